@@ -0,0 +1,491 @@
+/* file: A simple engine which retrieves data from Turtle files on disk
+ *
+ * This module maintains a cache of the triples parsed from each file, keyed
+ * by the file's path and the base URI it was parsed against, and validated
+ * against the file's size and modification time. The total (estimated)
+ * size of the cache is bounded, with the least-recently used entries being
+ * discarded first.
+ *
+ * Where the root can be watched for changes (see file-watch.c), cache hits
+ * are served without consulting the filesystem at all, for as long as the
+ * watcher continues to run.
+ *
+ * Paths are put into a canonical form (see file_cache_canon_()) before they
+ * are used as keys, so that the paths built from requests and those reported
+ * by the watcher agree.
+ *
+ * Author: Mo McRoberts <mo.mcroberts@bbc.co.uk>
+ *
+ * Copyright (c) 2014-2017 BBC
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include "p_file.h"
+
+/* The number of hash buckets */
+#define FILE_CACHE_BUCKETS              256
+
+/* The estimated cost, in bytes, of holding a triple in memory */
+#define FILE_CACHE_TRIPLE_COST          256
+
+struct file_cache_entry_struct
+{
+	char *path;
+	char *base;
+	time_t mtime;
+	off_t size;
+	librdf_storage *storage;
+	librdf_model *model;
+	size_t cost;
+	/* Hash chain */
+	struct file_cache_entry_struct *chain;
+	/* LRU list: most recently used first */
+	struct file_cache_entry_struct *prev;
+	struct file_cache_entry_struct *next;
+};
+
+typedef struct file_cache_entry_struct FILECACHE;
+
+static FILECACHE *buckets[FILE_CACHE_BUCKETS];
+static FILECACHE *lru_first, *lru_last;
+static size_t cache_used, cache_limit;
+static int watching;
+
+static char *file_cache_canon_(const char *path);
+static int file_cache_load_(const char *path, const char *base, librdf_model *model);
+static unsigned int file_cache_hash_(const char *path);
+static FILECACHE *file_cache_find_(const char *path, const char *base);
+static FILECACHE *file_cache_add_(const char *path, const char *base, struct stat *sbuf);
+static void file_cache_remove_(FILECACHE *entry);
+static void file_cache_touch_(FILECACHE *entry);
+static int file_cache_copy_(FILECACHE *entry, librdf_model *model);
+static void file_cache_account_(FILECACHE *entry);
+
+/* Initialise the cache, returning 1 if enabled, or 0 if not */
+int
+file_cache_init(const char *root)
+{
+	/* file:cache-size is the approximate limit on the memory used by the
+	 * cache, in megabytes; 0 disables caching
+	 */
+	if(!quilt_config_get_bool(QUILT_PLUGIN_NAME ":cache", 1))
+	{
+		return 0;
+	}
+	cache_limit = (size_t) quilt_config_get_int(QUILT_PLUGIN_NAME ":cache-size", 64) * 1024 * 1024;
+	if(!cache_limit)
+	{
+		return 0;
+	}
+	quilt_logf(LOG_DEBUG, QUILT_PLUGIN_NAME ": caching up to %luMB of parsed data\n", (unsigned long) (cache_limit / 1024 / 1024));
+	watching = file_watch_init(root);
+	return 1;
+}
+
+/* Add the triples from the file at path, parsed relative to base, to the
+ * model, using the cache where possible; returns 200 on success, or an HTTP
+ * status code otherwise.
+ */
+int
+file_cache_load(const char *path, const char *base, librdf_model *model)
+{
+	char *canon;
+	int r;
+
+	canon = file_cache_canon_(path);
+	if(!canon)
+	{
+		quilt_logf(LOG_CRIT, QUILT_PLUGIN_NAME ": failed to allocate memory for path\n");
+		return 500;
+	}
+	r = file_cache_load_(canon, base, model);
+	free(canon);
+	return r;
+}
+
+static int
+file_cache_load_(const char *path, const char *base, librdf_model *model)
+{
+	struct stat sbuf;
+	FILECACHE *entry;
+	int r;
+
+	if(watching && !file_watch_apply())
+	{
+		/* The watcher has stopped, and so changes will no longer be
+		 * noticed unless each file is checked
+		 */
+		quilt_logf(LOG_WARNING, QUILT_PLUGIN_NAME ": no longer watching for changes; cached files will be checked on each request\n");
+		watching = 0;
+	}
+	if(watching)
+	{
+		entry = file_cache_find_(path, base);
+		if(entry)
+		{
+			quilt_logf(LOG_DEBUG, QUILT_PLUGIN_NAME ": using cached copy of %s\n", path);
+			file_cache_touch_(entry);
+			return file_cache_copy_(entry, model) ? 500 : 200;
+		}
+	}
+	if(stat(path, &sbuf))
+	{
+		quilt_logf(LOG_ERR, QUILT_PLUGIN_NAME ": failed to open %s: %s\n", path, strerror(errno));
+		return 404;
+	}
+	entry = file_cache_find_(path, base);
+	if(entry && (entry->mtime != sbuf.st_mtime || entry->size != sbuf.st_size))
+	{
+		quilt_logf(LOG_DEBUG, QUILT_PLUGIN_NAME ": %s has been modified; discarding cached copy\n", path);
+		file_cache_remove_(entry);
+		entry = NULL;
+	}
+	if(entry)
+	{
+		quilt_logf(LOG_DEBUG, QUILT_PLUGIN_NAME ": using cached copy of %s\n", path);
+		file_cache_touch_(entry);
+		return file_cache_copy_(entry, model) ? 500 : 200;
+	}
+	entry = file_cache_add_(path, base, &sbuf);
+	if(!entry)
+	{
+		/* Fall back to parsing directly into the model */
+		return file_parse(path, base, model);
+	}
+	r = file_parse(path, base, entry->model);
+	if(r != 200)
+	{
+		file_cache_remove_(entry);
+		return r;
+	}
+	file_cache_account_(entry);
+	/* Evict least-recently used entries until the cache is within its
+	 * limit (but never the entry which has just been added)
+	 */
+	while(cache_used > cache_limit && lru_last && lru_last != entry)
+	{
+		quilt_logf(LOG_DEBUG, QUILT_PLUGIN_NAME ": evicting %s from cache\n", lru_last->path);
+		file_cache_remove_(lru_last);
+	}
+	return file_cache_copy_(entry, model) ? 500 : 200;
+}
+
+/* Parse the contents of a file obtained by file_read() into a new cache
+ * entry, without evicting anything; returns 0 on success, 1 if the cache
+ * is full, or -1 on error
+ */
+int
+file_cache_preload(const char *path, const char *base, FILEBUF *fb)
+{
+	FILECACHE *entry;
+	char *canon;
+
+	canon = file_cache_canon_(path);
+	if(!canon)
+	{
+		return -1;
+	}
+	if(file_cache_find_(canon, base))
+	{
+		free(canon);
+		return 0;
+	}
+	entry = file_cache_add_(canon, base, &(fb->sbuf));
+	free(canon);
+	if(!entry)
+	{
+		return -1;
+	}
+	if(file_parse_buffer(path, fb, base, entry->model) != 200)
+	{
+		file_cache_remove_(entry);
+		return -1;
+	}
+	file_cache_account_(entry);
+	if(cache_used > cache_limit)
+	{
+		file_cache_remove_(entry);
+		return 1;
+	}
+	return 0;
+}
+
+/* Return the estimated size of the cache's contents, in bytes */
+size_t
+file_cache_used(void)
+{
+	return cache_used;
+}
+
+/* Discard any cached copies of the file at path */
+void
+file_cache_invalidate(const char *path)
+{
+	FILECACHE *p, *next;
+	char *canon;
+
+	canon = file_cache_canon_(path);
+	if(!canon)
+	{
+		file_cache_flush();
+		return;
+	}
+	for(p = buckets[file_cache_hash_(canon)]; p; p = next)
+	{
+		next = p->chain;
+		if(!strcmp(p->path, canon))
+		{
+			quilt_logf(LOG_DEBUG, QUILT_PLUGIN_NAME ": %s has changed; discarding cached copy\n", canon);
+			file_cache_remove_(p);
+		}
+	}
+	free(canon);
+}
+
+/* Discard the entire contents of the cache */
+void
+file_cache_flush(void)
+{
+	while(lru_first)
+	{
+		file_cache_remove_(lru_first);
+	}
+}
+
+/* Return a copy of path with repeated slashes collapsed and any "." segments
+ * removed; ".." segments are left alone, as resolving them textually could
+ * change which file is named
+ */
+static char *
+file_cache_canon_(const char *path)
+{
+	char *buf, *p;
+	const char *s;
+
+	buf = (char *) malloc(strlen(path) + 1);
+	if(!buf)
+	{
+		return NULL;
+	}
+	p = buf;
+	for(s = path; *s; s++)
+	{
+		if(*s == '/' && p > buf && p[-1] == '/')
+		{
+			continue;
+		}
+		if(*s == '.' && (p == buf || p[-1] == '/') && (s[1] == '/' || !s[1]))
+		{
+			if(s[1])
+			{
+				s++;
+			}
+			continue;
+		}
+		*p = *s;
+		p++;
+	}
+	while(p > buf + 1 && p[-1] == '/')
+	{
+		p--;
+	}
+	if(p == buf && *path)
+	{
+		*p = '.';
+		p++;
+	}
+	*p = 0;
+	return buf;
+}
+
+static unsigned int
+file_cache_hash_(const char *path)
+{
+	unsigned int h;
+
+	for(h = 5381; *path; path++)
+	{
+		h = ((h << 5) + h) + (unsigned char) *path;
+	}
+	return h % FILE_CACHE_BUCKETS;
+}
+
+static FILECACHE *
+file_cache_find_(const char *path, const char *base)
+{
+	FILECACHE *p;
+
+	for(p = buckets[file_cache_hash_(path)]; p; p = p->chain)
+	{
+		if(!strcmp(p->path, path) && !strcmp(p->base, base))
+		{
+			return p;
+		}
+	}
+	return NULL;
+}
+
+/* Create a new, empty, cache entry and link it into the hash table and at
+ * the head of the LRU list
+ */
+static FILECACHE *
+file_cache_add_(const char *path, const char *base, struct stat *sbuf)
+{
+	FILECACHE *p;
+	unsigned int h;
+	librdf_world *world;
+
+	world = quilt_librdf_world();
+	p = (FILECACHE *) calloc(1, sizeof(FILECACHE));
+	if(!p)
+	{
+		quilt_logf(LOG_CRIT, QUILT_PLUGIN_NAME ": failed to allocate memory for cache entry\n");
+		return NULL;
+	}
+	p->path = strdup(path);
+	p->base = strdup(base);
+	p->mtime = sbuf->st_mtime;
+	p->size = sbuf->st_size;
+	if(p->path && p->base)
+	{
+		p->storage = librdf_new_storage(world, "hashes", NULL, "hash-type='memory',contexts='yes'");
+	}
+	if(p->storage)
+	{
+		p->model = librdf_new_model(world, p->storage, NULL);
+	}
+	if(!p->model)
+	{
+		quilt_logf(LOG_CRIT, QUILT_PLUGIN_NAME ": failed to create new RDF model for cache entry\n");
+		if(p->storage)
+		{
+			librdf_free_storage(p->storage);
+		}
+		free(p->path);
+		free(p->base);
+		free(p);
+		return NULL;
+	}
+	h = file_cache_hash_(path);
+	p->chain = buckets[h];
+	buckets[h] = p;
+	p->next = lru_first;
+	if(lru_first)
+	{
+		lru_first->prev = p;
+	}
+	lru_first = p;
+	if(!lru_last)
+	{
+		lru_last = p;
+	}
+	return p;
+}
+
+/* Unlink an entry from the hash table and the LRU list and free it */
+static void
+file_cache_remove_(FILECACHE *entry)
+{
+	FILECACHE **pp;
+
+	for(pp = &(buckets[file_cache_hash_(entry->path)]); *pp; pp = &((*pp)->chain))
+	{
+		if(*pp == entry)
+		{
+			*pp = entry->chain;
+			break;
+		}
+	}
+	if(entry->prev)
+	{
+		entry->prev->next = entry->next;
+	}
+	else
+	{
+		lru_first = entry->next;
+	}
+	if(entry->next)
+	{
+		entry->next->prev = entry->prev;
+	}
+	else
+	{
+		lru_last = entry->prev;
+	}
+	cache_used -= entry->cost;
+	librdf_free_model(entry->model);
+	librdf_free_storage(entry->storage);
+	free(entry->path);
+	free(entry->base);
+	free(entry);
+}
+
+/* Move an entry to the head of the LRU list */
+static void
+file_cache_touch_(FILECACHE *entry)
+{
+	if(entry == lru_first)
+	{
+		return;
+	}
+	entry->prev->next = entry->next;
+	if(entry->next)
+	{
+		entry->next->prev = entry->prev;
+	}
+	else
+	{
+		lru_last = entry->prev;
+	}
+	entry->prev = NULL;
+	entry->next = lru_first;
+	lru_first->prev = entry;
+	lru_first = entry;
+}
+
+/* Copy the statements held by a cache entry into a model */
+static int
+file_cache_copy_(FILECACHE *entry, librdf_model *model)
+{
+	librdf_stream *stream;
+
+	stream = librdf_model_as_stream(entry->model);
+	if(!stream)
+	{
+		quilt_logf(LOG_ERR, QUILT_PLUGIN_NAME ": failed to obtain statements from cached copy of %s\n", entry->path);
+		return -1;
+	}
+	if(librdf_model_add_statements(model, stream))
+	{
+		quilt_logf(LOG_ERR, QUILT_PLUGIN_NAME ": failed to add cached statements to model\n");
+		librdf_free_stream(stream);
+		return -1;
+	}
+	librdf_free_stream(stream);
+	return 0;
+}
+
+/* Estimate the memory used by a newly-populated entry and add it to the
+ * total
+ */
+static void
+file_cache_account_(FILECACHE *entry)
+{
+	entry->cost = sizeof(FILECACHE) + strlen(entry->path) + strlen(entry->base) + (librdf_model_size(entry->model) * FILE_CACHE_TRIPLE_COST);
+	cache_used += entry->cost;
+}
@@ -0,0 +1,285 @@
+/* file: A simple engine which retrieves data from Turtle files on disk
+ *
+ * This module populates the cache when the engine is initialised, if
+ * file:preload is set, so that the first requests for each resource do not
+ * incur the cost of parsing. Files are read by a pool of threads; because
+ * librdf is not thread-safe, parsing and adding to the cache are performed
+ * by one thread at a time.
+ *
+ * Author: Mo McRoberts <mo.mcroberts@bbc.co.uk>
+ *
+ * Copyright (c) 2014-2017 BBC
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include "p_file.h"
+
+#include <ftw.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+
+/* The maximum number of threads used to read files */
+#define FILE_PRELOAD_MAXTHREADS         64
+
+struct file_preload_struct
+{
+	char *path;
+	char *base;
+};
+
+static struct file_preload_struct *files;
+static size_t nfiles, filesize;
+static const char *preloadroot;
+static size_t rootlen;
+
+/* Shared between the loading threads */
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t parselock = PTHREAD_MUTEX_INITIALIZER;
+static size_t next, nloaded, nfailed;
+static int full;
+
+static int file_preload_cb_(const char *path, const struct stat *sbuf, int flag, struct FTW *ftw);
+static void *file_preload_thread_(void *arg);
+static void file_preload_free_(void);
+
+/* Parse every file beneath root into the cache; returns 0 on success, or
+ * -1 if the files could not be enumerated
+ */
+int
+file_preload(const char *root)
+{
+	pthread_t threads[FILE_PRELOAD_MAXTHREADS];
+	struct rusage ru;
+	unsigned long long start;
+	char *realroot;
+	int nthreads, c, r;
+
+	start = quilt_clock();
+	/* The root may be a symbolic link (for example, one which is switched
+	 * between releases), which nftw() would not otherwise descend into;
+	 * files are nonetheless recorded by their paths beneath root, as
+	 * file_process() will construct them
+	 */
+	realroot = realpath(root, NULL);
+	if(!realroot)
+	{
+		quilt_logf(LOG_ERR, QUILT_PLUGIN_NAME ": failed to resolve %s for preloading: %s\n", root, strerror(errno));
+		return -1;
+	}
+	preloadroot = root;
+	rootlen = strlen(realroot);
+	r = nftw(realroot, file_preload_cb_, 16, FTW_PHYS);
+	if(r)
+	{
+		quilt_logf(LOG_ERR, QUILT_PLUGIN_NAME ": failed to enumerate files beneath %s for preloading: %s\n", root, strerror(errno));
+		free(realroot);
+		file_preload_free_();
+		return -1;
+	}
+	free(realroot);
+	nthreads = quilt_config_get_int(QUILT_PLUGIN_NAME ":preload-threads", 4);
+	if(nthreads < 1)
+	{
+		nthreads = 1;
+	}
+	if(nthreads > FILE_PRELOAD_MAXTHREADS)
+	{
+		nthreads = FILE_PRELOAD_MAXTHREADS;
+	}
+	if((size_t) nthreads > nfiles)
+	{
+		nthreads = (nfiles ? nfiles : 1);
+	}
+	quilt_logf(LOG_DEBUG, QUILT_PLUGIN_NAME ": preloading %lu files using %d threads\n", (unsigned long) nfiles, nthreads);
+	for(c = 0; c < nthreads; c++)
+	{
+		if(pthread_create(&(threads[c]), NULL, file_preload_thread_, NULL))
+		{
+			quilt_logf(LOG_WARNING, QUILT_PLUGIN_NAME ": failed to create preloading thread\n");
+			break;
+		}
+	}
+	if(!c)
+	{
+		/* Load everything from this thread instead */
+		file_preload_thread_(NULL);
+	}
+	nthreads = c;
+	for(c = 0; c < nthreads; c++)
+	{
+		pthread_join(threads[c], NULL);
+	}
+	if(full)
+	{
+		quilt_logf(LOG_WARNING, QUILT_PLUGIN_NAME ": cache is full; not all files have been preloaded (consider increasing file:cache-size)\n");
+	}
+	memset(&ru, 0, sizeof(ru));
+	getrusage(RUSAGE_SELF, &ru);
+	quilt_logf(LOG_INFO, QUILT_PLUGIN_NAME ": preloaded %lu of %lu files in %llums (%lu failed); cache holds approximately %luKB, maximum resident set size is %ldKB\n",
+		(unsigned long) nloaded, (unsigned long) nfiles, quilt_clock() - start, (unsigned long) nfailed,
+		(unsigned long) (file_cache_used() / 1024), ru.ru_maxrss);
+	file_preload_free_();
+	return 0;
+}
+
+/* nftw() callback: record each .ttl file found beneath the root along with
+ * the subject URI of the resource it describes, which is the base URI that
+ * a request for it will use to parse and cache it
+ */
+static int
+file_preload_cb_(const char *path, const struct stat *sbuf, int flag, struct FTW *ftw)
+{
+	struct file_preload_struct *p;
+	const char *rel;
+	char *reqpath;
+	size_t len;
+
+	(void) sbuf;
+	(void) ftw;
+
+	if(flag != FTW_F)
+	{
+		return 0;
+	}
+	len = strlen(path);
+	if(len < rootlen + 5 || strcmp(&(path[len - 4]), ".ttl"))
+	{
+		return 0;
+	}
+	rel = path + rootlen;
+	while(*rel == '/')
+	{
+		rel++;
+	}
+	len = strlen(rel) - 4;
+	/* A request path ends at the first '.', so files whose names contain
+	 * any other can never be requested
+	 */
+	if(memchr(rel, '.', len))
+	{
+		return 0;
+	}
+	if(nfiles + 1 > filesize)
+	{
+		filesize += 64;
+		p = (struct file_preload_struct *) realloc(files, filesize * sizeof(struct file_preload_struct));
+		if(!p)
+		{
+			return -1;
+		}
+		files = p;
+	}
+	p = &(files[nfiles]);
+	/* The path and subject which file_process() would use: root + '/' +
+	 * rel, and the subject of the request path '/' + rel (less '.ttl'),
+	 * where "/index" is the home resource, "/"
+	 */
+	p->path = (char *) malloc(strlen(preloadroot) + 1 + strlen(rel) + 1);
+	reqpath = (char *) malloc(len + 2);
+	if(!p->path || !reqpath)
+	{
+		free(p->path);
+		free(reqpath);
+		return -1;
+	}
+	strcpy(p->path, preloadroot);
+	strcat(p->path, "/");
+	strcat(p->path, rel);
+	reqpath[0] = '/';
+	memcpy(&(reqpath[1]), rel, len);
+	reqpath[len + 1] = 0;
+	if(!strcmp(reqpath, "/index"))
+	{
+		reqpath[1] = 0;
+	}
+	p->base = quilt_request_subject_path(reqpath);
+	free(reqpath);
+	if(!p->base)
+	{
+		free(p->path);
+		return -1;
+	}
+	nfiles++;
+	return 0;
+}
+
+static void *
+file_preload_thread_(void *arg)
+{
+	struct file_preload_struct *p;
+	FILEBUF fb;
+	int r;
+
+	(void) arg;
+
+	for(;;)
+	{
+		pthread_mutex_lock(&lock);
+		if(full || next >= nfiles)
+		{
+			pthread_mutex_unlock(&lock);
+			break;
+		}
+		p = &(files[next]);
+		next++;
+		pthread_mutex_unlock(&lock);
+		if(file_read(p->path, &fb) != 200)
+		{
+			r = -1;
+		}
+		else
+		{
+			pthread_mutex_lock(&parselock);
+			r = file_cache_preload(p->path, p->base, &fb);
+			pthread_mutex_unlock(&parselock);
+			file_release(&fb);
+		}
+		pthread_mutex_lock(&lock);
+		if(!r)
+		{
+			nloaded++;
+		}
+		else if(r > 0)
+		{
+			full = 1;
+		}
+		else
+		{
+			nfailed++;
+		}
+		pthread_mutex_unlock(&lock);
+	}
+	return NULL;
+}
+
+static void
+file_preload_free_(void)
+{
+	size_t c;
+
+	for(c = 0; c < nfiles; c++)
+	{
+		free(files[c].path);
+		free(files[c].base);
+	}
+	free(files);
+	files = NULL;
+	nfiles = 0;
+	filesize = 0;
+}
@@ -0,0 +1,289 @@
+/* file: A simple engine which retrieves data from Turtle files on disk
+ *
+ * This module serves resources from a snapshot compiled by quilt-snapshot,
+ * which is memory-mapped when the engine is initialised; no parsing is
+ * performed when handling requests.
+ *
+ * Author: Mo McRoberts <mo.mcroberts@bbc.co.uk>
+ *
+ * Copyright (c) 2014-2017 BBC
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include "p_file.h"
+#include "p_snapshot.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+static const unsigned char *snapshot;
+static size_t snapshotlen;
+static const struct snapshot_header_struct *header;
+static const char *strings;
+static const struct snapshot_term_struct *terms;
+static const struct snapshot_resource_struct *resources;
+static const struct snapshot_triple_struct *triples;
+
+static int file_snapshot_check_(const char *path);
+static int file_snapshot_cmp_(const void *key, const void *member);
+static librdf_node *file_snapshot_node_(librdf_world *world, uint32_t index);
+
+/* Map the snapshot at path */
+int
+file_snapshot_open(const char *path)
+{
+	struct stat sbuf;
+	int fd;
+	void *p;
+
+	fd = open(path, O_RDONLY);
+	if(fd == -1)
+	{
+		quilt_logf(LOG_CRIT, QUILT_PLUGIN_NAME ": failed to open snapshot %s: %s\n", path, strerror(errno));
+		return -1;
+	}
+	if(fstat(fd, &sbuf))
+	{
+		quilt_logf(LOG_CRIT, QUILT_PLUGIN_NAME ": failed to obtain information about snapshot %s: %s\n", path, strerror(errno));
+		close(fd);
+		return -1;
+	}
+	if((size_t) sbuf.st_size < sizeof(struct snapshot_header_struct))
+	{
+		quilt_logf(LOG_CRIT, QUILT_PLUGIN_NAME ": %s is not a valid snapshot\n", path);
+		close(fd);
+		return -1;
+	}
+	p = mmap(NULL, sbuf.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if(p == MAP_FAILED)
+	{
+		quilt_logf(LOG_CRIT, QUILT_PLUGIN_NAME ": failed to map snapshot %s: %s\n", path, strerror(errno));
+		return -1;
+	}
+	snapshot = (const unsigned char *) p;
+	snapshotlen = sbuf.st_size;
+	header = (const struct snapshot_header_struct *) snapshot;
+	if(file_snapshot_check_(path))
+	{
+		munmap(p, snapshotlen);
+		snapshot = NULL;
+		header = NULL;
+		return -1;
+	}
+	strings = (const char *) (snapshot + header->strings);
+	terms = (const struct snapshot_term_struct *) (snapshot + header->terms);
+	resources = (const struct snapshot_resource_struct *) (snapshot + header->resources);
+	triples = (const struct snapshot_triple_struct *) (snapshot + header->triples);
+	quilt_logf(LOG_INFO, QUILT_PLUGIN_NAME ": mapped snapshot %s (%lu resources, %lu triples, %lu terms)\n", path,
+		(unsigned long) header->nresources, (unsigned long) header->ntriples, (unsigned long) header->nterms);
+	return 0;
+}
+
+/* Add the triples for the resource identified by key to the model; returns
+ * 200 on success or an HTTP status code otherwise
+ */
+int
+file_snapshot_load(const char *key, librdf_model *model)
+{
+	const struct snapshot_resource_struct *res;
+	const struct snapshot_triple_struct *t;
+	librdf_world *world;
+	librdf_node *s, *p, *o, *g, *lastsubj, *lastpred;
+	librdf_statement *st;
+	uint32_t c;
+	int r;
+
+	res = (const struct snapshot_resource_struct *) bsearch(key, resources, header->nresources, sizeof(struct snapshot_resource_struct), file_snapshot_cmp_);
+	if(!res)
+	{
+		quilt_logf(LOG_ERR, QUILT_PLUGIN_NAME ": '%s' is not present in the snapshot\n", key);
+		return 404;
+	}
+	world = quilt_librdf_world();
+	lastsubj = NULL;
+	lastpred = NULL;
+	r = 200;
+	for(c = 0; c < res->count && r == 200; c++)
+	{
+		t = &(triples[res->first + c]);
+		/* Consecutive triples usually share a subject, and often a
+		 * predicate: re-use the nodes rather than creating new ones
+		 */
+		if(lastsubj && t->s == t[-1].s)
+		{
+			s = librdf_new_node_from_node(lastsubj);
+		}
+		else
+		{
+			s = file_snapshot_node_(world, t->s);
+		}
+		if(lastpred && t->p == t[-1].p)
+		{
+			p = librdf_new_node_from_node(lastpred);
+		}
+		else
+		{
+			p = file_snapshot_node_(world, t->p);
+		}
+		o = file_snapshot_node_(world, t->o);
+		if(!s || !p || !o)
+		{
+			quilt_logf(LOG_ERR, QUILT_PLUGIN_NAME ": failed to create nodes for '%s'\n", key);
+			if(s)
+			{
+				librdf_free_node(s);
+			}
+			if(p)
+			{
+				librdf_free_node(p);
+			}
+			if(o)
+			{
+				librdf_free_node(o);
+			}
+			r = 500;
+			break;
+		}
+		if(lastsubj)
+		{
+			librdf_free_node(lastsubj);
+		}
+		if(lastpred)
+		{
+			librdf_free_node(lastpred);
+		}
+		lastsubj = librdf_new_node_from_node(s);
+		lastpred = librdf_new_node_from_node(p);
+		st = librdf_new_statement_from_nodes(world, s, p, o);
+		if(!st)
+		{
+			r = 500;
+			break;
+		}
+		if(t->g != SNAPSHOT_NONE && (g = file_snapshot_node_(world, t->g)))
+		{
+			if(librdf_model_context_add_statement(model, g, st))
+			{
+				r = 500;
+			}
+			librdf_free_node(g);
+		}
+		else if(librdf_model_add_statement(model, st))
+		{
+			r = 500;
+		}
+		librdf_free_statement(st);
+	}
+	if(lastsubj)
+	{
+		librdf_free_node(lastsubj);
+	}
+	if(lastpred)
+	{
+		librdf_free_node(lastpred);
+	}
+	return r;
+}
+
+/* Verify that the offsets and counts in the header are consistent with the
+ * size of the snapshot, and that each resource refers only to strings and
+ * triples within it, so that they can be relied upon when serving
+ */
+static int
+file_snapshot_check_(const char *path)
+{
+	const struct snapshot_resource_struct *res;
+	uint64_t c;
+
+	if(memcmp(header->magic, SNAPSHOT_MAGIC, sizeof(header->magic)) || header->version != SNAPSHOT_VERSION)
+	{
+		quilt_logf(LOG_CRIT, QUILT_PLUGIN_NAME ": %s is not a valid version %d snapshot\n", path, SNAPSHOT_VERSION);
+		return -1;
+	}
+	if(header->strings > snapshotlen || header->stringslen > snapshotlen - header->strings ||
+	   header->terms > snapshotlen || header->nterms > (snapshotlen - header->terms) / sizeof(struct snapshot_term_struct) ||
+	   header->resources > snapshotlen || header->nresources > (snapshotlen - header->resources) / sizeof(struct snapshot_resource_struct) ||
+	   header->triples > snapshotlen || header->ntriples > (snapshotlen - header->triples) / sizeof(struct snapshot_triple_struct) ||
+	   !header->stringslen || snapshot[header->strings + header->stringslen - 1])
+	{
+		quilt_logf(LOG_CRIT, QUILT_PLUGIN_NAME ": snapshot %s is truncated or corrupt\n", path);
+		return -1;
+	}
+	res = (const struct snapshot_resource_struct *) (snapshot + header->resources);
+	for(c = 0; c < header->nresources; c++)
+	{
+		if(res[c].key >= header->stringslen || res[c].first > header->ntriples ||
+		   res[c].count > header->ntriples - res[c].first)
+		{
+			quilt_logf(LOG_CRIT, QUILT_PLUGIN_NAME ": snapshot %s is corrupt (resource %lu is invalid)\n", path, (unsigned long) c);
+			return -1;
+		}
+	}
+	return 0;
+}
+
+static int
+file_snapshot_cmp_(const void *key, const void *member)
+{
+	const struct snapshot_resource_struct *res;
+
+	res = (const struct snapshot_resource_struct *) member;
+	return strcmp((const char *) key, &(strings[res->key]));
+}
+
+/* Create a new librdf node for a snapshot term */
+static librdf_node *
+file_snapshot_node_(librdf_world *world, uint32_t index)
+{
+	const struct snapshot_term_struct *term;
+	librdf_node *node;
+	librdf_uri *dt;
+
+	if(index >= header->nterms)
+	{
+		return NULL;
+	}
+	term = &(terms[index]);
+	if(term->value >= header->stringslen)
+	{
+		return NULL;
+	}
+	switch(term->type)
+	{
+	case SNT_URI:
+		return librdf_new_node_from_uri_string(world, (const unsigned char *) &(strings[term->value]));
+	case SNT_BNODE:
+		return librdf_new_node_from_blank_identifier(world, (const unsigned char *) &(strings[term->value]));
+	case SNT_LITERAL:
+		dt = NULL;
+		if(term->datatype < header->nterms && terms[term->datatype].value < header->stringslen)
+		{
+			dt = librdf_new_uri(world, (const unsigned char *) &(strings[terms[term->datatype].value]));
+		}
+		node = librdf_new_node_from_typed_literal(world, (const unsigned char *) &(strings[term->value]),
+			(term->lang < header->stringslen ? &(strings[term->lang]) : NULL), dt);
+		if(dt)
+		{
+			librdf_free_uri(dt);
+		}
+		return node;
+	}
+	return NULL;
+}
@@ -0,0 +1,439 @@
+/* file: A simple engine which retrieves data from Turtle files on disk
+ *
+ * This module watches the root directory using inotify, so that the cache
+ * can be invalidated when files are modified or removed without having to
+ * stat() them on every request. Replacing the root itself (for example,
+ * by atomically switching a symbolic link to a new release directory)
+ * causes the whole cache to be discarded.
+ *
+ * The watcher thread never touches the cache (or librdf) itself: it records
+ * the paths which have changed, and the changes are applied by the thread
+ * handling requests when it next consults the cache. If the watcher thread
+ * stops, the cache is discarded and file_watch_apply() reports that it is no
+ * longer running, so that cached files are checked on each request instead.
+ *
+ * Author: Mo McRoberts <mo.mcroberts@bbc.co.uk>
+ *
+ * Copyright (c) 2014-2017 BBC
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include "p_file.h"
+
+#ifdef HAVE_SYS_INOTIFY_H
+
+# include <unistd.h>
+# include <limits.h>
+# include <ftw.h>
+# include <pthread.h>
+# include <sys/inotify.h>
+
+/* The number of pending invalidations beyond which the whole cache is
+ * discarded instead
+ */
+# define FILE_WATCH_MAXPENDING          1024
+
+# define FILE_WATCH_EVENTS              (IN_CLOSE_WRITE|IN_CREATE|IN_DELETE|IN_MOVED_FROM|IN_MOVED_TO|IN_ATTRIB|IN_DELETE_SELF|IN_MOVE_SELF)
+# define FILE_WATCH_PARENT_EVENTS       (IN_CREATE|IN_DELETE|IN_MOVED_FROM|IN_MOVED_TO)
+
+struct file_watch_struct
+{
+	int wd;
+	char *path;
+};
+
+static char *root;
+static char *rootname;
+static int ifd = -1;
+static int parentwd = -1;
+static struct file_watch_struct *watches;
+static size_t nwatches, watchsize;
+static pthread_t thread;
+
+/* Shared between the watcher and request threads */
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static char **pending;
+static size_t npending;
+static int flushall;
+/* Nonzero while the watcher thread is running */
+static int alive;
+
+static void *file_watch_thread_(void *arg);
+static int file_watch_tree_(void);
+static int file_watch_dir_cb_(const char *path, const struct stat *sbuf, int flag, struct FTW *ftw);
+static int file_watch_add_(const char *path);
+static void file_watch_clear_(void);
+static const char *file_watch_path_(int wd);
+static void file_watch_changed_(const char *dir, const char *name);
+static void file_watch_flush_(void);
+
+/* Begin watching the tree beneath path; returns 1 if watching, 0 if not */
+int
+file_watch_init(const char *path)
+{
+	char *parent, *t;
+
+	if(!quilt_config_get_bool(QUILT_PLUGIN_NAME ":watch", 1))
+	{
+		return 0;
+	}
+	root = strdup(path);
+	parent = strdup(path);
+	if(!root || !parent)
+	{
+		quilt_logf(LOG_CRIT, QUILT_PLUGIN_NAME ": failed to allocate memory for watcher\n");
+		free(parent);
+		return 0;
+	}
+	t = strchr(root, 0);
+	while(t > root + 1 && t[-1] == '/')
+	{
+		t--;
+		*t = 0;
+	}
+	ifd = inotify_init();
+	if(ifd == -1)
+	{
+		quilt_logf(LOG_WARNING, QUILT_PLUGIN_NAME ": failed to initialise inotify (%s); cached files will be checked on each request\n", strerror(errno));
+		free(parent);
+		return 0;
+	}
+	/* Watch the directory containing the root, so that the root being
+	 * replaced can be detected
+	 */
+	strcpy(parent, root);
+	t = strrchr(parent, '/');
+	if(t && t[1])
+	{
+		rootname = strdup(t + 1);
+		if(t == parent)
+		{
+			t++;
+		}
+		*t = 0;
+		parentwd = inotify_add_watch(ifd, (*parent ? parent : "."), FILE_WATCH_PARENT_EVENTS|IN_DONT_FOLLOW);
+	}
+	free(parent);
+	if(file_watch_tree_())
+	{
+		close(ifd);
+		ifd = -1;
+		return 0;
+	}
+	alive = 1;
+	if(pthread_create(&thread, NULL, file_watch_thread_, NULL))
+	{
+		quilt_logf(LOG_WARNING, QUILT_PLUGIN_NAME ": failed to create watcher thread; cached files will be checked on each request\n");
+		alive = 0;
+		close(ifd);
+		ifd = -1;
+		return 0;
+	}
+	quilt_logf(LOG_DEBUG, QUILT_PLUGIN_NAME ": watching %lu directories beneath %s\n", (unsigned long) nwatches, root);
+	return 1;
+}
+
+/* Apply any invalidations recorded by the watcher thread to the cache; must
+ * be invoked by the thread which owns the cache. Returns 1 if the watcher
+ * is still running, or 0 if it has stopped (in which case the cache has
+ * been discarded).
+ */
+int
+file_watch_apply(void)
+{
+	char **list;
+	size_t count, c;
+	int all, running;
+
+	pthread_mutex_lock(&lock);
+	list = pending;
+	count = npending;
+	all = flushall;
+	running = alive;
+	pending = NULL;
+	npending = 0;
+	flushall = 0;
+	pthread_mutex_unlock(&lock);
+	if(all)
+	{
+		quilt_logf(LOG_DEBUG, QUILT_PLUGIN_NAME ": discarding all cached files\n");
+		file_cache_flush();
+	}
+	for(c = 0; c < count; c++)
+	{
+		if(!all)
+		{
+			file_cache_invalidate(list[c]);
+		}
+		free(list[c]);
+	}
+	free(list);
+	return running;
+}
+
+static void *
+file_watch_thread_(void *arg)
+{
+	char buf[sizeof(struct inotify_event) + NAME_MAX + 1] __attribute__((aligned(__alignof__(struct inotify_event))));
+	const struct inotify_event *ev;
+	const char *dir;
+	ssize_t r;
+	char *p;
+
+	(void) arg;
+
+	for(;;)
+	{
+		r = read(ifd, buf, sizeof(buf));
+		if(r <= 0)
+		{
+			if(r == -1 && errno == EINTR)
+			{
+				continue;
+			}
+			quilt_logf(LOG_ERR, QUILT_PLUGIN_NAME ": failed to read inotify events: %s\n", strerror(errno));
+			break;
+		}
+		for(p = buf; p < buf + r; p += sizeof(struct inotify_event) + ev->len)
+		{
+			ev = (const struct inotify_event *) p;
+			if(ev->mask & IN_Q_OVERFLOW)
+			{
+				file_watch_flush_();
+				continue;
+			}
+			if(ev->wd == parentwd)
+			{
+				if(ev->len && rootname && !strcmp(ev->name, rootname))
+				{
+					/* The root has been replaced */
+					quilt_logf(LOG_INFO, QUILT_PLUGIN_NAME ": %s has been replaced\n", root);
+					file_watch_clear_();
+					file_watch_tree_();
+					file_watch_flush_();
+				}
+				continue;
+			}
+			if(ev->mask & IN_IGNORED)
+			{
+				continue;
+			}
+			dir = file_watch_path_(ev->wd);
+			if(!dir)
+			{
+				continue;
+			}
+			if((ev->mask & (IN_DELETE_SELF|IN_MOVE_SELF)) && !strcmp(dir, root))
+			{
+				file_watch_clear_();
+				file_watch_tree_();
+				file_watch_flush_();
+				continue;
+			}
+			if(!ev->len)
+			{
+				continue;
+			}
+			if(ev->mask & IN_ISDIR)
+			{
+				if(ev->mask & (IN_CREATE|IN_MOVED_TO))
+				{
+					/* Watch the new directory and anything beneath it */
+					file_watch_tree_();
+				}
+				if(ev->mask & (IN_DELETE|IN_MOVED_FROM|IN_MOVED_TO))
+				{
+					/* Any number of cached files beneath the directory
+					 * may have been removed or replaced
+					 */
+					file_watch_flush_();
+				}
+				continue;
+			}
+			file_watch_changed_(dir, ev->name);
+		}
+	}
+	/* Changes may have been missed, and will no longer be noticed */
+	pthread_mutex_lock(&lock);
+	alive = 0;
+	flushall = 1;
+	pthread_mutex_unlock(&lock);
+	return NULL;
+}
+
+/* Add watches for the root and every directory beneath it; directories
+ * which are already being watched are re-used by inotify
+ */
+static int
+file_watch_tree_(void)
+{
+	if(nftw(root, file_watch_dir_cb_, 16, 0))
+	{
+		quilt_logf(LOG_WARNING, QUILT_PLUGIN_NAME ": failed to watch %s: %s\n", root, strerror(errno));
+		return -1;
+	}
+	return 0;
+}
+
+static int
+file_watch_dir_cb_(const char *path, const struct stat *sbuf, int flag, struct FTW *ftw)
+{
+	(void) sbuf;
+	(void) ftw;
+
+	if(flag == FTW_D)
+	{
+		return file_watch_add_(path);
+	}
+	return 0;
+}
+
+static int
+file_watch_add_(const char *path)
+{
+	struct file_watch_struct *p;
+	size_t c;
+	int wd;
+
+	wd = inotify_add_watch(ifd, path, FILE_WATCH_EVENTS);
+	if(wd == -1)
+	{
+		quilt_logf(LOG_WARNING, QUILT_PLUGIN_NAME ": failed to watch %s: %s\n", path, strerror(errno));
+		return -1;
+	}
+	for(c = 0; c < nwatches; c++)
+	{
+		if(watches[c].wd == wd)
+		{
+			return 0;
+		}
+	}
+	if(nwatches + 1 > watchsize)
+	{
+		watchsize += 32;
+		p = (struct file_watch_struct *) realloc(watches, watchsize * sizeof(struct file_watch_struct));
+		if(!p)
+		{
+			return -1;
+		}
+		watches = p;
+	}
+	watches[nwatches].path = strdup(path);
+	if(!watches[nwatches].path)
+	{
+		return -1;
+	}
+	watches[nwatches].wd = wd;
+	nwatches++;
+	return 0;
+}
+
+/* Remove all of the watches beneath the root */
+static void
+file_watch_clear_(void)
+{
+	size_t c;
+
+	for(c = 0; c < nwatches; c++)
+	{
+		inotify_rm_watch(ifd, watches[c].wd);
+		free(watches[c].path);
+	}
+	nwatches = 0;
+}
+
+static const char *
+file_watch_path_(int wd)
+{
+	size_t c;
+
+	for(c = 0; c < nwatches; c++)
+	{
+		if(watches[c].wd == wd)
+		{
+			return watches[c].path;
+		}
+	}
+	return NULL;
+}
+
+/* Record that a file within a watched directory has changed */
+static void
+file_watch_changed_(const char *dir, const char *name)
+{
+	size_t len;
+	char *path, **p;
+
+	len = strlen(name);
+	if(len < 5 || strcmp(&(name[len - 4]), ".ttl"))
+	{
+		return;
+	}
+	path = (char *) malloc(strlen(dir) + len + 2);
+	if(!path)
+	{
+		file_watch_flush_();
+		return;
+	}
+	sprintf(path, "%s/%s", dir, name);
+	pthread_mutex_lock(&lock);
+	if(flushall || npending >= FILE_WATCH_MAXPENDING)
+	{
+		flushall = 1;
+		free(path);
+	}
+	else if((p = (char **) realloc(pending, (npending + 1) * sizeof(char *))))
+	{
+		pending = p;
+		pending[npending] = path;
+		npending++;
+	}
+	else
+	{
+		flushall = 1;
+		free(path);
+	}
+	pthread_mutex_unlock(&lock);
+}
+
+/* Record that the whole cache must be discarded */
+static void
+file_watch_flush_(void)
+{
+	pthread_mutex_lock(&lock);
+	flushall = 1;
+	pthread_mutex_unlock(&lock);
+}
+
+#else /*HAVE_SYS_INOTIFY_H*/
+
+int
+file_watch_init(const char *path)
+{
+	(void) path;
+
+	return 0;
+}
+
+int
+file_watch_apply(void)
+{
+	return 0;
+}
+
+#endif /*HAVE_SYS_INOTIFY_H*/
@@ -27,6 +27,9 @@
 static int file_process(QUILTREQ *request);
 
 static char *basepath;
+static int caching;
+static int snapshot;
+static size_t mmap_threshold;
 
 # ifndef HAVE_STRLCPY
 #  undef strlcpy
@@ -59,32 +62,70 @@ static char *basepath;
 int
 quilt_plugin_init(void)
 {
+	char *t;
+
 	if(quilt_plugin_register_engine(QUILT_PLUGIN_NAME, file_process))
 	{
 		quilt_logf(LOG_CRIT, QUILT_PLUGIN_NAME ": failed to register engine\n");
 		return -1;
 	}
 	basepath = quilt_config_geta("file:root", DATAROOTDIR "/" PACKAGE_TARNAME "/sample");
+	/* Paths are formed by appending '/' + the resource path to the root */
+	t = strchr(basepath, 0);
+	while(t > basepath + 1 && t[-1] == '/')
+	{
+		t--;
+		*t = 0;
+	}
+	/* Files at least this size are memory-mapped rather than read; 0 (the
+	 * default) means that files are never mapped. A mapped file which is
+	 * truncated while it is being parsed causes the process to receive
+	 * SIGBUS, and so this should only be enabled where files in the root
+	 * are replaced (e.g., renamed into place) rather than rewritten.
+	 */
+	mmap_threshold = quilt_config_get_int(QUILT_PLUGIN_NAME ":mmap-threshold", 0);
+	/* If file:snapshot is set, resources are served from a snapshot
+	 * compiled by quilt-snapshot rather than from the files in the root
+	 */
+	t = quilt_config_geta(QUILT_PLUGIN_NAME ":snapshot", NULL);
+	if(t)
+	{
+		if(file_snapshot_open(t))
+		{
+			free(t);
+			return -1;
+		}
+		free(t);
+		snapshot = 1;
+	}
+	/* A snapshot is never cached, and so the files in the root needn't be
+	 * watched for changes
+	 */
+	if(!snapshot)
+	{
+		caching = file_cache_init(basepath);
+	}
+	/* If file:preload is set, parse every file in the root into the cache
+	 * before any requests are handled
+	 */
+	if(caching && quilt_config_get_bool(QUILT_PLUGIN_NAME ":preload", 0))
+	{
+		file_preload(basepath);
+	}
 	return 0;
 }
 
 static int
 file_process(QUILTREQ *request)
 {
-	librdf_world *world;
-	librdf_parser *parser;
-	librdf_model *model;
-	librdf_uri *base;
-	const char *s, *path, *basestr;
+	const char *s, *path;
 	char *pathname;
 	size_t buflen, len;
-	FILE *f;
+	int r;
 	QUILTCANON *canonical;
 	
 	canonical = quilt_request_canonical(request);
 	path = quilt_request_path(request);
-	world = quilt_librdf_world();
-	model = quilt_request_model(request);
 
 	if(quilt_request_home(request))
 	{
@@ -101,6 +142,10 @@ file_process(QUILTREQ *request)
 	{
 		s++;
 	}
+	if(snapshot)
+	{
+		return file_snapshot_load(s, quilt_request_model(request));
+	}
 	len = strlen(basepath);
 	/* basepath + '/' + s + '.ttl' */
 	buflen = strlen(basepath) + 1 + strlen(s) + 4 + 1;
@@ -115,47 +160,146 @@ file_process(QUILTREQ *request)
 	pathname[len + 1] = 0;
 	strlcat(pathname, s, buflen);
 	strlcat(pathname, ".ttl", buflen);
-	f = fopen(pathname, "rb");
-	if(!f)
+	if(caching)
+	{
+		r = file_cache_load(pathname, quilt_request_subject(request), quilt_request_model(request));
+	}
+	else
+	{
+		r = file_parse(pathname, quilt_request_subject(request), quilt_request_model(request));
+	}
+	free(pathname);
+	/* On success, r is 200 (rather than 0), which causes the model to be
+	 * serialized automatically.
+	 */
+	return r;
+}
+
+/* Parse the Turtle file at pathname into the model, relative to the base URI
+ * basestr; returns 200 on success, or an HTTP status code otherwise.
+ */
+int
+file_parse(const char *pathname, const char *basestr, librdf_model *model)
+{
+	FILEBUF fb;
+	int r;
+
+	r = file_read(pathname, &fb);
+	if(r != 200)
+	{
+		return r;
+	}
+	r = file_parse_buffer(pathname, &fb, basestr, model);
+	file_release(&fb);
+	return r;
+}
+
+/* Obtain the contents of the file at pathname. If file:mmap-threshold is
+ * nonzero, files of at least that many bytes are mapped into memory and
+ * parsed in place; otherwise, files are read into a buffer.
+ */
+int
+file_read(const char *pathname, FILEBUF *fb)
+{
+	ssize_t r;
+	int fd;
+
+	memset(fb, 0, sizeof(FILEBUF));
+	fd = open(pathname, O_RDONLY);
+	if(fd == -1)
 	{
 		quilt_logf(LOG_ERR, QUILT_PLUGIN_NAME ": failed to open %s: %s\n", pathname, strerror(errno));
-		free(pathname);
 		return 404;
 	}
-	parser = librdf_new_parser(world, "turtle", NULL, NULL);
-	if(!parser)
+	if(fstat(fd, &(fb->sbuf)))
 	{
-		quilt_logf(LOG_CRIT, QUILT_PLUGIN_NAME ": failed to create Turtle parser\n");
-		fclose(f);
-		free(pathname);
-		return 404;
+		quilt_logf(LOG_ERR, QUILT_PLUGIN_NAME ": failed to obtain information about %s: %s\n", pathname, strerror(errno));
+		close(fd);
+		return 500;
+	}
+	fb->len = fb->sbuf.st_size;
+	if(!fb->len)
+	{
+		close(fd);
+		return 200;
 	}
-	basestr = quilt_request_subject(request);
-	base = librdf_new_uri(world, (const unsigned char *) basestr);
+	if(mmap_threshold && fb->len >= mmap_threshold)
+	{
+		fb->buf = (char *) mmap(NULL, fb->len, PROT_READ, MAP_PRIVATE, fd, 0);
+		if(fb->buf == MAP_FAILED)
+		{
+			quilt_logf(LOG_ERR, QUILT_PLUGIN_NAME ": failed to map %s: %s\n", pathname, strerror(errno));
+			fb->buf = NULL;
+			close(fd);
+			return 500;
+		}
+		fb->mapped = 1;
+		/* The parser reads the whole file once, from start to finish */
+		madvise(fb->buf, fb->len, MADV_SEQUENTIAL);
+		madvise(fb->buf, fb->len, MADV_WILLNEED);
+	}
+	else
+	{
+		fb->buf = (char *) malloc(fb->len);
+		if(!fb->buf)
+		{
+			quilt_logf(LOG_CRIT, QUILT_PLUGIN_NAME ": failed to allocate %u bytes\n", (unsigned) fb->len);
+			close(fd);
+			return 500;
+		}
+		r = read(fd, fb->buf, fb->len);
+		if(r < 0 || (size_t) r != fb->len)
+		{
+			quilt_logf(LOG_ERR, QUILT_PLUGIN_NAME ": failed to read %s: %s\n", pathname, (r < 0 ? strerror(errno) : "short read"));
+			file_release(fb);
+			close(fd);
+			return 500;
+		}
+	}
+	close(fd);
+	return 200;
+}
+
+/* Parse the contents of a file obtained by file_read() into the model */
+int
+file_parse_buffer(const char *pathname, FILEBUF *fb, const char *basestr, librdf_model *model)
+{
+	librdf_uri *base;
+	int status;
+
+	if(!fb->len)
+	{
+		return 200;
+	}
+	base = librdf_new_uri(quilt_librdf_world(), (const unsigned char *) basestr);
 	if(!base)
 	{
 		quilt_logf(LOG_CRIT, QUILT_PLUGIN_NAME ": failed to create new RDF URI from <%s>\n", basestr);
-		fclose(f);
-		free(pathname);
-		librdf_free_parser(parser);
 		return 500;
 	}
+	status = 200;
 	quilt_logf(LOG_DEBUG, QUILT_PLUGIN_NAME ": parsing %s\n", pathname);
-	if(librdf_parser_parse_file_handle_into_model(parser, f, 0, base, model))
+	if(quilt_model_parse_base(model, "text/turtle", fb->buf, fb->len, base))
 	{
 		quilt_logf(LOG_ERR, QUILT_PLUGIN_NAME ": failed to parse %s as Turtle\n", pathname);
-		fclose(f);
-		free(pathname);
-		librdf_free_uri(base);
-		librdf_free_parser(parser);
-		return 503;
+		status = 503;
 	}
-	fclose(f);
-	free(pathname);
 	librdf_free_uri(base);
-	librdf_free_parser(parser);
-	/* Returning 200 (rather than 0) causes the model to be serialized
-	 * automatically.
-	 */
-	return 200;
+	return status;
+}
+
+void
+file_release(FILEBUF *fb)
+{
+	if(fb->mapped)
+	{
+		munmap(fb->buf, fb->len);
+	}
+	else
+	{
+		free(fb->buf);
+	}
+	fb->buf = NULL;
+	fb->len = 0;
+	fb->mapped = 0;
 }
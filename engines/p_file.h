@@ -25,9 +25,43 @@
 # include <stdlib.h>
 # include <string.h>
 # include <errno.h>
+# include <sys/types.h>
+# include <sys/stat.h>
+# include <sys/mman.h>
+# include <fcntl.h>
+# include <unistd.h>
 
 # include "libquilt.h"
 
 # define QUILT_PLUGIN_NAME              "file"
 
+/* The contents of a file, as obtained by file_read() */
+typedef struct
+{
+	char *buf;
+	size_t len;
+	int mapped;
+	struct stat sbuf;
+} FILEBUF;
+
+int file_parse(const char *pathname, const char *basestr, librdf_model *model);
+int file_read(const char *pathname, FILEBUF *fb);
+int file_parse_buffer(const char *pathname, FILEBUF *fb, const char *basestr, librdf_model *model);
+void file_release(FILEBUF *fb);
+
+int file_cache_init(const char *root);
+int file_cache_load(const char *path, const char *base, librdf_model *model);
+void file_cache_invalidate(const char *path);
+void file_cache_flush(void);
+int file_cache_preload(const char *path, const char *base, FILEBUF *fb);
+size_t file_cache_used(void);
+
+int file_preload(const char *root);
+
+int file_watch_init(const char *root);
+int file_watch_apply(void);
+
+int file_snapshot_open(const char *path);
+int file_snapshot_load(const char *key, librdf_model *model);
+
 #endif /*!P_FILE_H_*/
@@ -23,10 +23,22 @@
 
 # include <stdlib.h>
 # include <string.h>
+# include <strings.h>
 # include <libsparqlclient.h>
 
 # include "libquilt.h"
 
 # define QUILT_PLUGIN_NAME              "resourcegraph"
 
+typedef enum
+{
+	RG_UNKNOWN,
+	RG_SELECT,
+	RG_CONSTRUCT,
+	RG_DESCRIBE
+} RGMODE;
+
+RGMODE resourcegraph_mode(const char *name);
+int resourcegraph_query(RGMODE mode, const char *subject, char *buf, librdf_model *model);
+
 #endif /*!P_RESOURCEGRAPH_H_*/
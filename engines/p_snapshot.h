@@ -0,0 +1,98 @@
+/* file: A simple engine which retrieves data from Turtle files on disk
+ *
+ * This header describes the snapshot format produced by quilt-snapshot and
+ * served by the file engine when file:snapshot is set. A snapshot is
+ * intended to be memory-mapped and used in place: it is written in the host
+ * byte order, and all offsets are relative to the start of the file.
+ *
+ *   header
+ *   strings    NUL-terminated strings, each referred to by its offset
+ *              within this block
+ *   terms      snapshot_term_struct[nterms]
+ *   resources  snapshot_resource_struct[nresources], sorted by key
+ *   triples    snapshot_triple_struct[ntriples], grouped by resource
+ *
+ * Author: Mo McRoberts <mo.mcroberts@bbc.co.uk>
+ *
+ * Copyright (c) 2014-2017 BBC
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef P_SNAPSHOT_H_
+# define P_SNAPSHOT_H_                  1
+
+# include <stdint.h>
+
+# define SNAPSHOT_MAGIC                 "QSNAPSHT"
+# define SNAPSHOT_VERSION               1
+/* Used in place of a string offset or term index which is not present */
+# define SNAPSHOT_NONE                  0xffffffff
+
+typedef enum
+{
+	SNT_URI = 1,
+	SNT_BNODE,
+	SNT_LITERAL
+} SNAPTERMTYPE;
+
+struct snapshot_header_struct
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t nterms;
+	uint32_t nresources;
+	uint32_t ntriples;
+	uint64_t strings;
+	uint64_t stringslen;
+	uint64_t terms;
+	uint64_t resources;
+	uint64_t triples;
+};
+
+struct snapshot_term_struct
+{
+	/* SNAPTERMTYPE */
+	uint32_t type;
+	/* The URI, blank node identifier or literal value */
+	uint32_t value;
+	/* The language of a literal, or SNAPSHOT_NONE */
+	uint32_t lang;
+	/* The index of the datatype URI term of a literal, or SNAPSHOT_NONE */
+	uint32_t datatype;
+};
+
+struct snapshot_resource_struct
+{
+	/* The resource path relative to the root, without the .ttl suffix;
+	 * the home resource's key is "index"
+	 */
+	uint32_t key;
+	/* The index of the resource's first triple, and the number of triples */
+	uint32_t first;
+	uint32_t count;
+	uint32_t reserved;
+};
+
+struct snapshot_triple_struct
+{
+	/* Term indices: subject, predicate, object, and graph (or
+	 * SNAPSHOT_NONE)
+	 */
+	uint32_t s;
+	uint32_t p;
+	uint32_t o;
+	uint32_t g;
+};
+
+#endif /*!P_SNAPSHOT_H_*/
@@ -0,0 +1,663 @@
+/* quilt-snapshot: Compile a directory of Turtle files, as served by the file
+ * engine, into a single memory-mappable snapshot (see p_snapshot.h).
+ *
+ * Author: Mo McRoberts <mo.mcroberts@bbc.co.uk>
+ *
+ * Copyright (c) 2014-2017 BBC
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <ftw.h>
+#include <librdf.h>
+#include <liburi.h>
+
+#include "p_snapshot.h"
+
+/* An open-addressed hash table of 32-bit values (string offsets or term
+ * indices); empty slots hold SNAPSHOT_NONE
+ */
+struct table_struct
+{
+	uint32_t *slots;
+	size_t size;
+	size_t count;
+};
+
+struct resource_struct
+{
+	char *key;
+	char *path;
+};
+
+static const char *progname = "quilt-snapshot";
+static librdf_world *world;
+static const char *base;
+static URI *baseuri;
+static char *root;
+static size_t rootlen;
+
+/* The snapshot being built */
+static char *strbuf;
+static size_t stringslen, strsize;
+static struct table_struct strtab;
+static struct snapshot_term_struct *terms;
+static size_t nterms, termsize;
+static struct table_struct termtab;
+static struct snapshot_triple_struct *triples;
+static size_t ntriples, triplesize;
+static struct resource_struct *resources;
+static size_t nresources, resourcesize;
+
+static int process_args(int argc, char **argv);
+static void usage(void);
+static int collect(const char *path, const struct stat *sbuf, int flag, struct FTW *ftw);
+static int compare_resources(const void *a, const void *b);
+static int compile_resource(struct resource_struct *res, struct snapshot_resource_struct *out);
+static uint32_t intern_node(librdf_node *node);
+static uint32_t intern_string(const char *str);
+static uint32_t intern_term(uint32_t type, uint32_t value, uint32_t lang, uint32_t datatype);
+static int table_grow(struct table_struct *table, unsigned int (*hash)(uint32_t value));
+static unsigned int hash_string(const char *str);
+static unsigned int hash_strval(uint32_t offset);
+static unsigned int hash_term(uint32_t index);
+static int write_snapshot(const char *path, struct snapshot_resource_struct *res);
+static int write_block(FILE *f, const void *data, size_t len, uint64_t *offset);
+static void too_large(const char *what);
+
+int
+main(int argc, char **argv)
+{
+	struct snapshot_resource_struct *out;
+	size_t c;
+
+	if(process_args(argc, argv))
+	{
+		return 1;
+	}
+	world = librdf_new_world();
+	if(!world)
+	{
+		fprintf(stderr, "%s: failed to create librdf world\n", progname);
+		return 1;
+	}
+	librdf_world_open(world);
+	baseuri = uri_create_str(base, NULL);
+	if(!baseuri)
+	{
+		fprintf(stderr, "%s: failed to parse base URI <%s>\n", progname, base);
+		return 1;
+	}
+	rootlen = strlen(root);
+	if(nftw(root, collect, 16, FTW_PHYS))
+	{
+		fprintf(stderr, "%s: failed to read %s: %s\n", progname, root, strerror(errno));
+		return 1;
+	}
+	qsort(resources, nresources, sizeof(struct resource_struct), compare_resources);
+	out = (struct snapshot_resource_struct *) calloc(nresources ? nresources : 1, sizeof(struct snapshot_resource_struct));
+	if(!out)
+	{
+		fprintf(stderr, "%s: failed to allocate memory\n", progname);
+		return 1;
+	}
+	/* Ensure that the string block is never empty */
+	intern_string("");
+	for(c = 0; c < nresources; c++)
+	{
+		if(compile_resource(&(resources[c]), &(out[c])))
+		{
+			return 1;
+		}
+	}
+	if(write_snapshot(argv[optind + 1], out))
+	{
+		return 1;
+	}
+	fprintf(stderr, "%s: wrote %lu resources (%lu triples, %lu terms, %lu bytes of strings) to %s\n", progname,
+		(unsigned long) nresources, (unsigned long) ntriples, (unsigned long) nterms, (unsigned long) stringslen, argv[optind + 1]);
+	return 0;
+}
+
+static int
+process_args(int argc, char **argv)
+{
+	const char *t;
+	int c;
+
+	if(argc > 0 && argv[0])
+	{
+		t = strrchr(argv[0], '/');
+		progname = t ? t + 1 : argv[0];
+	}
+	while((c = getopt(argc, argv, "hb:")) != -1)
+	{
+		switch(c)
+		{
+		case 'h':
+			usage();
+			exit(0);
+		case 'b':
+			base = optarg;
+			break;
+		default:
+			usage();
+			return -1;
+		}
+	}
+	if(argc - optind != 2)
+	{
+		usage();
+		return -1;
+	}
+	/* Parsed triples are only useful if they have the subjects which the
+	 * server will look for, and so the base URI must be the one which it
+	 * is configured with
+	 */
+	if(!base)
+	{
+		fprintf(stderr, "%s: the base URI must be specified with -b\n", progname);
+		usage();
+		return -1;
+	}
+	/* The root may be a symbolic link, which nftw() would not otherwise
+	 * descend into
+	 */
+	root = realpath(argv[optind], NULL);
+	if(!root)
+	{
+		fprintf(stderr, "%s: %s: %s\n", progname, argv[optind], strerror(errno));
+		return -1;
+	}
+	return 0;
+}
+
+static void
+usage(void)
+{
+	fprintf(stderr, "Usage: %s [OPTIONS] -b BASE ROOT SNAPSHOT\n"
+			"\n"
+			"Compiles the Turtle files beneath ROOT into SNAPSHOT\n"
+			"\n"
+			"OPTIONS is one or more of:\n"
+			"  -h                   Print this notice and exit\n"
+			"  -b BASE              Specify the base URI, which must match\n"
+			"                       [quilt] base in quilt.conf (required)\n",
+			progname);
+}
+
+/* nftw() callback: record each .ttl file found beneath the root */
+static int
+collect(const char *path, const struct stat *sbuf, int flag, struct FTW *ftw)
+{
+	struct resource_struct *p;
+	const char *rel;
+	size_t len;
+
+	(void) sbuf;
+	(void) ftw;
+
+	if(flag != FTW_F)
+	{
+		return 0;
+	}
+	len = strlen(path);
+	if(len < rootlen + 5 || strcmp(&(path[len - 4]), ".ttl"))
+	{
+		return 0;
+	}
+	rel = path + rootlen;
+	while(*rel == '/')
+	{
+		rel++;
+	}
+	/* A request path ends at the first '.', so files whose names contain
+	 * any other can never be requested
+	 */
+	if(memchr(rel, '.', strlen(rel) - 4))
+	{
+		return 0;
+	}
+	if(nresources >= SNAPSHOT_NONE)
+	{
+		too_large("resources");
+		return -1;
+	}
+	if(nresources + 1 > resourcesize)
+	{
+		resourcesize += 64;
+		p = (struct resource_struct *) realloc(resources, resourcesize * sizeof(struct resource_struct));
+		if(!p)
+		{
+			return -1;
+		}
+		resources = p;
+	}
+	p = &(resources[nresources]);
+	p->path = strdup(path);
+	p->key = strdup(rel);
+	if(!p->path || !p->key)
+	{
+		return -1;
+	}
+	p->key[strlen(p->key) - 4] = 0;
+	nresources++;
+	return 0;
+}
+
+static int
+compare_resources(const void *a, const void *b)
+{
+	return strcmp(((const struct resource_struct *) a)->key, ((const struct resource_struct *) b)->key);
+}
+
+/* Parse a Turtle file relative to the URI it would be served at, and add its
+ * triples to the snapshot
+ */
+static int
+compile_resource(struct resource_struct *res, struct snapshot_resource_struct *out)
+{
+	librdf_storage *storage;
+	librdf_model *model;
+	librdf_parser *parser;
+	librdf_stream *stream;
+	librdf_statement *st;
+	librdf_uri *uri;
+	struct snapshot_triple_struct *p;
+	URI *subject;
+	char *buf;
+	FILE *f;
+
+	/* The file engine parses relative to the request's subject URI, which
+	 * is the request path ("/" for the home resource) resolved against the
+	 * base URI (see quilt_request_subject_path())
+	 */
+	buf = (char *) malloc(strlen(res->key) + 2);
+	if(!buf)
+	{
+		return -1;
+	}
+	buf[0] = '/';
+	strcpy(&(buf[1]), strcmp(res->key, "index") ? res->key : "");
+	subject = uri_create_str(buf, baseuri);
+	free(buf);
+	buf = subject ? uri_stralloc(subject) : NULL;
+	uri = buf ? librdf_new_uri(world, (const unsigned char *) buf) : NULL;
+	free(buf);
+	if(subject)
+	{
+		uri_destroy(subject);
+	}
+	storage = librdf_new_storage(world, "hashes", NULL, "hash-type='memory'");
+	model = storage ? librdf_new_model(world, storage, NULL) : NULL;
+	parser = librdf_new_parser(world, "turtle", NULL, NULL);
+	f = fopen(res->path, "rb");
+	if(!uri || !model || !parser || !f)
+	{
+		fprintf(stderr, "%s: failed to prepare to parse %s\n", progname, res->path);
+		return -1;
+	}
+	if(librdf_parser_parse_file_handle_into_model(parser, f, 0, uri, model))
+	{
+		fprintf(stderr, "%s: failed to parse %s as Turtle\n", progname, res->path);
+		return -1;
+	}
+	fclose(f);
+	out->key = intern_string(res->key);
+	if(out->key == SNAPSHOT_NONE)
+	{
+		fprintf(stderr, "%s: failed to add %s\n", progname, res->path);
+		return -1;
+	}
+	out->first = ntriples;
+	stream = librdf_model_as_stream(model);
+	while(stream && !librdf_stream_end(stream))
+	{
+		st = librdf_stream_get_object(stream);
+		/* The index of every triple, and the number of them, must fit in
+		 * 32 bits
+		 */
+		if(ntriples >= SNAPSHOT_NONE)
+		{
+			too_large("triples");
+			return -1;
+		}
+		if(ntriples + 1 > triplesize)
+		{
+			triplesize = triplesize ? triplesize * 2 : 4096;
+			p = (struct snapshot_triple_struct *) realloc(triples, triplesize * sizeof(struct snapshot_triple_struct));
+			if(!p)
+			{
+				fprintf(stderr, "%s: failed to allocate memory\n", progname);
+				return -1;
+			}
+			triples = p;
+		}
+		p = &(triples[ntriples]);
+		p->s = intern_node(librdf_statement_get_subject(st));
+		p->p = intern_node(librdf_statement_get_predicate(st));
+		p->o = intern_node(librdf_statement_get_object(st));
+		p->g = SNAPSHOT_NONE;
+		if(p->s == SNAPSHOT_NONE || p->p == SNAPSHOT_NONE || p->o == SNAPSHOT_NONE)
+		{
+			fprintf(stderr, "%s: failed to add triple from %s\n", progname, res->path);
+			return -1;
+		}
+		ntriples++;
+		librdf_stream_next(stream);
+	}
+	if(stream)
+	{
+		librdf_free_stream(stream);
+	}
+	out->count = ntriples - out->first;
+	librdf_free_parser(parser);
+	librdf_free_model(model);
+	librdf_free_storage(storage);
+	librdf_free_uri(uri);
+	return 0;
+}
+
+static uint32_t
+intern_node(librdf_node *node)
+{
+	librdf_uri *dt;
+	const char *lang;
+	uint32_t value, langidx, dtidx;
+
+	if(librdf_node_is_resource(node))
+	{
+		value = intern_string((const char *) librdf_uri_as_string(librdf_node_get_uri(node)));
+		return intern_term(SNT_URI, value, SNAPSHOT_NONE, SNAPSHOT_NONE);
+	}
+	if(librdf_node_is_blank(node))
+	{
+		value = intern_string((const char *) librdf_node_get_blank_identifier(node));
+		return intern_term(SNT_BNODE, value, SNAPSHOT_NONE, SNAPSHOT_NONE);
+	}
+	if(librdf_node_is_literal(node))
+	{
+		value = intern_string((const char *) librdf_node_get_literal_value(node));
+		lang = librdf_node_get_literal_value_language(node);
+		langidx = lang ? intern_string(lang) : SNAPSHOT_NONE;
+		dt = librdf_node_get_literal_value_datatype_uri(node);
+		dtidx = SNAPSHOT_NONE;
+		if(dt)
+		{
+			dtidx = intern_term(SNT_URI, intern_string((const char *) librdf_uri_as_string(dt)), SNAPSHOT_NONE, SNAPSHOT_NONE);
+		}
+		/* A failure to add the language or datatype mustn't be mistaken
+		 * for its absence
+		 */
+		if((lang && langidx == SNAPSHOT_NONE) || (dt && dtidx == SNAPSHOT_NONE))
+		{
+			return SNAPSHOT_NONE;
+		}
+		return intern_term(SNT_LITERAL, value, langidx, dtidx);
+	}
+	return SNAPSHOT_NONE;
+}
+
+/* Add a string to the string block if not already present, returning its
+ * offset
+ */
+static uint32_t
+intern_string(const char *str)
+{
+	size_t h, len;
+	uint32_t off;
+	char *p;
+
+	if(strtab.count * 2 >= strtab.size && table_grow(&strtab, hash_strval))
+	{
+		return SNAPSHOT_NONE;
+	}
+	for(h = hash_string(str) & (strtab.size - 1); strtab.slots[h] != SNAPSHOT_NONE; h = (h + 1) & (strtab.size - 1))
+	{
+		if(!strcmp(&(strbuf[strtab.slots[h]]), str))
+		{
+			return strtab.slots[h];
+		}
+	}
+	len = strlen(str) + 1;
+	/* Every offset must fit in 32 bits without being SNAPSHOT_NONE */
+	if(len > SNAPSHOT_NONE - stringslen)
+	{
+		too_large("strings");
+		return SNAPSHOT_NONE;
+	}
+	if(stringslen + len > strsize)
+	{
+		strsize = (stringslen + len) * 2;
+		p = (char *) realloc(strbuf, strsize);
+		if(!p)
+		{
+			return SNAPSHOT_NONE;
+		}
+		strbuf = p;
+	}
+	off = (uint32_t) stringslen;
+	memcpy(&(strbuf[stringslen]), str, len);
+	stringslen += len;
+	strtab.slots[h] = off;
+	strtab.count++;
+	return off;
+}
+
+/* Add a term to the term table if not already present, returning its index */
+static uint32_t
+intern_term(uint32_t type, uint32_t value, uint32_t lang, uint32_t datatype)
+{
+	struct snapshot_term_struct *p;
+	size_t h;
+
+	if(value == SNAPSHOT_NONE)
+	{
+		return SNAPSHOT_NONE;
+	}
+	if(termtab.count * 2 >= termtab.size && table_grow(&termtab, hash_term))
+	{
+		return SNAPSHOT_NONE;
+	}
+	/* The index of a term is stored in the hash table, where
+	 * SNAPSHOT_NONE marks an empty slot, and so must be less than it
+	 */
+	if(nterms >= SNAPSHOT_NONE)
+	{
+		too_large("terms");
+		return SNAPSHOT_NONE;
+	}
+	if(nterms + 1 > termsize)
+	{
+		termsize = termsize ? termsize * 2 : 1024;
+		p = (struct snapshot_term_struct *) realloc(terms, termsize * sizeof(struct snapshot_term_struct));
+		if(!p)
+		{
+			return SNAPSHOT_NONE;
+		}
+		terms = p;
+	}
+	p = &(terms[nterms]);
+	p->type = type;
+	p->value = value;
+	p->lang = lang;
+	p->datatype = datatype;
+	for(h = hash_term(nterms) & (termtab.size - 1); termtab.slots[h] != SNAPSHOT_NONE; h = (h + 1) & (termtab.size - 1))
+	{
+		if(!memcmp(&(terms[termtab.slots[h]]), p, sizeof(struct snapshot_term_struct)))
+		{
+			return termtab.slots[h];
+		}
+	}
+	termtab.slots[h] = (uint32_t) nterms;
+	termtab.count++;
+	nterms++;
+	return termtab.slots[h];
+}
+
+/* Double the size of a hash table, re-inserting its values */
+static int
+table_grow(struct table_struct *table, unsigned int (*hash)(uint32_t value))
+{
+	uint32_t *slots;
+	size_t c, h, size;
+
+	size = table->size ? table->size * 2 : 4096;
+	slots = (uint32_t *) malloc(size * sizeof(uint32_t));
+	if(!slots)
+	{
+		fprintf(stderr, "%s: failed to allocate memory\n", progname);
+		return -1;
+	}
+	memset(slots, 0xff, size * sizeof(uint32_t));
+	for(c = 0; c < table->size; c++)
+	{
+		if(table->slots[c] == SNAPSHOT_NONE)
+		{
+			continue;
+		}
+		for(h = hash(table->slots[c]) & (size - 1); slots[h] != SNAPSHOT_NONE; h = (h + 1) & (size - 1));
+		slots[h] = table->slots[c];
+	}
+	free(table->slots);
+	table->slots = slots;
+	table->size = size;
+	return 0;
+}
+
+static unsigned int
+hash_string(const char *str)
+{
+	unsigned int h;
+
+	for(h = 5381; *str; str++)
+	{
+		h = ((h << 5) + h) + (unsigned char) *str;
+	}
+	return h;
+}
+
+static unsigned int
+hash_strval(uint32_t offset)
+{
+	return hash_string(&(strbuf[offset]));
+}
+
+static unsigned int
+hash_term(uint32_t index)
+{
+	const struct snapshot_term_struct *t;
+
+	t = &(terms[index]);
+	return (t->type * 31 + t->value) * 2654435761U + t->lang * 40503U + t->datatype;
+}
+
+static int
+write_snapshot(const char *path, struct snapshot_resource_struct *res)
+{
+	struct snapshot_header_struct header;
+	uint64_t offset;
+	char *tmp;
+	FILE *f;
+
+	/* Write to a temporary file and rename it into place, so that a
+	 * running server never maps a partially-written snapshot
+	 */
+	tmp = (char *) malloc(strlen(path) + 5);
+	if(!tmp)
+	{
+		return -1;
+	}
+	sprintf(tmp, "%s.tmp", path);
+	f = fopen(tmp, "wb");
+	if(!f)
+	{
+		fprintf(stderr, "%s: %s: %s\n", progname, tmp, strerror(errno));
+		free(tmp);
+		return -1;
+	}
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+	header.version = SNAPSHOT_VERSION;
+	/* Each of these was limited to less than SNAPSHOT_NONE as it grew */
+	header.nterms = (uint32_t) nterms;
+	header.nresources = (uint32_t) nresources;
+	header.ntriples = (uint32_t) ntriples;
+	header.stringslen = stringslen;
+	offset = 0;
+	if(write_block(f, &header, sizeof(header), &offset) ||
+	   write_block(f, strbuf, stringslen, &(header.strings)) ||
+	   write_block(f, terms, nterms * sizeof(struct snapshot_term_struct), &(header.terms)) ||
+	   write_block(f, res, nresources * sizeof(struct snapshot_resource_struct), &(header.resources)) ||
+	   write_block(f, triples, ntriples * sizeof(struct snapshot_triple_struct), &(header.triples)) ||
+	   fseek(f, 0, SEEK_SET) ||
+	   fwrite(&header, sizeof(header), 1, f) != 1 ||
+	   fclose(f))
+	{
+		fprintf(stderr, "%s: failed to write %s: %s\n", progname, tmp, strerror(errno));
+		unlink(tmp);
+		free(tmp);
+		return -1;
+	}
+	if(rename(tmp, path))
+	{
+		fprintf(stderr, "%s: failed to rename %s to %s: %s\n", progname, tmp, path, strerror(errno));
+		unlink(tmp);
+		free(tmp);
+		return -1;
+	}
+	free(tmp);
+	return 0;
+}
+
+/* Report that the snapshot has outgrown the 32-bit offsets and indices of
+ * the format
+ */
+static void
+too_large(const char *what)
+{
+	fprintf(stderr, "%s: too many %s for a snapshot (offsets and indices are limited to 32 bits)\n", progname, what);
+}
+
+/* Write a block at the next 8-byte aligned position, recording its offset */
+static int
+write_block(FILE *f, const void *data, size_t len, uint64_t *offset)
+{
+	static const char pad[8];
+	long pos;
+
+	pos = ftell(f);
+	if(pos < 0)
+	{
+		return -1;
+	}
+	if(pos % 8 && fwrite(pad, 8 - (pos % 8), 1, f) != 1)
+	{
+		return -1;
+	}
+	*offset = (uint64_t) ftell(f);
+	if(len && fwrite(data, len, 1, f) != 1)
+	{
+		return -1;
+	}
+	return 0;
+}
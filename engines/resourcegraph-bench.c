@@ -0,0 +1,216 @@
+/* resourcegraph-bench: Compare the time taken to retrieve a resource graph
+ * using each of the resourcegraph engine's query modes.
+ *
+ * Author: Mo McRoberts <mo.mcroberts@bbc.co.uk>
+ *
+ * Copyright (c) 2014-2017 BBC
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+#include "p_resourcegraph.h"
+#include "libquilt-sapi.h"
+#include "libsupport.h"
+
+const char *quilt_progname = "resourcegraph-bench";
+
+static const char *modes[] = { "select", "construct", "describe", NULL };
+
+static int bench_defaults(void);
+static int bench_mode(RGMODE mode, const char *name, const char *graph, int count);
+static void usage(void);
+
+int
+main(int argc, char **argv)
+{
+	struct quilt_configfn_struct configfn;
+	const char *mode;
+	RGMODE m;
+	int c, count, r;
+
+	log_set_ident(argv[0]);
+	log_set_stderr(1);
+	log_set_level(LOG_NOTICE);
+	if(config_init(bench_defaults))
+	{
+		return 1;
+	}
+	count = 10;
+	mode = NULL;
+	while((c = getopt(argc, argv, "hdc:n:m:")) != -1)
+	{
+		switch(c)
+		{
+		case 'h':
+			usage();
+			return 0;
+		case 'd':
+			config_set("log:level", "debug");
+			break;
+		case 'c':
+			config_set("global:configFile", optarg);
+			break;
+		case 'n':
+			count = atoi(optarg);
+			if(count <= 0)
+			{
+				fprintf(stderr, "%s: '%s' is not a positive integer\n", quilt_progname, optarg);
+				return 1;
+			}
+			break;
+		case 'm':
+			if(resourcegraph_mode(optarg) == RG_UNKNOWN)
+			{
+				fprintf(stderr, "%s: unsupported query mode '%s'\n", quilt_progname, optarg);
+				return 1;
+			}
+			mode = optarg;
+			break;
+		default:
+			usage();
+			return 1;
+		}
+	}
+	argc -= optind;
+	argv += optind;
+	if(argc != 1)
+	{
+		usage();
+		return 1;
+	}
+	if(config_load(NULL))
+	{
+		return 1;
+	}
+	log_set_use_config(1);
+	configfn.config_get = config_get;
+	configfn.config_geta = config_geta;
+	configfn.config_get_int = config_get_int;
+	configfn.config_get_bool = config_get_bool;
+	configfn.config_get_all = config_get_all;
+	if(quilt_init(log_vprintf, &configfn))
+	{
+		return 1;
+	}
+	r = 0;
+	for(c = 0; modes[c]; c++)
+	{
+		if(mode && strcasecmp(mode, modes[c]))
+		{
+			continue;
+		}
+		m = resourcegraph_mode(modes[c]);
+		if(bench_mode(m, modes[c], argv[0], count))
+		{
+			r = 1;
+		}
+	}
+	return r;
+}
+
+static int
+bench_defaults(void)
+{
+	config_set_default("global:configFile", SYSCONFDIR "/quilt.conf");
+	config_set_default("log:level", "notice");
+	config_set_default("log:facility", "user");
+	config_set_default("log:syslog", "0");
+	config_set_default("log:stderr", "1");
+	config_set_default("sparql:query", "http://localhost/sparql/");
+	config_set_default("quilt:base", "http://www.example.com/");
+	return 0;
+}
+
+/* Fetch the graph count times using the given mode, each time into a new
+ * model, and report the elapsed time
+ */
+static int
+bench_mode(RGMODE mode, const char *name, const char *graph, int count)
+{
+	librdf_world *world;
+	librdf_storage *storage;
+	librdf_model *model;
+	struct timeval start, end;
+	double elapsed, total, best;
+	char *query;
+	int c, size;
+
+	world = quilt_librdf_world();
+	query = (char *) malloc(strlen(graph) + 64);
+	if(!query)
+	{
+		return -1;
+	}
+	total = 0;
+	best = 0;
+	size = 0;
+	for(c = 0; c < count; c++)
+	{
+		storage = librdf_new_storage(world, "hashes", NULL, "hash-type='memory',contexts='yes'");
+		model = storage ? librdf_new_model(world, storage, NULL) : NULL;
+		if(!model)
+		{
+			fprintf(stderr, "%s: failed to create new RDF model\n", quilt_progname);
+			if(storage)
+			{
+				librdf_free_storage(storage);
+			}
+			free(query);
+			return -1;
+		}
+		gettimeofday(&start, NULL);
+		if(resourcegraph_query(mode, graph, query, model))
+		{
+			fprintf(stderr, "%s: %s: query failed\n", quilt_progname, name);
+			librdf_free_model(model);
+			librdf_free_storage(storage);
+			free(query);
+			return -1;
+		}
+		gettimeofday(&end, NULL);
+		elapsed = (end.tv_sec - start.tv_sec) * 1000.0 + (end.tv_usec - start.tv_usec) / 1000.0;
+		total += elapsed;
+		if(!c || elapsed < best)
+		{
+			best = elapsed;
+		}
+		size = librdf_model_size(model);
+		librdf_free_model(model);
+		librdf_free_storage(storage);
+	}
+	free(query);
+	printf("%-10s %8d triples %6d runs %10.3f ms mean %10.3f ms best\n", name, size, count, total / count, best);
+	return 0;
+}
+
+static void
+usage(void)
+{
+	fprintf(stderr, "Usage: %s [OPTIONS] GRAPH-URI\n"
+			"\n"
+			"OPTIONS is one or more of:\n"
+			"  -h                   Print this notice and exit\n"
+			"  -d                   Enable debug output\n"
+			"  -c FILE              Specify path to configuration file\n"
+			"  -n COUNT             Fetch the graph COUNT times in each mode (default 10)\n"
+			"  -m MODE              Only benchmark MODE (select, construct or describe)\n",
+			quilt_progname);
+}
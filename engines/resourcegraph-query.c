@@ -0,0 +1,67 @@
+/* resourcegraph: Construction and execution of the queries used to
+ * retrieve a resource graph.
+ *
+ * Author: Mo McRoberts <mo.mcroberts@bbc.co.uk>
+ *
+ * Copyright (c) 2014-2017 BBC
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include "p_resourcegraph.h"
+
+/* Map the name of a query mode to its RGMODE value */
+RGMODE
+resourcegraph_mode(const char *name)
+{
+	if(!strcasecmp(name, "construct"))
+	{
+		return RG_CONSTRUCT;
+	}
+	if(!strcasecmp(name, "describe"))
+	{
+		return RG_DESCRIBE;
+	}
+	if(!strcasecmp(name, "select"))
+	{
+		return RG_SELECT;
+	}
+	return RG_UNKNOWN;
+}
+
+/* Fetch the graph named by subject into the model using the given query
+ * mode; buf must be at least strlen(subject) + 64 bytes in size.
+ */
+int
+resourcegraph_query(RGMODE mode, const char *subject, char *buf, librdf_model *model)
+{
+	switch(mode)
+	{
+	case RG_SELECT:
+		sprintf(buf, "SELECT * WHERE { GRAPH <%s> { ?s ?p ?o } }", subject);
+		return quilt_sparql_query_rdf(buf, model);
+	case RG_CONSTRUCT:
+		sprintf(buf, "CONSTRUCT { ?s ?p ?o } WHERE { GRAPH <%s> { ?s ?p ?o } }", subject);
+		return quilt_sparql_query_graph(buf, model);
+	case RG_DESCRIBE:
+		sprintf(buf, "DESCRIBE <%s>", subject);
+		return quilt_sparql_query_graph(buf, model);
+	case RG_UNKNOWN:
+		break;
+	}
+	return -1;
+}
@@ -25,10 +25,40 @@
 #include "p_resourcegraph.h"
 
 static int resourcegraph_process(QUILTREQ *request);
+static int resourcegraph_linked(QUILTREQ *request, librdf_model *model);
+static int resourcegraph_error(QUILTREQ *request);
+
+static RGMODE mode = RG_CONSTRUCT;
+static size_t linked;
 
 int
 quilt_plugin_init(void)
 {
+	char *t;
+
+	/* resourcegraph:query selects how the graph is fetched: 'construct'
+	 * (the default) and 'describe' request N-Triples directly from the
+	 * store; 'select' retrieves SPARQL results and converts the bindings
+	 * back into triples.
+	 */
+	t = quilt_config_geta(QUILT_PLUGIN_NAME ":query", NULL);
+	if(t)
+	{
+		mode = resourcegraph_mode(t);
+		if(mode == RG_UNKNOWN)
+		{
+			quilt_logf(LOG_CRIT, QUILT_PLUGIN_NAME ": unsupported query mode '%s'\n", t);
+			free(t);
+			return -1;
+		}
+		free(t);
+	}
+	/* resourcegraph:linked is the maximum number of graphs describing
+	 * local resources referred to by the requested graph which will be
+	 * retrieved alongside it (so that their labels are available), using
+	 * batched queries.
+	 */
+	linked = quilt_config_get_int(QUILT_PLUGIN_NAME ":linked", 0);
 	if(quilt_plugin_register_engine(QUILT_PLUGIN_NAME, resourcegraph_process))
 	{
 		quilt_logf(LOG_CRIT, QUILT_PLUGIN_NAME ": failed to register engine\n");
@@ -43,21 +73,22 @@ resourcegraph_process(QUILTREQ *request)
 	librdf_model *model;
 	const char *subject;
 	char *query;
+	int r;
 	
 	subject = quilt_request_subject(request);
 	model = quilt_request_model(request);
-	query = (char *) malloc(strlen(subject) + 64);  
+	query = (char *) malloc(strlen(subject) + 64);
 	if(!query)
 	{
 		quilt_logf(LOG_CRIT, QUILT_PLUGIN_NAME ": failed to allocate %u bytes\n", (unsigned) strlen(subject) + 64);
 		return 500;
 	}
-	sprintf(query, "SELECT * WHERE { GRAPH <%s> { ?s ?p ?o } }", subject);	
-	if(quilt_sparql_query_rdf(query, model))
+	r = resourcegraph_query(mode, subject, query, model);
+	if(r)
 	{
 		quilt_logf(LOG_ERR, QUILT_PLUGIN_NAME ": failed to create model from query\n");
 		free(query);
-		return 500;
+		return resourcegraph_error(request);
 	}
 	free(query);
 	/* If the model is completely empty, consider the graph to be Not Found */
@@ -65,8 +96,119 @@ resourcegraph_process(QUILTREQ *request)
 	{
 		return 404;
 	}
+	if(linked && resourcegraph_linked(request, model))
+	{
+		quilt_logf(LOG_ERR, QUILT_PLUGIN_NAME ": failed to retrieve linked graphs\n");
+		return resourcegraph_error(request);
+	}
 	/* Returning 200 (rather than 0) causes the model to be serialized
 	 * automatically.
 	 */
 	return 200;
 }
+
+/* Retrieve the graphs for the local resources which are the objects of
+ * statements in the model, up to the configured limit, in a single batch
+ */
+static int
+resourcegraph_linked(QUILTREQ *request, librdf_model *model)
+{
+	librdf_world *world;
+	librdf_statement *query;
+	librdf_stream *st;
+	librdf_node *obj;
+	const char *base, *subject, *uri, *t;
+	char **graphs, *p;
+	size_t count, baselen, len, c;
+	int r;
+
+	world = quilt_librdf_world();
+	base = quilt_request_baseuristr(request);
+	subject = quilt_request_subject(request);
+	if(!base)
+	{
+		return 0;
+	}
+	baselen = strlen(base);
+	graphs = (char **) calloc(linked, sizeof(char *));
+	if(!graphs)
+	{
+		quilt_logf(LOG_CRIT, QUILT_PLUGIN_NAME ": failed to allocate memory for linked graph list\n");
+		return -1;
+	}
+	count = 0;
+	r = 0;
+	query = librdf_new_statement(world);
+	st = librdf_model_find_statements(model, query);
+	while(count < linked && !librdf_stream_end(st))
+	{
+		obj = librdf_statement_get_object(librdf_stream_get_object(st));
+		librdf_stream_next(st);
+		if(!librdf_node_is_resource(obj))
+		{
+			continue;
+		}
+		uri = (const char *) librdf_uri_as_string(librdf_node_get_uri(obj));
+		if(strncmp(uri, base, baselen) || !uri[baselen])
+		{
+			continue;
+		}
+		/* The graph is named by the URI without any fragment */
+		t = strchr(uri, '#');
+		len = t ? (size_t) (t - uri) : strlen(uri);
+		if(!strncmp(uri, subject, len) && !subject[len])
+		{
+			continue;
+		}
+		for(c = 0; c < count; c++)
+		{
+			if(!strncmp(graphs[c], uri, len) && !graphs[c][len])
+			{
+				break;
+			}
+		}
+		if(c < count)
+		{
+			continue;
+		}
+		p = (char *) malloc(len + 1);
+		if(!p)
+		{
+			quilt_logf(LOG_CRIT, QUILT_PLUGIN_NAME ": failed to allocate %u bytes\n", (unsigned) len + 1);
+			r = -1;
+			break;
+		}
+		memcpy(p, uri, len);
+		p[len] = 0;
+		graphs[count] = p;
+		count++;
+	}
+	librdf_free_stream(st);
+	librdf_free_statement(query);
+	if(!r && count)
+	{
+		quilt_logf(LOG_DEBUG, QUILT_PLUGIN_NAME ": retrieving %u linked graphs\n", (unsigned) count);
+		r = quilt_sparql_query_graphs((const char *const *) graphs, count, model);
+	}
+	for(c = 0; c < count; c++)
+	{
+		free(graphs[c]);
+	}
+	free(graphs);
+	return r;
+}
+
+/* Determine the status to return when a query has failed */
+static int
+resourcegraph_error(QUILTREQ *request)
+{
+	if(quilt_request_timedout(request))
+	{
+		return 504;
+	}
+	if(quilt_request_unavailable(request))
+	{
+		return 503;
+	}
+	return 500;
+}
@@ -24,7 +24,13 @@
 #define BLOCKSIZE                      128
 #define ROUNDUP(n)                     ((((n) / BLOCKSIZE) + 1) * BLOCKSIZE)
 
-static int apply_filter(LIQUIFYCTX *ctx, char *buf, size_t len, struct liquify_filter *filter);
+static char *apply_template(LIQUIFYTPL *template, const LIQUIFYPROVIDER *provider, void *root, struct liquify_local *locals);
+static int apply_run(LIQUIFYCTX *ctx);
+static int apply_flush(LIQUIFYCTX *ctx);
+static int apply_failed(LIQUIFYCTX *ctx);
+static int apply_fragment(LIQUIFYCTX *ctx, struct liquify_op *frag);
+static int apply_filters(LIQUIFYCTX *ctx, const struct liquify_op *op, const LIQUIFYVALUE *value);
+static int apply_filter(LIQUIFYCTX *ctx, const struct liquify_filter_struct *filter, char *buf, size_t len);
 
 /* Locate a loaded template by name */
 LIQUIFYTPL *
@@ -58,196 +64,194 @@ liquify_apply_name(LIQUIFY *env, const char *name, json_t *dict)
 
 char *
 liquify_apply(LIQUIFYTPL *template, json_t *dict)
+{
+	return liquify_apply_data(template, &liquify_json_provider, (void *) dict);
+}
+
+char *
+liquify_apply_data(LIQUIFYTPL *template, const LIQUIFYPROVIDER *provider, void *root)
+{
+	return apply_template(template, provider, root, NULL);
+}
+
+/* Apply a template, passing its output to write() in blocks of up to
+ * STREAM_BUFSIZE bytes (or larger, if a single emitted string is larger),
+ * so that the output need never be held in full. Returns 0 on success,
+ * or -1 if the template could not be applied or write() failed.
+ */
+int
+liquify_apply_stream(LIQUIFYTPL *template, const LIQUIFYPROVIDER *provider, void *root, int (*write)(const char *buf, size_t len, void *data), void *data)
 {
 	LIQUIFYCTX context;
-	struct liquify_part *part;
-	struct liquify_filter *filter;
-	struct liquify_stack *sp;
-	size_t len;
 	int r;
-	char *str, *buf;
-	const char *ident;
-	json_t *value;
 
 	memset(&context, 0, sizeof(LIQUIFYCTX));
 	context.tpl = template;
-	context.cp = template->first;
-	context.dict = dict;
-	str = NULL;
+	context.provider = provider;
+	context.root = root;
+	context.write = write;
+	context.writedata = data;
+	context.bufsize = STREAM_BUFSIZE;
+	context.buf = (char *) liquify_alloc(template->env, context.bufsize);
+	r = apply_run(&context);
+	if(!r)
+	{
+		r = apply_flush(&context);
+	}
+	liquify_free(template->env, context.buf);
+	return r;
+}
+
+/* Apply a template within the data scope of another: the root object and
+ * any local variables of the parent context are visible to it
+ */
+char *
+liquify_apply_ctx_(LIQUIFYTPL *template, LIQUIFYCTX *parent)
+{
+	return apply_template(template, parent->provider, parent->root, parent->locals);
+}
+
+static char *
+apply_template(LIQUIFYTPL *template, const LIQUIFYPROVIDER *provider, void *root, struct liquify_local *locals)
+{
+	LIQUIFYCTX context;
+
+	memset(&context, 0, sizeof(LIQUIFYCTX));
+	context.tpl = template;
+	context.provider = provider;
+	context.root = root;
+	context.locals = locals;
+	if(apply_run(&context))
+	{
+		liquify_free(template->env, context.buf);
+		return NULL;
+	}
+	if(!context.buf)
+	{
+		return liquify_strdup(template->env, "");
+	}
+	return context.buf;
+}
+
+/* Apply the instructions of a template to a context */
+static int
+apply_run(LIQUIFYCTX *ctx)
+{
+	const struct liquify_op *op;
+	struct liquify_stack *sp;
+	LIQUIFYVALUE value;
+	int r, skipped;
+
 	r = 0;
-	while(context.cp)
+	while(!r && !ctx->writeerr && ctx->pc < ctx->tpl->ncode)
 	{
-		part = context.cp;
-		context.jumped = 0;
-		switch(part->type)
+		op = &(ctx->tpl->code[ctx->pc]);
+		ctx->jumped = 0;
+		skipped = ctx->skipped;
+		ctx->skipped = 0;
+		switch(op->type)
 		{
-		case LPT_TEXT:
+		case LOP_TEXT:
 			/* Emit a block of literal text */
-			if(context.capture && context.capture->inhibit)
-			{
-				break;
-			}
-			if(liquify_emit(&context, part->d.text.text, part->d.text.len))
-			{
-				liquify_free(template->env, context.buf);
-				return NULL;
-			}
+			r = liquify_emit(ctx, op->text, op->len);
 			break;
-		case LPT_VAR:
+		case LOP_VAR:
 			/* Emit the contents of a variable */
-			if(context.capture && context.capture->inhibit)
+			liquify_eval_(ctx, op->paths, &value);
+			if(op->nfilters)
 			{
-				break;
+				r = apply_filters(ctx, op, &value);
 			}
-			value = liquify_eval_(&(part->d.var.expr), dict, NULL);
-			if(part->d.var.ffirst)
+			else
 			{
-				if(liquify_capture(&context))
-				{
-					if(value)
-					{
-						json_decref(value);
-					}
-					r = -1;
-				}
-			}
-			if(!r)
-			{
-				liquify_emit_json(&context, value);
-				json_decref(value);
-				if(part->d.var.ffirst)
-				{
-					for(filter = part->d.var.ffirst; filter; filter = filter->next)
-					{
-						buf = context.capture->buf;
-						len = context.capture->buflen;
-						context.capture->buf = NULL;
-						context.capture->buflen = 0;
-						context.capture->bufsize = 0;
-						if(apply_filter(&context, buf, len, filter))
-						{
-							r = -1;
-							break;
-						}
-						liquify_free(template->env, buf);
-					}
-					len = 0;
-					str = liquify_capture_end(&context, &len);
-					if(!r)
-					{
-						liquify_emit(&context, str, len);
-					}
-				}
+				r = liquify_emit_value(ctx, &value);
 			}
 			break;
-		case LPT_TAG:
-			/* Apply a tag of some kind */
-			if(part->d.tag.kind == TPK_END)
+		case LOP_BEGIN:
+			sp = liquify_push_(ctx, op->block);
+			sp->begin = ctx->pc;
+			r = op->block->begin(ctx, op, sp);
+			break;
+		case LOP_END:
+			/* If the end of the block was reached by skipping a branch,
+			 * the block is simply closed
+			 */
+			if(!skipped)
 			{
-				if(!context.stack ||
-				   (context.stack->end && context.stack->end != part) ||
-				   strcmp(context.stack->ident, EXPR_IDENT(&(part->d.tag.expr)) + 3))
-				{
-					liquify_logf(template->env, LOG_ERR, "%s:%d:%d: tag mismatch: %s does not match %s\n", template->name, part->line, part->col, EXPR_IDENT(&(part->d.tag.expr)), context.stack->ident);
-					r = -1;
-					break;
-				}
-				context.stack->end = part;
-				if(context.capture && context.capture->inhibit)
-				{
-					sp = context.stack;
-					liquify_block_cleanup_(&context, context.stack->ident, context.stack);
-					if(context.capture->owner == sp)
-					{
-						liquify_capture_end(&context, NULL);
-					}
-					liquify_pop_(&context);
-					break;
-				}
-				
-				if(liquify_block_end_(&context, part, context.stack->ident, context.stack))
-				{
-					r = -1;
-					break;
-				}
-				if(!context.jumped)
-				{
-					liquify_block_cleanup_(&context, context.stack->ident, context.stack);
-					liquify_pop_(&context);
-				}
+				r = op->block->end(ctx, op, ctx->stack);
 			}
-			else if(part->d.tag.kind == TPK_BEGIN)
+			if(!r && !ctx->jumped)
 			{
-				if(context.capture && context.capture->inhibit)
-				{
-					if(!liquify_push_(&context, part))
-					{
-						r = 1;
-					}
-					break;
-				}
-				if(!context.stack || context.stack->begin != part)
-				{
-					if(!liquify_push_(&context, part))
-					{
-						r = -1;
-						break;
-					}
-				}
-				if(liquify_block_begin_(&context, part, EXPR_IDENT(&(part->d.tag.expr)), context.stack))
-				{
-					r = -1;
-					break;
-				}
+				op->block->cleanup(ctx, ctx->stack);
+				liquify_pop_(ctx);
 			}
-			else if(part->d.tag.kind == TPK_TAG)
+			break;
+		case LOP_TAG:
+			/* Apply a tag of some kind */
+			r = op->tag->emit(ctx, op);
+			break;
+		case LOP_INCLUDE:
+			/* The beginning of an included template */
+			ctx->includes[ctx->nincludes].op = op;
+			ctx->includes[ctx->nincludes].offset = ctx->written + ctx->buflen;
+			ctx->includes[ctx->nincludes].stack = ctx->stack;
+			ctx->includes[ctx->nincludes].locals = ctx->locals;
+			ctx->nincludes++;
+			break;
+		case LOP_END_INCLUDE:
+			ctx->nincludes--;
+			break;
+		case LOP_FRAGMENT:
+			/* Emit the output of a fragment, unless it refers to the
+			 * template data and local variables might shadow it, in which
+			 * case the instructions which follow are applied as normal
+			 */
+			if(op->cached || !op->data || !ctx->locals)
 			{
-				ident = EXPR_IDENT(&(part->d.tag.expr));
-				
-				/* 'else' and 'elsif' get special handling: they are processed
-				 * even when inhibited, provided the inhibition owner is the
-				 * current stack level and the block responsible is an
-				 * 'if'
-				 */
-				if(context.capture && context.capture->inhibit)
-				{
-					if(context.capture->owner == context.stack &&
-					   !strcmp(context.stack->ident, "if") &&
-					   (!strcmp(ident, "else") || !strcmp(ident, "elsif")))
-					{
-						if(liquify_tag_(&context, part, EXPR_IDENT(&(part->d.tag.expr))))
-						{
-							r = -1;
-							break;
-						}
-					}
-					/* Otherwise, ordinary inhibition */
-					break;
-				}
-				if(liquify_tag_(&context, part, EXPR_IDENT(&(part->d.tag.expr))))
-				{
-					r = -1;
-					break;
-				}
+				r = apply_fragment(ctx, &(ctx->tpl->code[ctx->pc]));
 			}
 			break;
 		}
-		if(!context.jumped)
+		/* Failing to write the output is not the fault of an included
+		 * template
+		 */
+		if(r && ctx->nincludes && !ctx->writeerr)
 		{
-			context.cp = context.cp->next;
+			r = apply_failed(ctx);
+		}
+		if(!ctx->jumped)
+		{
+			ctx->pc++;
 		}
 	}
-	if(r)
+	while(ctx->stack)
 	{
-		liquify_free(template->env, context.buf);
-		liquify_free(template->env, str);
-		return NULL;
+		ctx->stack->block->cleanup(ctx, ctx->stack);
+		liquify_pop_(ctx);
 	}
-	if(!context.buf)
+	if(ctx->writeerr)
 	{
-		return liquify_strdup(template->env, "");
+		return -1;
 	}
-	return context.buf;
+	return r;
+}
+
+/* Pass any buffered output to the write function */
+static int
+apply_flush(LIQUIFYCTX *ctx)
+{
+	if(ctx->writeerr)
+	{
+		return -1;
+	}
+	if(ctx->buflen && ctx->write(ctx->buf, ctx->buflen, ctx->writedata))
+	{
+		ctx->writeerr = 1;
+		return -1;
+	}
+	ctx->written += ctx->buflen;
+	ctx->buflen = 0;
+	return 0;
 }
 
 /* Write a value to the current context */
@@ -271,7 +275,7 @@ liquify_emit_json(LIQUIFYCTX *ctx, json_t *value)
 	case JSON_TRUE:
 		return liquify_emit(ctx, "true", 4);
 	case JSON_FALSE:
-		return liquify_emit(ctx, "false", 4);
+		return liquify_emit(ctx, "false", 5);
 	case JSON_STRING:
 		s = json_string_value(value);
 		return liquify_emit(ctx, s, strlen(s));
@@ -317,6 +321,26 @@ liquify_emit(LIQUIFYCTX *ctx, const char *str, size_t slen)
 		buf = &(ctx->buf);
 		size = &(ctx->bufsize);
 		len = &(ctx->buflen);
+		if(ctx->write && *len + slen + 1 > *size)
+		{
+			/* Pass on the buffered output, and anything which is too
+			 * large to be worth buffering
+			 */
+			if(apply_flush(ctx))
+			{
+				return -1;
+			}
+			if(slen + 1 > *size)
+			{
+				if(ctx->write(str, slen, ctx->writedata))
+				{
+					ctx->writeerr = 1;
+					return -1;
+				}
+				ctx->written += slen;
+				return 0;
+			}
+		}
 	}
 	if(*len + slen + 1 > *size)
 	{
@@ -353,19 +377,6 @@ liquify_capture(LIQUIFYCTX *ctx)
 	return 0;
 }
 
-/* Inhibit further output for this block */
-int
-liquify_inhibit_(LIQUIFYCTX *ctx)
-{
-	if(liquify_capture(ctx))
-	{
-		return -1;
-	}
-	ctx->capture->inhibit = 1;
-	ctx->capture->owner = ctx->stack;
-	return 0;
-}
-
 /* Finish capturing */
 char *
 liquify_capture_end(LIQUIFYCTX *ctx, size_t *len)
@@ -384,11 +395,6 @@ liquify_capture_end(LIQUIFYCTX *ctx, size_t *len)
 	{
 		*len = p->buflen;
 	}
-	if(p->inhibit)
-	{
-		liquify_free(ctx->tpl->env, p);
-		return NULL;
-	}
 	liquify_free(ctx->tpl->env, p);
 	if(!buf)
 	{
@@ -397,31 +403,181 @@ liquify_capture_end(LIQUIFYCTX *ctx, size_t *len)
 	return buf;
 }
 
+/* Applying an included template has failed: discard its output and
+ * state, and continue following it, as if it had been applied separately
+ */
+static int
+apply_failed(LIQUIFYCTX *ctx)
+{
+	struct liquify_inclusion *inc;
+
+	ctx->nincludes--;
+	inc = &(ctx->includes[ctx->nincludes]);
+	while(ctx->stack && ctx->stack != inc->stack)
+	{
+		ctx->stack->block->cleanup(ctx, ctx->stack);
+		liquify_pop_(ctx);
+	}
+	ctx->locals = inc->locals;
+	/* If output is being streamed, any which has already been written
+	 * cannot be discarded
+	 */
+	if(inc->offset > ctx->written)
+	{
+		ctx->buflen = inc->offset - ctx->written;
+	}
+	else
+	{
+		ctx->buflen = 0;
+	}
+	if(ctx->buf)
+	{
+		ctx->buf[ctx->buflen] = 0;
+	}
+	liquify_emit_str(ctx, "[failed to include '");
+	liquify_emit_str(ctx, inc->op->paths[0].literal);
+	liquify_emit_str(ctx, "']");
+	ctx->pc = inc->op->jump + 1;
+	ctx->jumped = 1;
+	ctx->skipped = 0;
+	return 0;
+}
+
+/* Emit the output of a fragment, generating it first if this is the first
+ * time that it has been applied, and continue following it
+ */
 static int
-apply_filter(LIQUIFYCTX *ctx, char *buf, size_t len, struct liquify_filter *filter)
-{	
+apply_fragment(LIQUIFYCTX *ctx, struct liquify_op *frag)
+{
+	struct liquify_capture capture;
+	const struct liquify_op *op;
+	LIQUIFYVALUE value;
+	size_t c;
+	int r;
+
+	if(!frag->cached)
+	{
+		memset(&capture, 0, sizeof(struct liquify_capture));
+		capture.prev = ctx->capture;
+		ctx->capture = &capture;
+		r = 0;
+		for(c = ctx->pc + 1; !r && c < frag->jump; c++)
+		{
+			op = &(ctx->tpl->code[c]);
+			if(op->type == LOP_TEXT)
+			{
+				r = liquify_emit(ctx, op->text, op->len);
+			}
+			else if(op->type == LOP_VAR)
+			{
+				liquify_eval_(ctx, op->paths, &value);
+				if(op->nfilters)
+				{
+					r = apply_filters(ctx, op, &value);
+				}
+				else
+				{
+					r = liquify_emit_value(ctx, &value);
+				}
+			}
+		}
+		ctx->capture = capture.prev;
+		if(r)
+		{
+			/* Partial output is never cached */
+			liquify_free(ctx->tpl->env, capture.buf);
+			return r;
+		}
+		frag->cache = capture.buf;
+		frag->cachelen = capture.buflen;
+		frag->cached = 1;
+	}
+	ctx->pc = frag->jump;
+	ctx->jumped = 1;
+	if(frag->cachelen)
+	{
+		return liquify_emit(ctx, frag->cache, frag->cachelen);
+	}
+	return 0;
+}
+
+/* Apply the filters of a variable to its value, each receiving the output
+ * of the last, and emit the result
+ */
+static int
+apply_filters(LIQUIFYCTX *ctx, const struct liquify_op *op, const LIQUIFYVALUE *value)
+{
+	struct liquify_capture capture;
+	char *buf;
+	size_t c, len;
+	int r;
+
+	memset(&capture, 0, sizeof(struct liquify_capture));
+	capture.prev = ctx->capture;
+	ctx->capture = &capture;
+	r = liquify_emit_value(ctx, value);
+	for(c = 0; !r && c < op->nfilters; c++)
+	{
+		buf = capture.buf;
+		len = capture.buflen;
+		capture.buf = NULL;
+		capture.buflen = 0;
+		capture.bufsize = 0;
+		r = apply_filter(ctx, &(op->filters[c]), buf, len);
+		liquify_free(ctx->tpl->env, buf);
+	}
+	ctx->capture = capture.prev;
+	if(!r && capture.buflen)
+	{
+		r = liquify_emit(ctx, capture.buf, capture.buflen);
+	}
+	liquify_free(ctx->tpl->env, capture.buf);
+	return r;
+}
+
+static int
+apply_filter(LIQUIFYCTX *ctx, const struct liquify_filter_struct *filter, char *buf, size_t len)
+{
 	/* failure to apply a filter is considered a warning, not an error */
-	liquify_filter_apply_(ctx, filter->expr.root.right->text, buf, len);
+	if(filter->fn)
+	{
+		filter->fn(ctx, buf, len, filter->name);
+		return 0;
+	}
+	liquify_emit(ctx, buf, len);
+	liquify_emit_str(ctx, "<!-- Warning: no such filter '");
+	liquify_emit_str(ctx, filter->name);
+	liquify_emit_str(ctx, "-->");
+	return 0;
+}
+
+/* Skip to the next branch of the current block, or to its end */
+int
+liquify_skip_(LIQUIFYCTX *ctx)
+{
+	ctx->pc = ctx->tpl->code[ctx->pc].jump;
+	ctx->jumped = 1;
+	ctx->skipped = 1;
 	return 0;
 }
 
+/* Jump back to the start of the body of the current block */
 int
-liquify_goto_(LIQUIFYCTX *ctx, struct liquify_part *where)
+liquify_repeat_(LIQUIFYCTX *ctx)
 {
-	ctx->cp = where;
+	ctx->pc = ctx->stack->begin + 1;
 	ctx->jumped = 1;
 	return 0;
 }
 
 struct liquify_stack *
-liquify_push_(LIQUIFYCTX *ctx, struct liquify_part *begin)
+liquify_push_(LIQUIFYCTX *ctx, const struct liquify_block_struct *block)
 {
 	struct liquify_stack *node;
 
 	node = (struct liquify_stack *) liquify_alloc(ctx->tpl->env, sizeof(struct liquify_stack));
-	node->begin = begin;
+	node->block = block;
 	node->prev = ctx->stack;
-	node->ident = EXPR_IDENT(&(begin->d.tag.expr));
 	ctx->stack = node;
 	return node;
 }
@@ -23,13 +23,14 @@
 
 struct for_data
 {
-	json_t *list;
-	json_t *keys;
-	size_t idx;	
-	struct liquify_expression *self;
+	LIQUIFYVALUE list;
+	LIQUIFYITER iter;
+	int iterating;
+	/* The iterator variable */
+	struct liquify_local local;
 };
 
-static json_t *for_current(LIQUIFYCTX *ctx, struct for_data *data);
+static int for_next(LIQUIFYCTX *ctx, struct for_data *data);
 
 /* Invoked when a new 'for' tag has been parsed */
 int
@@ -38,7 +39,7 @@ liquify_block_for_parsed_(LIQUIFYTPL *tpl, struct liquify_part *part)
 	struct liquify_param *param;
 
 	param = part->d.tag.pfirst;
-	if(!param)
+	if(!param || !EXPR_IS(&(param->expr), TOK_IDENT))
 	{
 		PARTERRS(tpl, part, "expected: iterator variable name\n");
 		return -1;
@@ -63,87 +64,58 @@ liquify_block_for_parsed_(LIQUIFYTPL *tpl, struct liquify_part *part)
 	return 0;
 }
 
-/* Invoked during template application to open a for loop */
+/* Invoked during template application to open a for loop; the body of
+ * the loop is repeated by jumping back to the instruction following this
+ * one, so this is only invoked once for each loop
+ */
 int
-liquify_block_for_begin_(LIQUIFYCTX *ctx, struct liquify_part *part, struct liquify_stack *stack)
+liquify_block_for_begin_(LIQUIFYCTX *ctx, const struct liquify_op *op, struct liquify_stack *stack)
 {
 	struct for_data *data;
-	struct liquify_param *param;
-	void *iter;
-	json_t *v;
 
-	if(stack->data)
+	data = (struct for_data *) calloc(1, sizeof(struct for_data));
+	if(!data)
 	{
-		data = (struct for_data *) stack->data;
+		return -1;
 	}
-	else
+	/* The parameters are validated by liquify_block_for_parsed_() */
+	data->local.name = op->paths[0].names[0];
+	liquify_eval_(ctx, &(op->paths[2]), &(data->list));
+	if(data->list.type == LVT_UNDEFINED)
 	{
-		data = (struct for_data *) calloc(1, sizeof(struct for_data));
-		if(!data)
-		{
-			return -1;
-		}		
-		/* This is the first pass through the loop */
-		param = part->d.tag.pfirst;
-		data->self = &(param->expr);
-		param = param->next;
-		if(!param || !EXPR_IS(&(param->expr), TOK_IDENT) || strcmp(EXPR_IDENT(&(param->expr)), "in"))
-		{
-			PARTERRS(ctx->tpl, part, "expected: 'in'\n");
-			return -1;
-		}
-		param = param->next;
-		if(!(data->list = liquify_eval_(&(param->expr), ctx->dict, NULL)))
-		{
-			PARTERRS(ctx->tpl, part, "expected: identifier\n");
-			return -1;
-		}
-		if(json_typeof(data->list) == JSON_OBJECT)
+		PARTERRS(op->tpl, op->part, "expected: identifier\n");
+		free(data);
+		return -1;
+	}
+	if(data->list.type == LVT_LIST || data->list.type == LVT_OBJECT)
+	{
+		if(!data->list.provider->iter(data->list.obj, &(data->iter)))
 		{
-			data->keys = json_array();
-			for(iter = json_object_iter(data->list); iter; iter = json_object_iter_next(data->list, iter))
-			{
-				json_array_append_new(data->keys, json_string(json_object_iter_key(iter)));
-			}
+			data->iterating = 1;
 		}
-		stack->data = (void *) data;
 	}
-	v = for_current(ctx, data);		
-	if(v)
+	stack->data = (void *) data;
+	/* The iterator variable is visible until the end of the loop */
+	data->local.prev = ctx->locals;
+	ctx->locals = &(data->local);
+	if(!for_next(ctx, data))
 	{
-		liquify_assign_(data->self, ctx->dict, v);
-	}
-	else
-	{		
-		liquify_inhibit_(ctx);
+		liquify_skip_(ctx);
 	}
 	return 0;
 }
 
 int
-liquify_block_for_end_(LIQUIFYCTX *ctx, struct liquify_part *part, struct liquify_stack *stack)
+liquify_block_for_end_(LIQUIFYCTX *ctx, const struct liquify_op *op, struct liquify_stack *stack)
 {
 	struct for_data *data;
-	json_t *v;
-	int finished;
 
-	(void) part;
+	(void) op;
 
 	data = (struct for_data *) stack->data;
-	data->idx++;
-	finished = 1;
-	v = for_current(ctx, data);
-	if(v)
+	if(for_next(ctx, data))
 	{
-		finished = 0;
-	}
-	else
-	{
-		/* End of the loop */
-	}
-	if(!finished)
-	{
-		liquify_goto_(ctx, stack->begin);
+		liquify_repeat_(ctx);
 	}
 	return 0;
 }
@@ -152,8 +124,7 @@ int
 liquify_block_for_cleanup_(LIQUIFYCTX *ctx, struct liquify_stack *stack)
 {
 	struct for_data *data;
-
-	(void) ctx;
+	struct liquify_local **lp;
 
 	data = (struct for_data *) stack->data;
 	if(!data)
@@ -161,57 +132,33 @@ liquify_block_for_cleanup_(LIQUIFYCTX *ctx, struct liquify_stack *stack)
 		return 0;
 	}
 	stack->data = NULL;
-	if(data->keys)
+	for(lp = &(ctx->locals); *lp; lp = &((*lp)->prev))
 	{
-		json_decref(data->keys);
+		if(*lp == &(data->local))
+		{
+			*lp = data->local.prev;
+			break;
+		}
 	}
-	if(data->list)		
+	if(data->iterating && data->list.provider->iter_end)
 	{
-		json_decref(data->list);
+		data->list.provider->iter_end(data->list.obj, &(data->iter));
 	}
 	free(data);
 	return 0;
 }
 
-/* Return a BORROWED reference to the current value in a for loop */	  
-static json_t *
-for_current(LIQUIFYCTX *ctx, struct for_data *data)
+/* Advance to the next value in a for loop, assigning it to the iterator
+ * variable; returns 1 if there is a value, 0 at the end of the loop
+ */
+static int
+for_next(LIQUIFYCTX *ctx, struct for_data *data)
 {
-	json_t *k, *v;
-	size_t count;
-
 	(void) ctx;
 
-	if(data->keys && json_typeof(data->keys) == JSON_ARRAY)
+	if(!data->iterating)
 	{
-		count = json_array_size(data->keys);
-		if(count <= data->idx)
-		{
-			return NULL;
-		}
-		k = json_array_get(data->keys, count - data->idx - 1);
-		if(!k)
-		{
-			return NULL;
-		}
-		if(json_typeof(k) != JSON_STRING)
-		{
-			return NULL;
-		}
-		v = json_object_get(data->list, json_string_value(k));
-	}
-	else if(json_typeof(data->list) == JSON_ARRAY)
-	{
-		if(json_array_size(data->list) <= data->idx)
-		{
-			return NULL;
-		}
-		v = json_array_get(data->list, data->idx);
-	}
-	else
-	{
-		v = NULL;
+		return 0;
 	}
-	return v;
+	return data->list.provider->next(data->list.obj, &(data->iter), &(data->local.value));
 }
-
@@ -46,30 +46,29 @@ liquify_block_if_parsed_(LIQUIFYTPL *tpl, struct liquify_part *part)
 }
 
 int
-liquify_block_if_begin_(LIQUIFYCTX *ctx, struct liquify_part *part, struct liquify_stack *stack)
+liquify_block_if_begin_(LIQUIFYCTX *ctx, const struct liquify_op *op, struct liquify_stack *stack)
 {
 	struct if_data *data;
-	struct liquify_param *param;
 
 	data = (struct if_data *) liquify_alloc(ctx->tpl->env, sizeof(struct if_data));
 	stack->data = (void *) data;
-	param = part->d.tag.pfirst;
-	if(liquify_eval_truth_(&(param->expr), ctx->dict))
+	if(liquify_eval_truth_(ctx, &(op->paths[0])))
 	{
 		data->matched = 1;
 	}
 	else
 	{
-		liquify_inhibit_(ctx);
+		/* Skip to the first 'else' or 'elsif', if any */
+		liquify_skip_(ctx);
 	}
 	return 0;
 }
 
 int
-liquify_block_if_end_(LIQUIFYCTX *ctx, struct liquify_part *part, struct liquify_stack *stack)
+liquify_block_if_end_(LIQUIFYCTX *ctx, const struct liquify_op *op, struct liquify_stack *stack)
 {
 	(void) ctx;
-	(void) part;
+	(void) op;
 	(void) stack;
 	
 	return 0;
@@ -105,77 +104,43 @@ liquify_tag_elsif_parsed_(LIQUIFYTPL *template, struct liquify_part *part)
 	return 0;
 }
 
+/* 'else' and 'elsif' are reached either when the preceding branch has been
+ * processed, or when it was skipped; in either case, once a branch has been
+ * matched, the remainder of the block is skipped
+ */
 int
-liquify_tag_else_(LIQUIFYCTX *ctx, struct liquify_part *part)
+liquify_tag_else_(LIQUIFYCTX *ctx, const struct liquify_op *op)
 {
 	struct if_data *data;
-	
-	if(!ctx->stack || strcmp(ctx->stack->ident, "if"))
-	{
-		PARTERRS(ctx->tpl, part, "unexpected 'else' outside of 'if'...'endif' block\n");
-		return -1;
-	}
+
+	(void) op;
+
 	data = (struct if_data *) ctx->stack->data;
 	if(data->matched)
 	{
-		if(!ctx->capture ||
-		   !ctx->capture->inhibit ||
-		   ctx->capture->owner != ctx->stack)
-		{
-			/* Inhibit output until the end of the block */
-			liquify_inhibit_(ctx);
-		}
-		return 0;
-	}
-	if(!ctx->capture ||
-	   !ctx->capture->inhibit ||
-	   ctx->capture->owner != ctx->stack)
-	{
-		PARTERRS(ctx->tpl, part, "internal error: 'else' in unmatched branch while not inhibited or capture owner is not current stack head\n");
-		return -1;
+		return liquify_skip_(ctx);
 	}
 	data->matched = 1;
-	liquify_capture_end(ctx, NULL);
 	return 0;
 }
 
 int
-liquify_tag_elsif_(LIQUIFYCTX *ctx, struct liquify_part *part)
+liquify_tag_elsif_(LIQUIFYCTX *ctx, const struct liquify_op *op)
 {
 	struct if_data *data;
-	
-	if(!ctx->stack || strcmp(ctx->stack->ident, "if"))
-	{
-		PARTERRS(ctx->tpl, part, "unexpected 'elsif' outside of 'if'...'endif' block\n");
-		return -1;
-	}
+
 	data = (struct if_data *) ctx->stack->data;
 	if(data->matched)
 	{
-		if(!ctx->capture ||
-		   !ctx->capture->inhibit ||
-		   ctx->capture->owner != ctx->stack)
-		{
-			/* Inhibit output until the end of the block */
-			liquify_inhibit_(ctx);
-		}
-		return 0;
-	}	
+		return liquify_skip_(ctx);
+	}
 	/* The block didn't previously match a branch; if our expression
-	 * is true, then end output inhibition; otherwise, leave everything
-	 * unchanged.
+	 * is true, then process this branch; otherwise, skip to the next.
 	 */
-	if(liquify_eval_truth_(&(part->d.tag.pfirst->expr), ctx->dict))
+	if(liquify_eval_truth_(ctx, &(op->paths[0])))
 	{
-		if(!ctx->capture ||
-		   !ctx->capture->inhibit ||
-		   ctx->capture->owner != ctx->stack)
-		{
-			PARTERRS(ctx->tpl, part, "internal error: 'else' in unmatched branch while not inhibited or capture owner is not current stack head\n");
-			return -1;
-		}
 		data->matched = 1;
-		liquify_capture_end(ctx, NULL);
+		return 0;
 	}
-	return 0;
+	return liquify_skip_(ctx);
 }
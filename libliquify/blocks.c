@@ -21,15 +21,6 @@
 
 #include "p_libliquify.h"
 
-struct liquify_block_struct
-{
-	const char *name;
-	int (*parsed)(LIQUIFYTPL *tpl, struct liquify_part *part);
-	int (*begin)(LIQUIFYCTX *ctx, struct liquify_part *part, struct liquify_stack *stack);
-	int (*end)(LIQUIFYCTX *ctx, struct liquify_part *part, struct liquify_stack *stack);
-	int (*cleanup)(LIQUIFYCTX *ctx, struct liquify_stack *stack);
-};
-
 #define BLOCK(name) \
 { \
     # name, \
@@ -39,7 +30,7 @@ struct liquify_block_struct
 	liquify_block_ ## name ## _cleanup_ \
 }
 
-static struct liquify_block_struct blocks[] = {
+static const struct liquify_block_struct blocks[] = {
 	BLOCK(for),
 	BLOCK(if),
 	{ NULL, NULL, NULL, NULL, NULL }
@@ -76,38 +67,11 @@ liquify_block_parsed_(LIQUIFYTPL *tpl, struct liquify_part *part, const char *na
 	return -1;
 }
 
-int
-liquify_block_begin_(LIQUIFYCTX *ctx, struct liquify_part *part, const char *name, struct liquify_stack *stack)
-{
-	size_t c;
-
-	for(c = 0; blocks[c].name; c++)
-	{
-		if(!strcmp(blocks[c].name, name))
-		{
-			return blocks[c].begin(ctx, part, stack);
-		}
-	}
-	return -1;
-}
-
-int
-liquify_block_end_(LIQUIFYCTX *ctx, struct liquify_part *part, const char *name, struct liquify_stack *stack)
-{
-	size_t c;
-
-	for(c = 0; blocks[c].name; c++)
-	{
-		if(!strcmp(blocks[c].name, name))
-		{
-			return blocks[c].end(ctx, part, stack);
-		}
-	}
-	return -1;
-}
-
-int
-liquify_block_cleanup_(LIQUIFYCTX *ctx, const char *name, struct liquify_stack *stack)
+/* Locate a block by name, so that its handlers can be bound to the
+ * instructions of a compiled template
+ */
+const struct liquify_block_struct *
+liquify_block_locate_(const char *name)
 {
 	size_t c;
 
@@ -115,9 +79,8 @@ liquify_block_cleanup_(LIQUIFYCTX *ctx, const char *name, struct liquify_stack *
 	{
 		if(!strcmp(blocks[c].name, name))
 		{
-			return blocks[c].cleanup(ctx, stack);
+			return &(blocks[c]);
 		}
 	}
-	return -1;
+	return NULL;
 }
-
@@ -0,0 +1,529 @@
+/* Author: Mo McRoberts <mo.mcroberts@bbc.co.uk>
+ *
+ * Copyright (c) 2017 BBC.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+/* Compilation of parsed templates
+ *
+ * Once a template has been parsed, its parts are lowered into a flat array
+ * of instructions: expressions are reduced to literals or pre-split
+ * variable paths, the handlers for blocks, tags and filters are bound
+ * directly, and the branches and ends of each block are resolved to
+ * instruction indices, so that skipping a branch or repeating a loop is a
+ * single jump.
+ *
+ * Included templates are compiled in place, between LOP_INCLUDE and
+ * LOP_END_INCLUDE, so that applying a template is a single pass with no
+ * lookups or intermediate buffers. Inlined instructions refer to the parts
+ * of the included template, and so any template which is replaced causes
+ * the others in the environment to be compiled again (see liquify_parse()).
+ *
+ * Finally, runs of instructions whose output can never change -- literal
+ * text, literal values, and members of the template data which have been
+ * declared constant with liquify_set_constant() -- are gathered into
+ * fragments, each introduced by a LOP_FRAGMENT instruction. The output of a
+ * fragment is generated once, when it is compiled (if it consists only of
+ * text) or when it is first applied, and is emitted as a single block
+ * thereafter.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include "p_libliquify.h"
+
+/* A block which is open during compilation */
+struct compile_open
+{
+	/* The instruction which began the block */
+	size_t begin;
+	/* The instruction whose jump target is the next branch or the end */
+	size_t pending;
+};
+
+struct compile_state
+{
+	LIQUIFYTPL *tpl;
+	/* The number of instructions allocated */
+	size_t size;
+	struct compile_open *open;
+	size_t depth;
+	size_t opensize;
+};
+
+static int compile_parts(struct compile_state *state, LIQUIFYTPL *src, int level);
+static struct liquify_op *compile_op(struct compile_state *state, LIQUIFYTPL *src, struct liquify_part *part, int type);
+static int compile_include(struct compile_state *state, LIQUIFYTPL *src, struct liquify_part *part, int level);
+static int compile_var(LIQUIFYTPL *tpl, struct liquify_part *part, struct liquify_op *op);
+static int compile_params(LIQUIFYTPL *tpl, struct liquify_param *pfirst, struct liquify_op *op);
+static int compile_fragments(LIQUIFYTPL *tpl);
+static size_t compile_fragment_end(LIQUIFYTPL *tpl, size_t start, int *data);
+static int compile_fragment_text(LIQUIFYTPL *tpl, struct liquify_op *frag, size_t start, size_t end);
+
+int
+liquify_compile_(LIQUIFYTPL *tpl)
+{
+	struct compile_state state;
+	int r;
+
+	memset(&state, 0, sizeof(struct compile_state));
+	state.tpl = tpl;
+	r = compile_parts(&state, tpl, 0);
+	liquify_free(tpl->env, state.open);
+	if(!r)
+	{
+		r = compile_fragments(tpl);
+	}
+	return r;
+}
+
+/* Compile all of the templates in an environment again, for example
+ * because one which the others include has been replaced
+ */
+void
+liquify_recompile_(LIQUIFY *env)
+{
+	LIQUIFYTPL *tpl;
+
+	for(tpl = env->first; tpl; tpl = tpl->next)
+	{
+		liquify_compile_free_(tpl);
+		if(liquify_compile_(tpl))
+		{
+			liquify_logf(env, LOG_ERR, "%s: failed to re-compile template\n", tpl->name);
+		}
+	}
+}
+
+/* Compile the parts of a template (either the template being compiled, or
+ * one which it includes), appending them to the instructions of the
+ * template being compiled
+ */
+static int
+compile_parts(struct compile_state *state, LIQUIFYTPL *src, int level)
+{
+	LIQUIFYTPL *tpl;
+	struct liquify_part *part;
+	struct liquify_op *op;
+	const struct liquify_tag_struct *tag;
+	size_t base;
+	const char *ident;
+
+	tpl = state->tpl;
+	/* Branches may only refer to blocks opened within the same template */
+	base = state->depth;
+	for(part = src->first; part; part = part->next)
+	{
+		switch(part->type)
+		{
+		case LPT_TEXT:
+			op = compile_op(state, src, part, LOP_TEXT);
+			op->text = part->d.text.text;
+			op->len = part->d.text.len;
+			break;
+		case LPT_VAR:
+			op = compile_op(state, src, part, LOP_VAR);
+			compile_var(tpl, part, op);
+			break;
+		case LPT_TAG:
+			ident = EXPR_IDENT(&(part->d.tag.expr));
+			if(part->d.tag.kind == TPK_BEGIN)
+			{
+				op = compile_op(state, src, part, LOP_BEGIN);
+				op->block = liquify_block_locate_(ident);
+				if(state->depth >= state->opensize)
+				{
+					state->opensize += 8;
+					state->open = (struct compile_open *) liquify_realloc(tpl->env, state->open, state->opensize * sizeof(struct compile_open));
+				}
+				state->open[state->depth].begin = tpl->ncode - 1;
+				state->open[state->depth].pending = tpl->ncode - 1;
+				state->depth++;
+			}
+			else if(part->d.tag.kind == TPK_END)
+			{
+				/* The parser has already matched blocks with their ends */
+				state->depth--;
+				op = compile_op(state, src, part, LOP_END);
+				op->block = tpl->code[state->open[state->depth].begin].block;
+				op->jump = state->open[state->depth].begin;
+				tpl->code[state->open[state->depth].pending].jump = tpl->ncode - 1;
+			}
+			else
+			{
+				tag = liquify_tag_locate_(ident);
+				if(tag && tag->emit == liquify_tag_include_)
+				{
+					if(compile_include(state, src, part, level))
+					{
+						return -1;
+					}
+					break;
+				}
+				op = compile_op(state, src, part, LOP_TAG);
+				op->tag = tag;
+				if(op->tag && op->tag->block)
+				{
+					if(state->depth <= base || strcmp(tpl->code[state->open[state->depth - 1].begin].block->name, op->tag->block))
+					{
+						PARTERR(src, part, "unexpected '%s' outside of '%s'...'end%s' block\n", ident, op->tag->block, op->tag->block);
+						return -1;
+					}
+					tpl->code[state->open[state->depth - 1].pending].jump = tpl->ncode - 1;
+					state->open[state->depth - 1].pending = tpl->ncode - 1;
+				}
+			}
+			if(!op->block && !op->tag)
+			{
+				PARTERR(src, part, "internal error: no handler for '%s'\n", ident);
+				return -1;
+			}
+			compile_params(tpl, part->d.tag.pfirst, op);
+			break;
+		}
+	}
+	return 0;
+}
+
+/* Append a new instruction */
+static struct liquify_op *
+compile_op(struct compile_state *state, LIQUIFYTPL *src, struct liquify_part *part, int type)
+{
+	LIQUIFYTPL *tpl;
+	struct liquify_op *op;
+
+	tpl = state->tpl;
+	if(tpl->ncode >= state->size)
+	{
+		state->size += 64;
+		tpl->code = (struct liquify_op *) liquify_realloc(tpl->env, tpl->code, state->size * sizeof(struct liquify_op));
+	}
+	op = &(tpl->code[tpl->ncode]);
+	tpl->ncode++;
+	memset(op, 0, sizeof(struct liquify_op));
+	op->type = type;
+	op->tpl = src;
+	op->part = part;
+	return op;
+}
+
+/* Compile an include: the included template is compiled in place if it has
+ * been loaded, and the maximum inclusion depth hasn't been reached;
+ * otherwise, it will be included when the template is applied
+ */
+static int
+compile_include(struct compile_state *state, LIQUIFYTPL *src, struct liquify_part *part, int level)
+{
+	LIQUIFYTPL *tpl, *included;
+	struct liquify_op *op;
+	size_t begin;
+
+	tpl = state->tpl;
+	included = NULL;
+	if(level < MAX_INCLUDE_DEPTH)
+	{
+		included = liquify_locate(tpl->env, part->d.tag.pfirst->expr.root.right->text);
+	}
+	if(!included || included == tpl)
+	{
+		op = compile_op(state, src, part, LOP_TAG);
+		op->tag = liquify_tag_locate_("include");
+		compile_params(tpl, part->d.tag.pfirst, op);
+		return 0;
+	}
+	op = compile_op(state, src, part, LOP_INCLUDE);
+	compile_params(tpl, part->d.tag.pfirst, op);
+	begin = tpl->ncode - 1;
+	if(compile_parts(state, included, level + 1))
+	{
+		return -1;
+	}
+	op = compile_op(state, src, part, LOP_END_INCLUDE);
+	op->jump = begin;
+	tpl->code[begin].jump = tpl->ncode - 1;
+	return 0;
+}
+
+/* Free the instructions of a compiled template */
+void
+liquify_compile_free_(LIQUIFYTPL *tpl)
+{
+	size_t c, p;
+
+	for(c = 0; c < tpl->ncode; c++)
+	{
+		for(p = 0; p < tpl->code[c].npaths; p++)
+		{
+			liquify_free(tpl->env, tpl->code[c].paths[p].names);
+		}
+		liquify_free(tpl->env, tpl->code[c].paths);
+		liquify_free(tpl->env, tpl->code[c].filters);
+		liquify_free(tpl->env, tpl->code[c].cache);
+	}
+	liquify_free(tpl->env, tpl->code);
+	tpl->code = NULL;
+	tpl->ncode = 0;
+}
+
+/* Compile a variable and bind its filters */
+static int
+compile_var(LIQUIFYTPL *tpl, struct liquify_part *part, struct liquify_op *op)
+{
+	struct liquify_filter *filter;
+	const struct liquify_filter_struct *f;
+	size_t c;
+
+	op->paths = (struct liquify_path *) liquify_alloc(tpl->env, sizeof(struct liquify_path));
+	op->npaths = 1;
+	liquify_path_(tpl, &(part->d.var.expr), op->paths);
+	for(filter = part->d.var.ffirst; filter; filter = filter->next)
+	{
+		op->nfilters++;
+	}
+	if(!op->nfilters)
+	{
+		return 0;
+	}
+	op->filters = (struct liquify_filter_struct *) liquify_alloc(tpl->env, op->nfilters * sizeof(struct liquify_filter_struct));
+	for(c = 0, filter = part->d.var.ffirst; filter; c++, filter = filter->next)
+	{
+		op->filters[c].name = filter->expr.root.right->text;
+		/* Unknown filters are reported when the template is applied */
+		f = liquify_filter_locate_(op->filters[c].name);
+		if(f)
+		{
+			op->filters[c].fn = f->fn;
+		}
+	}
+	return 0;
+}
+
+/* Compile the parameters of a tag */
+static int
+compile_params(LIQUIFYTPL *tpl, struct liquify_param *pfirst, struct liquify_op *op)
+{
+	struct liquify_param *param;
+	size_t c;
+
+	for(param = pfirst; param; param = param->next)
+	{
+		op->npaths++;
+	}
+	if(!op->npaths)
+	{
+		return 0;
+	}
+	op->paths = (struct liquify_path *) liquify_alloc(tpl->env, op->npaths * sizeof(struct liquify_path));
+	for(c = 0, param = pfirst; param; c++, param = param->next)
+	{
+		liquify_path_(tpl, &(param->expr), &(op->paths[c]));
+	}
+	return 0;
+}
+
+/* Introduce each run of instructions whose output never changes with a
+ * LOP_FRAGMENT, re-numbering the jump targets of the other instructions
+ */
+static int
+compile_fragments(LIQUIFYTPL *tpl)
+{
+	struct liquify_op *code, *frag;
+	size_t *map, nfrags, ncode, c, end;
+	int data;
+
+	nfrags = 0;
+	for(c = 0; c < tpl->ncode; c = (end > c ? end : c + 1))
+	{
+		end = compile_fragment_end(tpl, c, &data);
+		if(end > c)
+		{
+			nfrags++;
+		}
+	}
+	if(!nfrags)
+	{
+		return 0;
+	}
+	code = (struct liquify_op *) liquify_alloc(tpl->env, (tpl->ncode + nfrags) * sizeof(struct liquify_op));
+	map = (size_t *) liquify_alloc(tpl->env, tpl->ncode * sizeof(size_t));
+	ncode = 0;
+	c = 0;
+	while(c < tpl->ncode)
+	{
+		end = compile_fragment_end(tpl, c, &data);
+		if(end == c)
+		{
+			map[c] = ncode;
+			code[ncode] = tpl->code[c];
+			ncode++;
+			c++;
+			continue;
+		}
+		frag = &(code[ncode]);
+		memset(frag, 0, sizeof(struct liquify_op));
+		frag->type = LOP_FRAGMENT;
+		frag->tpl = tpl->code[c].tpl;
+		frag->part = tpl->code[c].part;
+		frag->data = data;
+		ncode++;
+		compile_fragment_text(tpl, frag, c, end);
+		for(; c < end; c++)
+		{
+			map[c] = ncode;
+			code[ncode] = tpl->code[c];
+			ncode++;
+		}
+		frag->jump = ncode;
+	}
+	for(c = 0; c < ncode; c++)
+	{
+		switch(code[c].type)
+		{
+		case LOP_BEGIN:
+		case LOP_END:
+		case LOP_TAG:
+		case LOP_INCLUDE:
+		case LOP_END_INCLUDE:
+			code[c].jump = map[code[c].jump];
+			break;
+		}
+	}
+	liquify_free(tpl->env, map);
+	liquify_free(tpl->env, tpl->code);
+	tpl->code = code;
+	tpl->ncode = ncode;
+	return 0;
+}
+
+/* Determine the extent of a fragment beginning at the instruction at
+ * 'start', returning 'start' if there is no fragment worth introducing
+ */
+static size_t
+compile_fragment_end(LIQUIFYTPL *tpl, size_t start, int *data)
+{
+	LIQUIFY *env;
+	const struct liquify_op *op;
+	size_t end, c, n;
+	int vars;
+
+	env = tpl->env;
+	for(end = start; end < tpl->ncode; end++)
+	{
+		op = &(tpl->code[end]);
+		if(op->type == LOP_TEXT || op->type == LOP_INCLUDE)
+		{
+			continue;
+		}
+		if(op->type == LOP_END_INCLUDE && op->jump >= start)
+		{
+			continue;
+		}
+		if(op->type != LOP_VAR)
+		{
+			break;
+		}
+		for(c = 0; c < op->nfilters; c++)
+		{
+			if(!op->filters[c].fn)
+			{
+				break;
+			}
+		}
+		if(c < op->nfilters)
+		{
+			break;
+		}
+		if(op->paths->literal)
+		{
+			continue;
+		}
+		for(n = 0; n < env->nconstants; n++)
+		{
+			if(op->paths->count && !strcmp(op->paths->names[0], env->constants[n]))
+			{
+				break;
+			}
+		}
+		if(n == env->nconstants)
+		{
+			break;
+		}
+	}
+	/* A fragment may not end part-way through an included template */
+	for(c = start; c < end; c++)
+	{
+		if(tpl->code[c].type == LOP_INCLUDE && tpl->code[c].jump >= end)
+		{
+			end = c;
+			break;
+		}
+	}
+	*data = 0;
+	vars = 0;
+	for(c = start; c < end; c++)
+	{
+		if(tpl->code[c].type == LOP_VAR)
+		{
+			vars++;
+			if(!tpl->code[c].paths->literal)
+			{
+				*data = 1;
+			}
+		}
+	}
+	/* A single instruction is only worth replacing if it must be
+	 * evaluated
+	 */
+	if(end - start < 2 && !vars)
+	{
+		return start;
+	}
+	return end;
+}
+
+/* Generate the output of a fragment at compile time, if it consists only of
+ * literal text
+ */
+static int
+compile_fragment_text(LIQUIFYTPL *tpl, struct liquify_op *frag, size_t start, size_t end)
+{
+	size_t c, len;
+
+	for(c = start, len = 0; c < end; c++)
+	{
+		if(tpl->code[c].type == LOP_VAR)
+		{
+			return 0;
+		}
+		if(tpl->code[c].type == LOP_TEXT)
+		{
+			len += tpl->code[c].len;
+		}
+	}
+	frag->cache = (char *) liquify_alloc(tpl->env, len + 1);
+	for(c = start, len = 0; c < end; c++)
+	{
+		if(tpl->code[c].type == LOP_TEXT)
+		{
+			memcpy(&(frag->cache[len]), tpl->code[c].text, tpl->code[c].len);
+			len += tpl->code[c].len;
+		}
+	}
+	frag->cache[len] = 0;
+	frag->cachelen = len;
+	frag->cached = 1;
+	return 0;
+}
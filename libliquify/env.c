@@ -78,6 +78,38 @@ liquify_set_loader(LIQUIFY *liquify, LIQUIFYTPL *(*loader)(LIQUIFY *env, const c
 	return 0;
 }
 
+/* Declare that the named member of the template data has the same value
+ * whenever templates in this environment are applied (for example,
+ * information about the application itself). Fragments of templates whose
+ * output depends only upon literal text and constant members are
+ * generated once, and their output re-used thereafter.
+ *
+ * Any templates which have already been loaded are compiled again, and so
+ * this must not be called while templates in the environment are being
+ * applied.
+ */
+int
+liquify_set_constant(LIQUIFY *liquify, const char *name)
+{
+	size_t c;
+
+	for(c = 0; c < liquify->nconstants; c++)
+	{
+		if(!strcmp(liquify->constants[c], name))
+		{
+			return 0;
+		}
+	}
+	liquify->constants = (char **) liquify_realloc(liquify, liquify->constants, (liquify->nconstants + 1) * sizeof(char *));
+	liquify->constants[liquify->nconstants] = liquify_strdup(liquify, name);
+	liquify->nconstants++;
+	/* Templates which have already been compiled may now be able to use
+	 * cached fragments
+	 */
+	liquify_recompile_(liquify);
+	return 0;
+}
+
 /* Load a template, if it hasn't already been loaded into the environment,
  * using the callback set via liquify_set_loader().
  */
@@ -116,6 +148,12 @@ liquify_destroy(LIQUIFY *liquify)
 		liquify_tpl_free_(liquify->first);
 		liquify->first = tpl;
 	}
+	while(liquify->nconstants)
+	{
+		liquify->nconstants--;
+		liquify_free(liquify, liquify->constants[liquify->nconstants]);
+	}
+	liquify_free(liquify, liquify->constants);
 	free(liquify);
 	return 0;
 }
@@ -5,8 +5,8 @@
 #include "p_libliquify.h"
 
 static int insert_token(struct liquify_expression *expr, struct liquify_token *token);
-/* Locate or set a value in a tree of dictionaries */
-static json_t *locate_var(struct liquify_token *tok, json_t *dict, json_t *newval);
+/* Count or collect the identifiers comprising an object accessor */
+static int path_names(struct liquify_token *tok, const char **names, size_t *count);
 
 /* This is not a real expression parser - it reads a token, which must be an
  * identifier or a string literal, and will be followed by a terminator of
@@ -94,90 +94,133 @@ liquify_expression_(LIQUIFYTPL *tpl, struct liquify_part *part, struct liquify_e
 	return NULL;
 }
 
-/* Evaluate an expression; returns NULL if:
- * - an error occurred
- * - if newval was not specified, the expression did not evaluate to an object
- * otherwise, returns a new reference to an object which must be decremented.
+/* Compile an expression into a path: either a string literal, or the
+ * sequence of identifiers which must be resolved (in turn) to locate a
+ * value. Expressions which can't be evaluated are compiled to an empty
+ * path, which is always undefined.
  */
-json_t *
-liquify_eval_(struct liquify_expression *expr, json_t *dict, json_t *newval)
+int
+liquify_path_(LIQUIFYTPL *tpl, struct liquify_expression *expr, struct liquify_path *path)
 {
+	size_t count;
+
+	memset(path, 0, sizeof(struct liquify_path));
+	if(!expr->root.right)
+	{
+		return 0;
+	}
 	switch(expr->root.right->type)
 	{
+	case TOK_STRING:
+		path->literal = expr->root.right->text;
+		return 0;
 	case TOK_DOT:
 	case TOK_IDENT:
-		return locate_var(expr->root.right, dict, newval);
-	case TOK_STRING:
-		return json_string(expr->root.right->text);
+		count = 0;
+		if(path_names(expr->root.right, NULL, &count))
+		{
+			return 0;
+		}
+		path->names = (const char **) liquify_alloc(tpl->env, count * sizeof(const char *));
+		path_names(expr->root.right, path->names, &(path->count));
+		return 0;
 	}
-	return NULL;
+	return 0;
 }
 
-/* Evaluate an expression to a boolean value */
+/* Evaluate a compiled expression; if it cannot be resolved to a value
+ * (including if an error occurs), the resulting value is LVT_UNDEFINED.
+ *
+ * The first identifier of a path is resolved against the local variables
+ * of the context and then against the root object; each subsequent
+ * identifier is resolved against the object located so far.
+ */
 int
-liquify_eval_truth_(struct liquify_expression *expr, json_t *dict)
+liquify_eval_(LIQUIFYCTX *ctx, const struct liquify_path *path, LIQUIFYVALUE *value)
 {
-	const char *t;
-	json_t *value;
-	int r;
+	struct liquify_local *local;
+	LIQUIFYVALUE scope;
+	size_t c;
 
-	switch(expr->root.right->type)
+	memset(value, 0, sizeof(LIQUIFYVALUE));
+	if(path->literal)
 	{
-	case TOK_DOT:
-	case TOK_IDENT:
-		value = locate_var(expr->root.right, dict, NULL);
-		if(!value)
+		value->type = LVT_STRING;
+		value->str = path->literal;
+		value->len = strlen(path->literal);
+		return 0;
+	}
+	if(!path->count)
+	{
+		return 0;
+	}
+	for(local = ctx->locals; local; local = local->prev)
+	{
+		if(!strcmp(local->name, path->names[0]))
+		{
+			*value = local->value;
+			break;
+		}
+	}
+	if(!local && (!ctx->root || ctx->provider->get(ctx->root, path->names[0], value) < 1))
+	{
+		memset(value, 0, sizeof(LIQUIFYVALUE));
+		return 0;
+	}
+	for(c = 1; c < path->count; c++)
+	{
+		if(value->type != LVT_OBJECT)
 		{
+			memset(value, 0, sizeof(LIQUIFYVALUE));
 			return 0;
 		}
-		r = 0;
-		switch(json_typeof(value))
+		scope = *value;
+		if(scope.provider->get(scope.obj, path->names[c], value) < 1)
 		{
-		case JSON_NULL:
-		case JSON_FALSE:
-			break;
-		case JSON_TRUE:
-			r = 1;
-			break;
-		case JSON_INTEGER:
-			r = json_integer_value(value) == 0 ? 0 : 1;
-			break;
-		case JSON_REAL:
-			r = json_real_value(value) == 0.0 ? 0 : 1;
-			break;
-		case JSON_STRING:
-			t = json_string_value(value);
-			if(t && t[0])
-			{
-				r = 1;
-			}
-			break;
-		case JSON_ARRAY:
-		case JSON_OBJECT:
-			r = 1;
-			break;
-		default:
-			break;
+			memset(value, 0, sizeof(LIQUIFYVALUE));
+			return 0;
 		}
-		json_decref(value);
-		return r;
-	case TOK_STRING:
-		return 1;
 	}
 	return 0;
 }
 
-/* Assign a value to an expression (currently non-hierarchical) */
+/* Evaluate a compiled expression to a boolean value */
 int
-liquify_assign_(struct liquify_expression *expr, json_t *dict, json_t *newval)
+liquify_eval_truth_(LIQUIFYCTX *ctx, const struct liquify_path *path)
 {
-	switch(expr->root.right->type)
+	LIQUIFYVALUE value;
+
+	if(path->literal)
 	{
-	case TOK_IDENT:
-		json_object_set(dict, expr->root.right->text, newval);
+		return 1;
+	}
+	liquify_eval_(ctx, path, &value);
+	return liquify_truth_(&value);
+}
+
+/* Determine the truth of a value */
+int
+liquify_truth_(const LIQUIFYVALUE *value)
+{
+	switch(value->type)
+	{
+	case LVT_UNDEFINED:
+	case LVT_NULL:
+	case LVT_FALSE:
 		return 0;
+	case LVT_TRUE:
+		return 1;
+	case LVT_INTEGER:
+		return value->integer == 0 ? 0 : 1;
+	case LVT_REAL:
+		return value->real == 0.0 ? 0 : 1;
+	case LVT_STRING:
+		return (value->str && value->str[0]) ? 1 : 0;
+	case LVT_LIST:
+	case LVT_OBJECT:
+		return 1;
 	}
-	return -1;
+	return 0;
 }
 
 /* Push the current token down the tree */
@@ -194,47 +237,32 @@ insert_token(struct liquify_expression *expr, struct liquify_token *tok)
 	return 0;
 }
 
-/* Locate an lvalue within dict based upon the contents of tok;
- * the result, if successful, is ALWAYS a new reference - even if it's
- * a copy of the pointer to newval
+/* Determine the identifiers comprising an object accessor (which are
+ * nested to the right, so that 'a.b.c' is a.(b.c)); if names is NULL, they
+ * are only counted. Returns -1 if the token tree is not an accessor.
  */
-static json_t *
-locate_var(struct liquify_token *tok, json_t *dict, json_t *newval)
+static int
+path_names(struct liquify_token *tok, const char **names, size_t *count)
 {
-	json_t *left, *r;
-
-	if(!tok || !dict)
+	if(!tok)
 	{
-		return NULL;
+		return -1;
 	}
 	switch(tok->type)
 	{
 	case TOK_DOT:
-		left = locate_var(tok->left, dict, newval);
-		if(!left)
+		if(path_names(tok->left, names, count) || path_names(tok->right, names, count))
 		{
-			return NULL;
+			return -1;
 		}
-		r = locate_var(tok->right, left, newval);
-		json_decref(left);
-		return r;
+		return 0;
 	case TOK_IDENT:
-		if(newval)
+		if(names)
 		{
-			if(json_object_set(dict, tok->text, newval))
-			{
-				return NULL;
-			}
-			json_incref(newval);
-			return newval;
-		}
-		newval = json_object_get(dict, tok->text);
-		if(!newval)
-		{
-			return NULL;
+			names[*count] = tok->text;
 		}
-		json_incref(newval);
-		return newval;
+		(*count)++;
+		return 0;
 	}
-	return NULL;
+	return -1;
 }
@@ -21,16 +21,10 @@
 
 #include "p_libliquify.h"
 
-struct liquify_filter_struct
-{
-	const char *name;
-	int (*fn)(LIQUIFYCTX *ctx, char *buf, size_t len, const char *name);
-};
-
 #define FILTER(name) \
 	{ # name, liquify_filter_ ## name ## _ }
 
-static struct liquify_filter_struct filters[] = {
+static const struct liquify_filter_struct filters[] = {
 	FILTER(escape),
 	FILTER(downcase),
 	FILTER(upcase),
@@ -52,8 +46,11 @@ liquify_is_filter_(const char *name)
 	return 0;
 }
 
-int
-liquify_filter_apply_(LIQUIFYCTX *ctx, const char *name, char *buf, size_t len)
+/* Locate a filter by name, so that it can be bound to the instructions of
+ * a compiled template
+ */
+const struct liquify_filter_struct *
+liquify_filter_locate_(const char *name)
 {
 	size_t c;
 
@@ -61,13 +58,8 @@ liquify_filter_apply_(LIQUIFYCTX *ctx, const char *name, char *buf, size_t len)
 	{
 		if(!strcmp(name, filters[c].name))
 		{
-			return filters[c].fn(ctx, buf, len, name);
+			return &(filters[c]);
 		}
 	}
-	liquify_emit(ctx, buf, len);
-	liquify_emit_str(ctx, "<!-- Warning: no such filter '");
-	liquify_emit_str(ctx, name);
-	liquify_emit_str(ctx, "-->");
-	return -1;
+	return NULL;
 }
-
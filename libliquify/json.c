@@ -0,0 +1,181 @@
+/* Author: Mo McRoberts <mo.mcroberts@bbc.co.uk>
+ *
+ * Copyright (c) 2017 BBC.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include "p_libliquify.h"
+
+/* The data provider for jansson values: objects and lists are json_t
+ * pointers, which are borrowed from the dictionary passed to
+ * liquify_apply()
+ */
+
+static int json_get_(void *obj, const char *key, LIQUIFYVALUE *value);
+static int json_iter_(void *obj, LIQUIFYITER *iter);
+static int json_next_(void *obj, LIQUIFYITER *iter, LIQUIFYVALUE *value);
+static void json_iter_end_(void *obj, LIQUIFYITER *iter);
+static int json_emit_(LIQUIFYCTX *ctx, void *obj);
+static void json_value_(json_t *json, LIQUIFYVALUE *value);
+
+const LIQUIFYPROVIDER liquify_json_provider = {
+	json_get_,
+	json_iter_,
+	json_next_,
+	json_iter_end_,
+	json_emit_
+};
+
+static int
+json_get_(void *obj, const char *key, LIQUIFYVALUE *value)
+{
+	json_t *json;
+
+	json = json_object_get((json_t *) obj, key);
+	if(!json)
+	{
+		return 0;
+	}
+	json_value_(json, value);
+	return 1;
+}
+
+/* Lists are iterated in order; the members of an object are visited in
+ * the reverse of the order in which jansson would iterate them
+ */
+static int
+json_iter_(void *obj, LIQUIFYITER *iter)
+{
+	json_t *json;
+	const char **keys;
+	void *p;
+	size_t c;
+
+	json = (json_t *) obj;
+	iter->index = 0;
+	iter->data = NULL;
+	switch(json_typeof(json))
+	{
+	case JSON_ARRAY:
+		iter->count = json_array_size(json);
+		return 0;
+	case JSON_OBJECT:
+		iter->count = json_object_size(json);
+		if(!iter->count)
+		{
+			return 0;
+		}
+		keys = (const char **) calloc(iter->count, sizeof(const char *));
+		if(!keys)
+		{
+			return -1;
+		}
+		for(c = 0, p = json_object_iter(json); p && c < iter->count; p = json_object_iter_next(json, p), c++)
+		{
+			keys[iter->count - c - 1] = json_object_iter_key(p);
+		}
+		iter->count = c;
+		iter->data = (void *) keys;
+		return 0;
+	default:
+		break;
+	}
+	return -1;
+}
+
+static int
+json_next_(void *obj, LIQUIFYITER *iter, LIQUIFYVALUE *value)
+{
+	json_t *json, *member;
+	const char **keys;
+
+	json = (json_t *) obj;
+	member = NULL;
+	while(!member && iter->index < iter->count)
+	{
+		if(iter->data)
+		{
+			keys = (const char **) iter->data;
+			member = json_object_get(json, keys[iter->index]);
+		}
+		else
+		{
+			member = json_array_get(json, iter->index);
+		}
+		iter->index++;
+	}
+	if(!member)
+	{
+		return 0;
+	}
+	json_value_(member, value);
+	return 1;
+}
+
+static void
+json_iter_end_(void *obj, LIQUIFYITER *iter)
+{
+	(void) obj;
+
+	free(iter->data);
+	iter->data = NULL;
+}
+
+static int
+json_emit_(LIQUIFYCTX *ctx, void *obj)
+{
+	return liquify_emit_json(ctx, (json_t *) obj);
+}
+
+static void
+json_value_(json_t *json, LIQUIFYVALUE *value)
+{
+	memset(value, 0, sizeof(LIQUIFYVALUE));
+	switch(json_typeof(json))
+	{
+	case JSON_NULL:
+		value->type = LVT_NULL;
+		break;
+	case JSON_TRUE:
+		value->type = LVT_TRUE;
+		break;
+	case JSON_FALSE:
+		value->type = LVT_FALSE;
+		break;
+	case JSON_INTEGER:
+		value->type = LVT_INTEGER;
+		value->integer = (long long) json_integer_value(json);
+		break;
+	case JSON_REAL:
+		value->type = LVT_REAL;
+		value->real = json_real_value(json);
+		break;
+	case JSON_STRING:
+		value->type = LVT_STRING;
+		value->str = json_string_value(json);
+		value->len = strlen(value->str);
+		break;
+	case JSON_ARRAY:
+		liquify_value_list(value, &liquify_json_provider, (void *) json);
+		break;
+	case JSON_OBJECT:
+		liquify_value_object(value, &liquify_json_provider, (void *) json);
+		break;
+	}
+}
@@ -30,6 +30,78 @@
 typedef struct liquify_struct LIQUIFY;
 typedef struct liquify_template_struct LIQUIFYTPL;
 typedef struct liquify_context_struct LIQUIFYCTX;
+typedef struct liquify_value_struct LIQUIFYVALUE;
+typedef struct liquify_iter_struct LIQUIFYITER;
+typedef struct liquify_provider_struct LIQUIFYPROVIDER;
+
+/* The types of value which can be obtained from a data provider */
+typedef enum
+{
+	LVT_UNDEFINED,
+	LVT_NULL,
+	LVT_FALSE,
+	LVT_TRUE,
+	LVT_INTEGER,
+	LVT_REAL,
+	LVT_STRING,
+	LVT_LIST,
+	LVT_OBJECT
+} LIQUIFYTYPE;
+
+/* A value obtained from a data provider. Strings, lists and objects are
+ * borrowed from the provider, and must remain valid until the template
+ * has been applied.
+ */
+struct liquify_value_struct
+{
+	LIQUIFYTYPE type;
+	/* LVT_STRING */
+	const char *str;
+	size_t len;
+	/* LVT_INTEGER */
+	long long integer;
+	/* LVT_REAL */
+	double real;
+	/* LVT_LIST and LVT_OBJECT: the provider responsible for the value, and
+	 * its own representation of it
+	 */
+	const LIQUIFYPROVIDER *provider;
+	void *obj;
+};
+
+/* The state of an iteration over a list or object */
+struct liquify_iter_struct
+{
+	size_t index;
+	size_t count;
+	void *data;
+};
+
+/* A data provider supplies the values which are substituted into a
+ * template, allowing an application to expose its own data structures
+ * directly. Values within a list or object may be supplied by a different
+ * provider to that of the list or object itself.
+ */
+struct liquify_provider_struct
+{
+	/* Obtain the named member of an object; returns 1 if found, 0 if not */
+	int (*get)(void *obj, const char *key, LIQUIFYVALUE *value);
+	/* Prepare to iterate the members of a list or object; returns 0 on
+	 * success, -1 if the value cannot be iterated
+	 */
+	int (*iter)(void *obj, LIQUIFYITER *iter);
+	/* Obtain the next value in an iteration; returns 1 if found, 0 at the
+	 * end
+	 */
+	int (*next)(void *obj, LIQUIFYITER *iter, LIQUIFYVALUE *value);
+	/* Release any resources used by an iteration (may be NULL) */
+	void (*iter_end)(void *obj, LIQUIFYITER *iter);
+	/* Write a representation of a list or object (may be NULL) */
+	int (*emit)(LIQUIFYCTX *ctx, void *obj);
+};
+
+/* The data provider for jansson values */
+extern const LIQUIFYPROVIDER liquify_json_provider;
 
 /* Create a liquify environment */
 LIQUIFY *liquify_create(void);
@@ -40,6 +112,12 @@ int liquify_set_logger(LIQUIFY *liquify, void (*logger)(int level, const char *f
 /* Set the loader callback for a liquify environment */
 int liquify_set_loader(LIQUIFY *liquify, LIQUIFYTPL *(*loader)(LIQUIFY *env, const char *name, void *dta), void *data);
 
+/* Declare that a member of the template data has the same value whenever
+ * templates are applied, so that output which depends only upon it can be
+ * cached
+ */
+int liquify_set_constant(LIQUIFY *liquify, const char *name);
+
 /* Load a template, using the currently-defined loader */
 LIQUIFYTPL *liquify_load(LIQUIFY *liquify, const char *name);
 
@@ -64,6 +142,22 @@ LIQUIFYTPL *liquify_locate(LIQUIFY *env, const char *name);
 /* Apply a template, returning its contents as a string */
 char *liquify_apply_name(LIQUIFY *env, const char *name, json_t *dict);
 char *liquify_apply(LIQUIFYTPL *tpl, json_t *dict);
+/* Apply a template whose data is supplied by a provider, where root is
+ * the provider's representation of the top-level object
+ */
+char *liquify_apply_data(LIQUIFYTPL *tpl, const LIQUIFYPROVIDER *provider, void *root);
+/* Apply a template, passing its output to a write function as it is
+ * generated, rather than returning it
+ */
+int liquify_apply_stream(LIQUIFYTPL *tpl, const LIQUIFYPROVIDER *provider, void *root, int (*write)(const char *buf, size_t len, void *data), void *data);
+
+/* Populate a value structure */
+void liquify_value_string(LIQUIFYVALUE *value, const char *str);
+void liquify_value_bool(LIQUIFYVALUE *value, int b);
+void liquify_value_integer(LIQUIFYVALUE *value, long long i);
+void liquify_value_real(LIQUIFYVALUE *value, double d);
+void liquify_value_object(LIQUIFYVALUE *value, const LIQUIFYPROVIDER *provider, void *obj);
+void liquify_value_list(LIQUIFYVALUE *value, const LIQUIFYPROVIDER *provider, void *obj);
 
 /* Write text to the current processing context */
 int liquify_emit(LIQUIFYCTX *ctx, const char *str, size_t len);
@@ -71,6 +165,8 @@ int liquify_emit(LIQUIFYCTX *ctx, const char *str, size_t len);
 int liquify_emit_str(LIQUIFYCTX *ctx, const char *str);
 /* Write a JSON value to the current context */
 int liquify_emit_json(LIQUIFYCTX *ctx, json_t *value);
+/* Write a value obtained from a data provider to the current context */
+int liquify_emit_value(LIQUIFYCTX *ctx, const LIQUIFYVALUE *value);
 
 /* Begin capturing output to a buffer */
 int liquify_capture(LIQUIFYCTX *ctx);
@@ -31,11 +31,24 @@
 
 # define MAX_INCLUDE_DEPTH             32
 
+/* The amount of output buffered before it is passed to a write function */
+# define STREAM_BUFSIZE                8192
+
 /* Part types */
 # define LPT_TEXT                      0
 # define LPT_VAR                       1
 # define LPT_TAG                       2
 
+/* Instruction types */
+# define LOP_TEXT                      0
+# define LOP_VAR                       1
+# define LOP_BEGIN                     2
+# define LOP_END                       3
+# define LOP_TAG                       4
+# define LOP_INCLUDE                   5
+# define LOP_END_INCLUDE               6
+# define LOP_FRAGMENT                  7
+
 /* Tokens */
 # define TOK_NONE                      0
 # define TOK_IDENT                     'i'
@@ -178,6 +191,9 @@ struct liquify_struct
 	LIQUIFYTPL *(*loader)(LIQUIFY *liquify, const char *name, void *data);
 	void *loaddata;
 	int depth;
+	/* Members of the template data whose values never change */
+	char **constants;
+	size_t nconstants;
 };
 
 struct liquify_template_struct
@@ -186,6 +202,9 @@ struct liquify_template_struct
 	LIQUIFYTPL *next;
 	/* Template components */
 	struct liquify_part *first, *last;
+	/* The compiled template */
+	struct liquify_op *code;
+	size_t ncode;
 	/* Parser state */
 	char *name;
 	const char *start;
@@ -196,11 +215,88 @@ struct liquify_template_struct
 	struct liquify_part *stack;
 };
 
+struct liquify_op;
+struct liquify_stack;
+
+/* A block, such as 'for' or 'if' */
+struct liquify_block_struct
+{
+	const char *name;
+	int (*parsed)(LIQUIFYTPL *tpl, struct liquify_part *part);
+	int (*begin)(LIQUIFYCTX *ctx, const struct liquify_op *op, struct liquify_stack *stack);
+	int (*end)(LIQUIFYCTX *ctx, const struct liquify_op *op, struct liquify_stack *stack);
+	int (*cleanup)(LIQUIFYCTX *ctx, struct liquify_stack *stack);
+};
+
+/* A tag; if 'block' is set, the tag begins a new branch of the named block
+ * (such as 'else' within 'if'), and must appear directly within it
+ */
+struct liquify_tag_struct
+{
+	const char *name;
+	const char *block;
+	int (*parsed)(LIQUIFYTPL *template, struct liquify_part *part);
+	int (*emit)(LIQUIFYCTX *ctx, const struct liquify_op *op);
+};
+
+/* A filter; fn is NULL if the named filter does not exist */
+struct liquify_filter_struct
+{
+	const char *name;
+	int (*fn)(LIQUIFYCTX *ctx, char *buf, size_t len, const char *name);
+};
+
+/* An expression, compiled either to a literal string or to the path of a
+ * variable (such as item.props), which is resolved one identifier at a
+ * time. If neither is set, the expression always evaluates as undefined.
+ */
+struct liquify_path
+{
+	const char *literal;
+	const char **names;
+	size_t count;
+};
+
+/* A single instruction of a compiled template */
+struct liquify_op
+{
+	int type;
+	/* The template and part this instruction was compiled from */
+	LIQUIFYTPL *tpl;
+	struct liquify_part *part;
+	/* LOP_TEXT */
+	const char *text;
+	size_t len;
+	/* LOP_VAR: the expression to be emitted; LOP_BEGIN, LOP_TAG and
+	 * LOP_INCLUDE: the parameters
+	 */
+	struct liquify_path *paths;
+	size_t npaths;
+	/* LOP_VAR */
+	struct liquify_filter_struct *filters;
+	size_t nfilters;
+	/* LOP_BEGIN and LOP_END */
+	const struct liquify_block_struct *block;
+	/* LOP_TAG */
+	const struct liquify_tag_struct *tag;
+	/* LOP_BEGIN and branch tags: the index of the next branch of the block,
+	 * or of its end; LOP_END: the index of the beginning of the block;
+	 * LOP_INCLUDE and LOP_END_INCLUDE: the index of the other;
+	 * LOP_FRAGMENT: the index following the fragment
+	 */
+	size_t jump;
+	/* LOP_FRAGMENT: the output of the fragment, once it has been generated,
+	 * and whether it refers to the template data
+	 */
+	char *cache;
+	size_t cachelen;
+	int cached;
+	int data;
+};
+
 struct liquify_capture
 {
 	struct liquify_capture *prev;
-	struct liquify_stack *owner;
-	int inhibit;
 	char *buf;
 	size_t buflen;
 	size_t bufsize;
@@ -209,22 +305,59 @@ struct liquify_capture
 struct liquify_stack
 {
 	struct liquify_stack *prev;
-	struct liquify_part *begin, *end;
-	const char *ident;
+	const struct liquify_block_struct *block;
+	/* The index of the instruction which began the block */
+	size_t begin;
 	void *data;
 };
 
+/* A variable local to a block, such as the iterator of a for loop, which
+ * takes precedence over the members of the root object
+ */
+struct liquify_local
+{
+	struct liquify_local *prev;
+	const char *name;
+	LIQUIFYVALUE value;
+};
+
+/* The state of the context at the beginning of an included template, so
+ * that if applying it fails, its output can be discarded
+ */
+struct liquify_inclusion
+{
+	const struct liquify_op *op;
+	/* The amount of output generated before the template was included */
+	size_t offset;
+	struct liquify_stack *stack;
+	struct liquify_local *locals;
+};
+
 struct liquify_context_struct
 {
 	LIQUIFYTPL *tpl;
 	struct liquify_capture *capture;
-	struct liquify_part *cp;
-	json_t *dict;
+	/* The index of the current instruction */
+	size_t pc;
+	const LIQUIFYPROVIDER *provider;
+	void *root;
+	struct liquify_local *locals;
 	char *buf;
 	size_t buflen;
 	size_t bufsize;
+	/* If output is being streamed, the function it is written to, and the
+	 * amount which has been written so far
+	 */
+	int (*write)(const char *buf, size_t len, void *data);
+	void *writedata;
+	size_t written;
+	int writeerr;
 	int jumped;
+	int skipped;
 	struct liquify_stack *stack;
+	/* Included templates which are being applied */
+	struct liquify_inclusion includes[MAX_INCLUDE_DEPTH];
+	size_t nincludes;
 };
 
 /* Parse a single token */
@@ -235,43 +368,54 @@ int liquify_tpl_free_(LIQUIFYTPL *template);
 int liquify_token_free_(LIQUIFYTPL *template, struct liquify_token *tok);
 /* Parse an expression */
 const char *liquify_expression_(LIQUIFYTPL *tpl, struct liquify_part *part, struct liquify_expression *expr, const char *cur, int flags);
-/* Evaluate an expression */
-json_t *liquify_eval_(struct liquify_expression *expr, json_t *dict, json_t *newval);
-int liquify_eval_truth_(struct liquify_expression *expr, json_t *dict);
-/* Assign a value to a template variable */
-int liquify_assign_(struct liquify_expression *expr, json_t *dict, json_t *newval);
+/* Compile an expression to a path */
+int liquify_path_(LIQUIFYTPL *tpl, struct liquify_expression *expr, struct liquify_path *path);
+/* Evaluate a compiled expression; the value is LVT_UNDEFINED if it could
+ * not be resolved
+ */
+int liquify_eval_(LIQUIFYCTX *ctx, const struct liquify_path *path, LIQUIFYVALUE *value);
+int liquify_eval_truth_(LIQUIFYCTX *ctx, const struct liquify_path *path);
+/* Determine the truth of a value */
+int liquify_truth_(const LIQUIFYVALUE *value);
+
+/* Compile a parsed template */
+int liquify_compile_(LIQUIFYTPL *tpl);
+/* Free a compiled template */
+void liquify_compile_free_(LIQUIFYTPL *tpl);
+/* Compile all of the templates in an environment again */
+void liquify_recompile_(LIQUIFY *env);
+
+/* Apply a template within the data scope of another (used by 'include') */
+char *liquify_apply_ctx_(LIQUIFYTPL *tpl, LIQUIFYCTX *parent);
 
 /* Determine whether a tag is a block */
 int liquify_is_block_(const char *name);
 /* Invoked once the opening tag for a block has been parsed */
 int liquify_block_parsed_(LIQUIFYTPL *tpl, struct liquify_part *part, const char *name);
-/* Process a block */
-int liquify_block_begin_(LIQUIFYCTX *ctx, struct liquify_part *part, const char *name, struct liquify_stack *sp);
-int liquify_block_end_(LIQUIFYCTX *ctx, struct liquify_part *part, const char *name, struct liquify_stack *sp);
-int liquify_block_cleanup_(LIQUIFYCTX *ctx, const char *name, struct liquify_stack *stack);
+/* Locate a block by name */
+const struct liquify_block_struct *liquify_block_locate_(const char *name);
 
 /* Determine whether a tag is a non-block tag */
 int liquify_is_tag_(const char *name);
 /* Invoked once a tag has been parsed */
 int liquify_tag_parsed_(LIQUIFYTPL *template, struct liquify_part *part, const char *name);
-/* Invoked to process a tag */
-int liquify_tag_(LIQUIFYCTX *ctx, struct liquify_part *part, const char *name);
+/* Locate a tag by name */
+const struct liquify_tag_struct *liquify_tag_locate_(const char *name);
 
 /* Push a new node on the block stack */
-struct liquify_stack *liquify_push_(LIQUIFYCTX *ctx, struct liquify_part *begin);
+struct liquify_stack *liquify_push_(LIQUIFYCTX *ctx, const struct liquify_block_struct *block);
 /* Pop a node off the block stack */
 int liquify_pop_(LIQUIFYCTX *ctx);
 
-/* Inhibit further output for this block */
-int liquify_inhibit_(LIQUIFYCTX *ctx);
-
-/* Jump to a particular location in the template */
-int liquify_goto_(LIQUIFYCTX *ctx, struct liquify_part *where);
+/* Skip to the next branch of the current block, or to its end */
+int liquify_skip_(LIQUIFYCTX *ctx);
+/* Jump back to the start of the body of the current block */
+int liquify_repeat_(LIQUIFYCTX *ctx);
 
 /* Determine whether a filter exists */
 int liquify_is_filter_(const char *name);
-/* Apply a filter to a buffer in a template application context */
-int liquify_filter_apply_(LIQUIFYCTX *ctx, const char *name, char *buf, size_t len);
+/* Locate a filter by name */
+const struct liquify_filter_struct *liquify_filter_locate_(const char *name);
 
 /* Filters */
 
@@ -287,7 +431,7 @@ DECLARE_FILTER(upcase);
 
 # define DECLARE_TAG(name) \
 	int liquify_tag_## name ##_parsed_(LIQUIFYTPL *template, struct liquify_part *part); \
-	int liquify_tag_## name ##_(LIQUIFYCTX *ctx, struct liquify_part *part);
+	int liquify_tag_## name ##_(LIQUIFYCTX *ctx, const struct liquify_op *op);
 
 DECLARE_TAG(include);
 DECLARE_TAG(else);
@@ -296,8 +440,8 @@ DECLARE_TAG(elsif);
 /* Blocks */
 # define DECLARE_BLOCK(name) \
 	int liquify_block_## name ##_parsed_(LIQUIFYTPL *template, struct liquify_part *part); \
-	int liquify_block_## name ##_begin_(LIQUIFYCTX *ctx, struct liquify_part *part, struct liquify_stack *stack); \
-	int liquify_block_## name ##_end_(LIQUIFYCTX *ctx, struct liquify_part *part, struct liquify_stack *stack); \
+	int liquify_block_## name ##_begin_(LIQUIFYCTX *ctx, const struct liquify_op *op, struct liquify_stack *stack); \
+	int liquify_block_## name ##_end_(LIQUIFYCTX *ctx, const struct liquify_op *op, struct liquify_stack *stack); \
 	int liquify_block_## name ##_cleanup_(LIQUIFYCTX *ctx, struct liquify_stack *stack);
 
 DECLARE_BLOCK(for);
@@ -142,6 +142,11 @@ liquify_parse(LIQUIFY *env, const char *name, const char *doc, size_t len)
 		liquify_tpl_free_(tpl);
 		return NULL;
 	}
+	if(liquify_compile_(tpl))
+	{
+		liquify_tpl_free_(tpl);
+		return NULL;
+	}
 	/* Clean up the parsing context */
 	tpl->start = NULL;
 	tpl->len = 0;
@@ -168,6 +173,11 @@ liquify_parse(LIQUIFY *env, const char *name, const char *doc, size_t len)
 			{
 				env->last = tpl;
 			}
+			/* Any template may have compiled the one being replaced in place
+			 * of an include, so all of them must be compiled again before
+			 * it is freed
+			 */
+			liquify_recompile_(env);
 			liquify_tpl_free_(p);
 			return tpl;
 		}
@@ -199,6 +209,7 @@ liquify_tpl_free_(LIQUIFYTPL *template)
 	LIQUIFY *env;
 	
 	env = template->env;
+	liquify_compile_free_(template);
 	for(part = template->first; part; part = nextpart)
 	{
 		nextpart = part->next;
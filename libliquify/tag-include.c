@@ -46,19 +46,31 @@ liquify_tag_include_parsed_(LIQUIFYTPL *template, struct liquify_part *part)
 }
 
 int
-liquify_tag_include_(LIQUIFYCTX *ctx, struct liquify_part *part)
+liquify_tag_include_(LIQUIFYCTX *ctx, const struct liquify_op *op)
 {
+	LIQUIFYTPL *tpl;
+	const char *name;
 	char *buf;
 
+	name = op->paths[0].literal;
 	if(ctx->tpl->env->depth >= MAX_INCLUDE_DEPTH)
 	{
 		liquify_emit_str(ctx, "[refusing to include '");
-		liquify_emit_str(ctx, part->d.tag.pfirst->expr.root.right->text);
+		liquify_emit_str(ctx, name);
 		liquify_emit_str(ctx, "' because the maximum inclusion depth has been reached]");
 		return -1;
 	}
 	ctx->tpl->env->depth++;
-	buf = liquify_apply_name(ctx->tpl->env, part->d.tag.pfirst->expr.root.right->text, ctx->dict);
+	tpl = liquify_locate(ctx->tpl->env, name);
+	buf = NULL;
+	if(tpl)
+	{
+		buf = liquify_apply_ctx_(tpl, ctx);
+	}
+	else
+	{
+		liquify_logf(ctx->tpl->env, LOG_ERR, "failed to locate template '%s'\n", name);
+	}
 	ctx->tpl->env->depth--;
 	if(buf)
 	{
@@ -68,7 +80,7 @@ liquify_tag_include_(LIQUIFYCTX *ctx, struct liquify_part *part)
 	else
 	{
 		liquify_emit_str(ctx, "[failed to include '");
-		liquify_emit_str(ctx, part->d.tag.pfirst->expr.root.right->text);
+		liquify_emit_str(ctx, name);
 		liquify_emit_str(ctx, "']");
 	}
 	return 0;
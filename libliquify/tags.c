@@ -21,21 +21,18 @@
 
 #include "p_libliquify.h"
 
-struct liquify_tag_struct
-{
-	const char *name;
-	int (*parsed)(LIQUIFYTPL *template, struct liquify_part *part);
-	int (*emit)(LIQUIFYCTX *ctx, struct liquify_part *part);
-};
-
 #define TAG(name) \
-	{ # name, liquify_tag_ ## name ## _parsed_, liquify_tag_ ## name ## _ }
+	{ # name, NULL, liquify_tag_ ## name ## _parsed_, liquify_tag_ ## name ## _ }
+
+/* A tag which begins a new branch of a block */
+#define BRANCH(name, block) \
+	{ # name, # block, liquify_tag_ ## name ## _parsed_, liquify_tag_ ## name ## _ }
 
-static struct liquify_tag_struct tags[] = {
+static const struct liquify_tag_struct tags[] = {
 	TAG(include),
-	TAG(else),
-	TAG(elsif),
-	{ NULL, NULL, NULL }
+	BRANCH(else, if),
+	BRANCH(elsif, if),
+	{ NULL, NULL, NULL, NULL }
 };
 
 int
@@ -68,8 +65,11 @@ liquify_tag_parsed_(LIQUIFYTPL *template, struct liquify_part *part, const char
 	return -1;
 }
 
-int
-liquify_tag_(LIQUIFYCTX *ctx, struct liquify_part *part, const char *name)
+/* Locate a tag by name, so that its handler can be bound to the
+ * instructions of a compiled template
+ */
+const struct liquify_tag_struct *
+liquify_tag_locate_(const char *name)
 {
 	size_t c;
 
@@ -77,9 +77,8 @@ liquify_tag_(LIQUIFYCTX *ctx, struct liquify_part *part, const char *name)
 	{
 		if(!strcmp(tags[c].name, name))
 		{
-			return tags[c].emit(ctx, part);
+			return &(tags[c]);
 		}
 	}
-	return -1;
+	return NULL;
 }
-
@@ -0,0 +1,114 @@
+/* Author: Mo McRoberts <mo.mcroberts@bbc.co.uk>
+ *
+ * Copyright (c) 2017 BBC.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include "p_libliquify.h"
+
+/* Populate value structures, for use by data providers */
+
+void
+liquify_value_string(LIQUIFYVALUE *value, const char *str)
+{
+	memset(value, 0, sizeof(LIQUIFYVALUE));
+	if(!str)
+	{
+		value->type = LVT_NULL;
+		return;
+	}
+	value->type = LVT_STRING;
+	value->str = str;
+	value->len = strlen(str);
+}
+
+void
+liquify_value_bool(LIQUIFYVALUE *value, int b)
+{
+	memset(value, 0, sizeof(LIQUIFYVALUE));
+	value->type = (b ? LVT_TRUE : LVT_FALSE);
+}
+
+void
+liquify_value_integer(LIQUIFYVALUE *value, long long i)
+{
+	memset(value, 0, sizeof(LIQUIFYVALUE));
+	value->type = LVT_INTEGER;
+	value->integer = i;
+}
+
+void
+liquify_value_real(LIQUIFYVALUE *value, double d)
+{
+	memset(value, 0, sizeof(LIQUIFYVALUE));
+	value->type = LVT_REAL;
+	value->real = d;
+}
+
+void
+liquify_value_object(LIQUIFYVALUE *value, const LIQUIFYPROVIDER *provider, void *obj)
+{
+	memset(value, 0, sizeof(LIQUIFYVALUE));
+	value->type = LVT_OBJECT;
+	value->provider = provider;
+	value->obj = obj;
+}
+
+void
+liquify_value_list(LIQUIFYVALUE *value, const LIQUIFYPROVIDER *provider, void *obj)
+{
+	memset(value, 0, sizeof(LIQUIFYVALUE));
+	value->type = LVT_LIST;
+	value->provider = provider;
+	value->obj = obj;
+}
+
+/* Write a value to the current context */
+int
+liquify_emit_value(LIQUIFYCTX *ctx, const LIQUIFYVALUE *value)
+{
+	char buf[128];
+
+	switch(value->type)
+	{
+	case LVT_UNDEFINED:
+	case LVT_NULL:
+		return liquify_emit(ctx, "null", 4);
+	case LVT_TRUE:
+		return liquify_emit(ctx, "true", 4);
+	case LVT_FALSE:
+		return liquify_emit(ctx, "false", 5);
+	case LVT_INTEGER:
+		sprintf(buf, "%lld", value->integer);
+		return liquify_emit(ctx, buf, strlen(buf));
+	case LVT_REAL:
+		sprintf(buf, "%f", value->real);
+		return liquify_emit(ctx, buf, strlen(buf));
+	case LVT_STRING:
+		return liquify_emit(ctx, value->str, value->len);
+	case LVT_LIST:
+	case LVT_OBJECT:
+		if(value->provider->emit)
+		{
+			return value->provider->emit(ctx, value->obj);
+		}
+		break;
+	}
+	return 0;
+}
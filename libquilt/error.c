@@ -111,16 +111,23 @@ quilt_error(QUILTREQ *request, int code)
 	quilt_logf(LOG_ERR, "Status %d: %s\n", request->status, request->errordesc);
 	if(!request->serialized)
 	{
-		/* Express the error condition as RDF */
+		/* Express the error condition as RDF; any index of the model will
+		 * no longer reflect it
+		 */
+		if(request->modelindex)
+		{
+			quilt_index_destroy_(request->modelindex);
+			request->modelindex = NULL;
+		}
 		/*	bnode = librdf_new_node_from_blank_identifier(world, NULL); */
 		bnode = quilt_node_create_uri("#error");
 		
 		st = librdf_new_statement(world);
 		node = librdf_new_node_from_node(bnode);
 		librdf_statement_set_subject(st, node);
-		node = quilt_node_create_uri("http://www.w3.org/1999/02/22-rdf-syntax-ns#type");
+		node = librdf_new_node_from_node(quilt_node_intern("http://www.w3.org/1999/02/22-rdf-syntax-ns#type"));
 		librdf_statement_set_predicate(st, node);
-		node = quilt_node_create_uri("http://www.w3.org/2011/http#Response");
+		node = librdf_new_node_from_node(quilt_node_intern("http://www.w3.org/2011/http#Response"));
 		librdf_statement_set_object(st, node);
 		librdf_model_add_statement(request->model, st);
 		librdf_free_statement(st);
@@ -128,7 +135,7 @@ quilt_error(QUILTREQ *request, int code)
 		st = librdf_new_statement(world);
 		node = librdf_new_node_from_node(bnode);
 		librdf_statement_set_subject(st, node);
-		node = quilt_node_create_uri("http://purl.org/dc/terms/title");
+		node = librdf_new_node_from_node(quilt_node_intern("http://purl.org/dc/terms/title"));
 		librdf_statement_set_predicate(st, node);
 		node = quilt_node_create_literal(request->statustitle, "en");
 		librdf_statement_set_object(st, node);
@@ -138,7 +145,7 @@ quilt_error(QUILTREQ *request, int code)
 		st = librdf_new_statement(world);
 		node = librdf_new_node_from_node(bnode);
 		librdf_statement_set_subject(st, node);
-		node = quilt_node_create_uri("http://purl.org/dc/terms/description");
+		node = librdf_new_node_from_node(quilt_node_intern("http://purl.org/dc/terms/description"));
 		librdf_statement_set_predicate(st, node);
 		node = quilt_node_create_literal(request->errordesc, "en");
 		librdf_statement_set_object(st, node);
@@ -148,7 +155,7 @@ quilt_error(QUILTREQ *request, int code)
 		st = librdf_new_statement(world);
 		node = librdf_new_node_from_node(bnode);
 		librdf_statement_set_subject(st, node);
-		node = quilt_node_create_uri("http://www.w3.org/2011/http#statusCodeValue");
+		node = librdf_new_node_from_node(quilt_node_intern("http://www.w3.org/2011/http#statusCodeValue"));
 		librdf_statement_set_predicate(st, node);
 		node = quilt_node_create_int(request->status);
 		librdf_statement_set_object(st, node);
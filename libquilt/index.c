@@ -0,0 +1,475 @@
+/* Quilt: A Linked Open Data server
+ *
+ * Author: Mo McRoberts <mo.mcroberts@bbc.co.uk>
+ *
+ * Copyright (c) 2014-2017 BBC
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+/* A compact, read-only index of the triples in a request's model, for
+ * serializers which perform many lookups by subject and predicate.
+ *
+ * Each distinct term is held once, so that terms within an index can be
+ * compared by pointer. Triples are held in a single array sorted by
+ * subject, then predicate, then object (duplicates from different graphs
+ * are discarded); the triples for a subject form a contiguous run, found
+ * directly from the subject's term, and the run for a predicate within it
+ * is found by binary search.
+ *
+ * The index is built from the model the first time it is requested, and so
+ * reflects the model at that point.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include "p_libquilt.h"
+
+struct index_key_struct
+{
+	uint32_t s;
+	uint32_t p;
+	uint32_t o;
+};
+
+struct quilt_index_struct
+{
+	/* Distinct terms, and an open-addressed hash of them; slots hold the
+	 * term index plus one, or zero if empty
+	 */
+	librdf_node **terms;
+	size_t nterms, termsize;
+	uint32_t *slots;
+	size_t nslots;
+	/* The triples, sorted, and the predicate term index of each */
+	QUILTTRIPLE *triples;
+	uint32_t *preds;
+	size_t ntriples;
+	/* For each term, the first triple and number of triples of which it is
+	 * the subject
+	 */
+	size_t *first;
+	size_t *count;
+	/* Subjects, in the order in which they first appeared */
+	librdf_node **subjects;
+	size_t nsubjects;
+};
+
+static int quilt_index_build_(QUILTINDEX *index, librdf_model *model);
+static int quilt_index_term_(QUILTINDEX *index, librdf_node *node, uint32_t *id);
+static int quilt_index_rehash_(QUILTINDEX *index);
+static unsigned int quilt_index_hash_node_(librdf_node *node);
+static unsigned int quilt_index_hash_str_(unsigned int h, const char *str);
+static int quilt_index_lookup_node_(QUILTINDEX *index, librdf_node *node, uint32_t *id);
+static int quilt_index_lookup_uri_(QUILTINDEX *index, const char *uri, uint32_t *id);
+static int quilt_index_cmp_(const void *a, const void *b);
+
+/* Obtain the index of the request's model, building it if needed */
+QUILTINDEX *
+quilt_request_model_index(QUILTREQ *req)
+{
+	QUILTINDEX *index;
+
+	if(req->modelindex)
+	{
+		return req->modelindex;
+	}
+	index = (QUILTINDEX *) calloc(1, sizeof(QUILTINDEX));
+	if(!index)
+	{
+		quilt_logf(LOG_CRIT, "failed to allocate memory for model index\n");
+		return NULL;
+	}
+	if(quilt_index_build_(index, req->model))
+	{
+		quilt_index_destroy_(index);
+		return NULL;
+	}
+	req->modelindex = index;
+	return index;
+}
+
+/* Internal: free the resources used by an index */
+void
+quilt_index_destroy_(QUILTINDEX *index)
+{
+	size_t c;
+
+	for(c = 0; c < index->nterms; c++)
+	{
+		librdf_free_node(index->terms[c]);
+	}
+	free(index->terms);
+	free(index->slots);
+	free(index->triples);
+	free(index->preds);
+	free(index->first);
+	free(index->count);
+	free(index->subjects);
+	free(index);
+}
+
+/* Return the triples whose subject is the given node */
+const QUILTTRIPLE *
+quilt_index_subject(QUILTINDEX *index, librdf_node *subject, size_t *count)
+{
+	uint32_t s;
+
+	*count = 0;
+	if(quilt_index_lookup_node_(index, subject, &s) || !index->count[s])
+	{
+		return NULL;
+	}
+	*count = index->count[s];
+	return &(index->triples[index->first[s]]);
+}
+
+/* Return the triples whose subject is the given node and whose predicate is
+ * the given URI
+ */
+const QUILTTRIPLE *
+quilt_index_find(QUILTINDEX *index, librdf_node *subject, const char *predicate, size_t *count)
+{
+	uint32_t s, p;
+	size_t lo, hi, mid, start;
+
+	*count = 0;
+	if(quilt_index_lookup_node_(index, subject, &s) || !index->count[s] ||
+	   quilt_index_lookup_uri_(index, predicate, &p))
+	{
+		return NULL;
+	}
+	/* Find the first triple in the subject's run with the predicate */
+	lo = index->first[s];
+	hi = lo + index->count[s];
+	while(lo < hi)
+	{
+		mid = lo + (hi - lo) / 2;
+		if(index->preds[mid] < p)
+		{
+			lo = mid + 1;
+		}
+		else
+		{
+			hi = mid;
+		}
+	}
+	start = lo;
+	hi = index->first[s] + index->count[s];
+	while(lo < hi && index->preds[lo] == p)
+	{
+		lo++;
+	}
+	if(lo == start)
+	{
+		return NULL;
+	}
+	*count = lo - start;
+	return &(index->triples[start]);
+}
+
+/* Return the number of distinct subjects in the index */
+size_t
+quilt_index_nsubjects(QUILTINDEX *index)
+{
+	return index->nsubjects;
+}
+
+/* Return a subject by position, in the order in which the subjects first
+ * appeared in the model
+ */
+librdf_node *
+quilt_index_subject_at(QUILTINDEX *index, size_t n)
+{
+	if(n >= index->nsubjects)
+	{
+		return NULL;
+	}
+	return index->subjects[n];
+}
+
+static int
+quilt_index_build_(QUILTINDEX *index, librdf_model *model)
+{
+	librdf_stream *stream;
+	librdf_statement *st;
+	struct index_key_struct *keys, *p;
+	size_t nkeys, keysize, c, n;
+	int r;
+
+	stream = librdf_model_as_stream(model);
+	if(!stream)
+	{
+		quilt_logf(LOG_ERR, "failed to obtain stream from model for indexing\n");
+		return -1;
+	}
+	keys = NULL;
+	nkeys = 0;
+	keysize = 0;
+	r = 0;
+	for(; !librdf_stream_end(stream); librdf_stream_next(stream))
+	{
+		st = librdf_stream_get_object(stream);
+		if(nkeys + 1 > keysize)
+		{
+			keysize = (keysize ? keysize * 2 : 256);
+			p = (struct index_key_struct *) realloc(keys, keysize * sizeof(struct index_key_struct));
+			if(!p)
+			{
+				r = -1;
+				break;
+			}
+			keys = p;
+		}
+		if(quilt_index_term_(index, librdf_statement_get_subject(st), &(keys[nkeys].s)) ||
+		   quilt_index_term_(index, librdf_statement_get_predicate(st), &(keys[nkeys].p)) ||
+		   quilt_index_term_(index, librdf_statement_get_object(st), &(keys[nkeys].o)))
+		{
+			r = -1;
+			break;
+		}
+		nkeys++;
+	}
+	librdf_free_stream(stream);
+	if(!r && index->nterms)
+	{
+		index->first = (size_t *) calloc(index->nterms, sizeof(size_t));
+		index->count = (size_t *) calloc(index->nterms, sizeof(size_t));
+		index->subjects = (librdf_node **) calloc(index->nterms, sizeof(librdf_node *));
+		if(!index->first || !index->count || !index->subjects)
+		{
+			r = -1;
+		}
+	}
+	if(!r && nkeys)
+	{
+		/* Record the subjects in order of first appearance, before
+		 * sorting
+		 */
+		for(c = 0; c < nkeys; c++)
+		{
+			if(!index->count[keys[c].s])
+			{
+				index->count[keys[c].s] = 1;
+				index->subjects[index->nsubjects] = index->terms[keys[c].s];
+				index->nsubjects++;
+			}
+		}
+		qsort(keys, nkeys, sizeof(struct index_key_struct), quilt_index_cmp_);
+		index->triples = (QUILTTRIPLE *) calloc(nkeys, sizeof(QUILTTRIPLE));
+		index->preds = (uint32_t *) calloc(nkeys, sizeof(uint32_t));
+		if(!index->triples || !index->preds)
+		{
+			r = -1;
+		}
+	}
+	if(!r && nkeys)
+	{
+		memset(index->count, 0, index->nterms * sizeof(size_t));
+		for(c = 0, n = 0; c < nkeys; c++)
+		{
+			if(c && !quilt_index_cmp_(&(keys[c - 1]), &(keys[c])))
+			{
+				/* The same triple is present in more than one graph */
+				continue;
+			}
+			if(!index->count[keys[c].s])
+			{
+				index->first[keys[c].s] = n;
+			}
+			index->count[keys[c].s]++;
+			index->triples[n].subject = index->terms[keys[c].s];
+			index->triples[n].predicate = index->terms[keys[c].p];
+			index->triples[n].object = index->terms[keys[c].o];
+			index->preds[n] = keys[c].p;
+			n++;
+		}
+		index->ntriples = n;
+	}
+	free(keys);
+	if(r)
+	{
+		quilt_logf(LOG_CRIT, "failed to allocate memory for model index\n");
+		return -1;
+	}
+	quilt_logf(LOG_DEBUG, "indexed %lu triples (%lu subjects, %lu terms)\n", (unsigned long) index->ntriples, (unsigned long) index->nsubjects, (unsigned long) index->nterms);
+	return 0;
+}
+
+/* Obtain the index of a term, adding it if it is not already present */
+static int
+quilt_index_term_(QUILTINDEX *index, librdf_node *node, uint32_t *id)
+{
+	librdf_node **p;
+	size_t slot;
+
+	if(!quilt_index_lookup_node_(index, node, id))
+	{
+		return 0;
+	}
+	if(index->nterms + 1 > index->termsize)
+	{
+		index->termsize = (index->termsize ? index->termsize * 2 : 64);
+		p = (librdf_node **) realloc(index->terms, index->termsize * sizeof(librdf_node *));
+		if(!p)
+		{
+			return -1;
+		}
+		index->terms = p;
+	}
+	/* Keep the hash no more than half full */
+	if((index->nterms + 1) * 2 > index->nslots && quilt_index_rehash_(index))
+	{
+		return -1;
+	}
+	index->terms[index->nterms] = librdf_new_node_from_node(node);
+	if(!index->terms[index->nterms])
+	{
+		return -1;
+	}
+	for(slot = quilt_index_hash_node_(node) & (index->nslots - 1); index->slots[slot]; slot = (slot + 1) & (index->nslots - 1));
+	*id = (uint32_t) index->nterms;
+	index->nterms++;
+	index->slots[slot] = (uint32_t) index->nterms;
+	return 0;
+}
+
+static int
+quilt_index_rehash_(QUILTINDEX *index)
+{
+	uint32_t *slots;
+	size_t nslots, c, slot;
+
+	nslots = (index->nslots ? index->nslots * 2 : 128);
+	slots = (uint32_t *) calloc(nslots, sizeof(uint32_t));
+	if(!slots)
+	{
+		return -1;
+	}
+	for(c = 0; c < index->nterms; c++)
+	{
+		for(slot = quilt_index_hash_node_(index->terms[c]) & (nslots - 1); slots[slot]; slot = (slot + 1) & (nslots - 1));
+		slots[slot] = (uint32_t) c + 1;
+	}
+	free(index->slots);
+	index->slots = slots;
+	index->nslots = nslots;
+	return 0;
+}
+
+static unsigned int
+quilt_index_hash_node_(librdf_node *node)
+{
+	librdf_uri *dt;
+	const char *lang;
+	unsigned int h;
+
+	if(librdf_node_is_resource(node))
+	{
+		return quilt_index_hash_str_(5381, (const char *) librdf_uri_as_string(librdf_node_get_uri(node)));
+	}
+	if(librdf_node_is_blank(node))
+	{
+		return quilt_index_hash_str_(5381 * 33 + 'b', (const char *) librdf_node_get_blank_identifier(node));
+	}
+	h = quilt_index_hash_str_(5381 * 33 + 'l', (const char *) librdf_node_get_literal_value(node));
+	lang = librdf_node_get_literal_value_language(node);
+	if(lang)
+	{
+		h = quilt_index_hash_str_(h, lang);
+	}
+	dt = librdf_node_get_literal_value_datatype_uri(node);
+	if(dt)
+	{
+		h = quilt_index_hash_str_(h, (const char *) librdf_uri_as_string(dt));
+	}
+	return h;
+}
+
+static unsigned int
+quilt_index_hash_str_(unsigned int h, const char *str)
+{
+	const unsigned char *p;
+
+	for(p = (const unsigned char *) str; p && *p; p++)
+	{
+		h = ((h << 5) + h) + *p;
+	}
+	return h;
+}
+
+static int
+quilt_index_lookup_node_(QUILTINDEX *index, librdf_node *node, uint32_t *id)
+{
+	size_t slot;
+
+	if(!index->nslots || !node)
+	{
+		return -1;
+	}
+	for(slot = quilt_index_hash_node_(node) & (index->nslots - 1); index->slots[slot]; slot = (slot + 1) & (index->nslots - 1))
+	{
+		if(librdf_node_equals(index->terms[index->slots[slot] - 1], node))
+		{
+			*id = index->slots[slot] - 1;
+			return 0;
+		}
+	}
+	return -1;
+}
+
+static int
+quilt_index_lookup_uri_(QUILTINDEX *index, const char *uri, uint32_t *id)
+{
+	librdf_node *node;
+	size_t slot;
+
+	if(!index->nslots)
+	{
+		return -1;
+	}
+	for(slot = quilt_index_hash_str_(5381, uri) & (index->nslots - 1); index->slots[slot]; slot = (slot + 1) & (index->nslots - 1))
+	{
+		node = index->terms[index->slots[slot] - 1];
+		if(librdf_node_is_resource(node) && !strcmp((const char *) librdf_uri_as_string(librdf_node_get_uri(node)), uri))
+		{
+			*id = index->slots[slot] - 1;
+			return 0;
+		}
+	}
+	return -1;
+}
+
+static int
+quilt_index_cmp_(const void *a, const void *b)
+{
+	const struct index_key_struct *ka, *kb;
+
+	ka = (const struct index_key_struct *) a;
+	kb = (const struct index_key_struct *) b;
+	if(ka->s != kb->s)
+	{
+		return ka->s < kb->s ? -1 : 1;
+	}
+	if(ka->p != kb->p)
+	{
+		return ka->p < kb->p ? -1 : 1;
+	}
+	if(ka->o != kb->o)
+	{
+		return ka->o < kb->o ? -1 : 1;
+	}
+	return 0;
+}
@@ -0,0 +1,132 @@
+/* Quilt: A Linked Open Data server
+ *
+ * Author: Mo McRoberts <mo.mcroberts@bbc.co.uk>
+ *
+ * Copyright (c) 2014-2017 BBC
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+/* A registry of interned URIs and nodes, for the constant terms (such as
+ * rdf:type) which are used repeatedly while processing requests. Each is
+ * created on first use and kept for the lifetime of the process; callers
+ * receive a borrowed reference, which must not be freed, and which can be
+ * copied cheaply with librdf_new_node_from_node() or librdf_new_uri_from_uri()
+ * where ownership is required (for example, when adding it to a statement).
+ *
+ * Only constant URIs should be interned: entries are never discarded.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include "p_libquilt.h"
+
+#define INTERN_BUCKETS                  64
+
+struct intern_struct
+{
+	char *str;
+	librdf_uri *uri;
+	librdf_node *node;
+	struct intern_struct *next;
+};
+
+static struct intern_struct *buckets[INTERN_BUCKETS];
+
+static struct intern_struct *quilt_intern_(const char *uri);
+
+/* Return the interned node for a URI */
+librdf_node *
+quilt_node_intern(const char *uri)
+{
+	struct intern_struct *p;
+
+	p = quilt_intern_(uri);
+	if(!p)
+	{
+		return NULL;
+	}
+	return p->node;
+}
+
+/* Return the interned librdf URI for a string */
+librdf_uri *
+quilt_uri_intern(const char *uri)
+{
+	struct intern_struct *p;
+
+	p = quilt_intern_(uri);
+	if(!p)
+	{
+		return NULL;
+	}
+	return p->uri;
+}
+
+static struct intern_struct *
+quilt_intern_(const char *uri)
+{
+	struct intern_struct *p;
+	librdf_world *world;
+	const unsigned char *s;
+	unsigned int h;
+
+	for(h = 5381, s = (const unsigned char *) uri; *s; s++)
+	{
+		h = ((h << 5) + h) + *s;
+	}
+	h %= INTERN_BUCKETS;
+	for(p = buckets[h]; p; p = p->next)
+	{
+		if(!strcmp(p->str, uri))
+		{
+			return p;
+		}
+	}
+	world = quilt_librdf_world();
+	if(!world)
+	{
+		return NULL;
+	}
+	p = (struct intern_struct *) calloc(1, sizeof(struct intern_struct));
+	if(!p)
+	{
+		quilt_logf(LOG_CRIT, "failed to allocate memory for interned URI\n");
+		return NULL;
+	}
+	p->str = strdup(uri);
+	if(p->str)
+	{
+		p->uri = librdf_new_uri(world, (const unsigned char *) uri);
+	}
+	if(p->uri)
+	{
+		p->node = librdf_new_node_from_uri(world, p->uri);
+	}
+	if(!p->node)
+	{
+		quilt_logf(LOG_ERR, "failed to create interned node for <%s>\n", uri);
+		if(p->uri)
+		{
+			librdf_free_uri(p->uri);
+		}
+		free(p->str);
+		free(p);
+		return NULL;
+	}
+	p->next = buckets[h];
+	buckets[h] = p;
+	return p;
+}
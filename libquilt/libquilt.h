@@ -33,6 +33,8 @@ typedef struct quilt_impl_struct QUILTIMPL;
 typedef struct quilt_type_struct QUILTTYPE;
 typedef struct quilt_canonical_struct QUILTCANON;
 typedef struct quilt_bulk_struct QUILTBULK;
+typedef struct quilt_index_struct QUILTINDEX;
+typedef struct quilt_triple_struct QUILTTRIPLE;
 
 # ifndef QUILTIMPL_DATA_DEFINED
 typedef struct quilt_impldata_struct QUILTIMPLDATA;
@@ -89,6 +91,22 @@ struct quilt_request_struct
 	QUILTCANON *canonical;
 	/* The query parameters */
 	char *query;
+	/* The time (in milliseconds, see quilt_clock()) by which processing of
+	 * the request must be complete, or zero if there is no deadline
+	 */
+	unsigned long long deadline;
+	/* The index of the model, if one has been built (see
+	 * quilt_request_model_index())
+	 */
+	QUILTINDEX *modelindex;
+};
+
+/* A triple within a model index; the nodes belong to the index */
+struct quilt_triple_struct
+{
+	librdf_node *subject;
+	librdf_node *predicate;
+	librdf_node *object;
 };
 
 /* A typemap structure, filled in by a serialising plug-in for registration */
@@ -193,6 +211,7 @@ int quilt_request_vprintf(QUILTREQ *req, const char *format, va_list ap);
 int quilt_request_headers(QUILTREQ *req, const char *str);
 int quilt_request_headerf(QUILTREQ *req, const char *format, ...);
 char *quilt_request_base(void);
+char *quilt_request_subject_path(const char *path);
 int quilt_request_bulk_item(QUILTBULK *context, const char *uri);
 
 /* Request property accessors */
@@ -228,6 +247,10 @@ char *quilt_request_query(QUILTREQ *req);
 librdf_node *quilt_request_basegraph(QUILTREQ *req);
 librdf_storage *quilt_request_storage(QUILTREQ *req);
 librdf_model *quilt_request_model(QUILTREQ *req);
+unsigned long long quilt_request_deadline(QUILTREQ *req);
+int quilt_request_timedout(QUILTREQ *req);
+int quilt_request_unavailable(QUILTREQ *req);
+unsigned long long quilt_clock(void);
 
 /* Canonical URI handling */
 QUILTCANON *quilt_canon_create(QUILTCANON *source);
@@ -251,18 +274,33 @@ char *quilt_canon_str(QUILTCANON *canon, QUILTCANOPTS opts);
 /* SPARQL queries */
 SPARQL *quilt_sparql(void);
 int quilt_sparql_query_rdf(const char *query, librdf_model *model);
+int quilt_sparql_query_graph(const char *query, librdf_model *model);
+int quilt_sparql_query_graphs(const char *const *graphs, size_t count, librdf_model *model);
 
 /* URL-encoding */
 size_t quilt_urlencode_size(const char *src);
 size_t quilt_urlencode_lsize(const char *src, size_t srclen);
 int quilt_urlencode(const char *src, char *dest, size_t destlen);
+int quilt_urlencode_l(const char *src, size_t srclen, char *dest, size_t destlen);
 
 /* librdf interface */
 librdf_world *quilt_librdf_world(void);
 int quilt_model_parse(librdf_model *model, const char *mime, const char *buf, size_t buflen);
+int quilt_model_parse_base(librdf_model *model, const char *mime, const char *buf, size_t buflen, librdf_uri *base);
 char *quilt_model_serialize(librdf_model *model, const char *mime);
 int quilt_model_isempty(librdf_model *model);
 char *quilt_uri_contract(const char *uri);
+int quilt_uri_contract_buf(const char *uri, char *buf, size_t buflen);
+librdf_node *quilt_node_intern(const char *uri);
+librdf_uri *quilt_uri_intern(const char *uri);
+
+/* Model indexes */
+QUILTINDEX *quilt_request_model_index(QUILTREQ *req);
+const QUILTTRIPLE *quilt_index_subject(QUILTINDEX *index, librdf_node *subject, size_t *count);
+const QUILTTRIPLE *quilt_index_find(QUILTINDEX *index, librdf_node *subject, const char *predicate, size_t *count);
+size_t quilt_index_nsubjects(QUILTINDEX *index);
+librdf_node *quilt_index_subject_at(QUILTINDEX *index, size_t n);
+int quilt_ns_get_all(int (*fn)(const char *prefix, const char *uri, void *data), void *data);
 librdf_node *quilt_node_create_uri(const char *uri);
 librdf_node *quilt_node_create_literal(const char *value, const char *lang);
 librdf_node *quilt_node_create_int(int value);
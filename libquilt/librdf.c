@@ -55,13 +55,57 @@ static struct override_struct overrides[] = {
 	{ NULL, NULL, NULL, -1.0f, -1.0f, 0, NULL }
 };
 
+/* Serializers are created on first use for each syntax, with the configured
+ * namespaces already set, and re-used for subsequent requests
+ */
+struct serializer_struct
+{
+	char *key;
+	librdf_serializer *serializer;
+};
+
+/* Parsers are likewise created on first use for each syntax; the base URI
+ * is supplied each time a document is parsed
+ */
+struct parser_struct
+{
+	char *key;
+	librdf_parser *parser;
+};
+
 static librdf_world *quilt_world;
 static struct namespace_struct *namespaces;
 static size_t nscount;
+static struct serializer_struct *serializers;
+static size_t nserializers;
+static struct parser_struct *parsers;
+static size_t nparsers;
+
+/* The namespace URIs are compiled into a byte trie, so that the longest
+ * matching namespace can be found in a single pass over a URI. Nodes are
+ * held in a single array; node 0 is the root, and index 0 otherwise
+ * indicates the absence of a child or sibling.
+ */
+struct ns_trie_struct
+{
+	unsigned char ch;
+	/* The index of the namespace ending at this node, or -1 */
+	int ns;
+	size_t child;
+	size_t sibling;
+};
+
+static struct ns_trie_struct *nstrie;
+static size_t nstriecount, nstriesize;
 
 static int quilt_librdf_serialize_(QUILTREQ *request);
 static int quilt_librdf_logger_(void *data, librdf_log_message *message);
 static int quilt_ns_cb_(const char *key, const char *value, void *data);
+static librdf_serializer *quilt_librdf_serializer_(const char *name, const char *mime);
+static librdf_parser *quilt_librdf_parser_(const char *name, const char *mime);
+static int quilt_ns_trie_build_(void);
+static size_t quilt_ns_trie_add_(size_t parent, unsigned char ch);
+static int quilt_ns_match_(const char *uri);
 
 /* Initialise the librdf execution context, quilt_world */
 int
@@ -84,6 +128,10 @@ quilt_librdf_init_(void)
 		librdf_world_set_logger(quilt_world, NULL, quilt_librdf_logger_);
 		/* Obtain all of our namespaces from the configuration */
 		quilt_config_get_all("namespaces", NULL, quilt_ns_cb_, NULL);
+		if(quilt_ns_trie_build_())
+		{
+			return -1;
+		}
 		/* Register our MIME types for the built-in serializer */
 		for(c = 0; (desc = librdf_serializer_get_description(quilt_world, c)); c++)
 		{
@@ -180,9 +228,6 @@ int
 quilt_model_parse(librdf_model *model, const char *mime, const char *buf, size_t buflen)
 {	
 	static librdf_uri *base;
-	const char *name;
-	librdf_parser *parser;
-	int r;
 
 	if(quilt_librdf_init_())
 	{
@@ -197,6 +242,20 @@ quilt_model_parse(librdf_model *model, const char *mime, const char *buf, size_t
 			return -1;
 		}
 	}
+	return quilt_model_parse_base(model, mime, buf, buflen, base);
+}
+
+/* Parse a buffer into a model, resolving relative URIs against base */
+int
+quilt_model_parse_base(librdf_model *model, const char *mime, const char *buf, size_t buflen, librdf_uri *base)
+{
+	const char *name;
+	librdf_parser *parser;
+
+	if(quilt_librdf_init_())
+	{
+		return -1;
+	}
 	name = NULL;
 	/* Handle specific MIME types whether or not librdf already knows
 	 * about them
@@ -214,28 +273,63 @@ quilt_model_parse(librdf_model *model, const char *mime, const char *buf, size_t
 	{
 		mime = NULL;
 	}
-	parser = librdf_new_parser(quilt_world, name, mime, NULL);
+	parser = quilt_librdf_parser_(name, mime);
 	if(!parser)
 	{
-		if(!name)
+		return -1;
+	}
+	return librdf_parser_parse_counted_string_into_model(parser, (const unsigned char *) buf, buflen, base, model);
+}
+
+/* Obtain a parser for the given name or MIME type from the pool, creating
+ * it if needed
+ */
+static librdf_parser *
+quilt_librdf_parser_(const char *name, const char *mime)
+{
+	struct parser_struct *p;
+	librdf_parser *parser;
+	const char *key;
+	size_t c;
+
+	key = (name ? name : mime);
+	for(c = 0; c < nparsers; c++)
+	{
+		if(!strcmp(parsers[c].key, key))
 		{
-			name = "auto";
+			return parsers[c].parser;
 		}
-		quilt_logf(LOG_ERR, "failed to create a new parser for %s (%s)\n", mime, name);
-		return -1;
 	}
-	r = librdf_parser_parse_counted_string_into_model(parser, (const unsigned char *) buf, buflen, base, model);
-	librdf_free_parser(parser);
-	return r;
+	p = (struct parser_struct *) realloc(parsers, sizeof(struct parser_struct) * (nparsers + 1));
+	if(!p)
+	{
+		quilt_logf(LOG_CRIT, "failed to allocate memory for parser pool\n");
+		return NULL;
+	}
+	parsers = p;
+	parser = librdf_new_parser(quilt_world, name, mime, NULL);
+	if(!parser)
+	{
+		quilt_logf(LOG_ERR, "failed to create a new parser for %s (%s)\n", mime, (name ? name : "auto"));
+		return NULL;
+	}
+	parsers[nparsers].key = strdup(key);
+	if(!parsers[nparsers].key)
+	{
+		quilt_logf(LOG_CRIT, "failed to allocate memory for parser pool\n");
+		librdf_free_parser(parser);
+		return NULL;
+	}
+	parsers[nparsers].parser = parser;
+	nparsers++;
+	quilt_logf(LOG_DEBUG, "created new parser for %s\n", key);
+	return parser;
 }
 
 char *
 quilt_model_serialize(librdf_model *model, const char *mime)
 {
-	size_t c;
-	char *buf;
 	librdf_serializer *serializer;
-	librdf_uri *uri;
 	const char *name;
 
 	if(quilt_librdf_init_())
@@ -271,30 +365,70 @@ quilt_model_serialize(librdf_model *model, const char *mime)
 	{
 		mime = NULL;
 	}
-	serializer = librdf_new_serializer(quilt_world, name, mime, NULL);
+	serializer = quilt_librdf_serializer_(name, mime);
 	if(!serializer)
 	{
-		if(!name)
+		return NULL;
+	}
+	return (char *) librdf_serializer_serialize_model_to_string(serializer, NULL, model);
+}
+
+/* Obtain a serializer for the given name or MIME type from the pool,
+ * creating it if needed
+ */
+static librdf_serializer *
+quilt_librdf_serializer_(const char *name, const char *mime)
+{
+	struct serializer_struct *p;
+	librdf_serializer *serializer;
+	librdf_uri *uri;
+	const char *key;
+	size_t c;
+
+	key = (name ? name : mime);
+	for(c = 0; c < nserializers; c++)
+	{
+		if(!strcmp(serializers[c].key, key))
 		{
-			name = "auto";
+			return serializers[c].serializer;
 		}
-		quilt_logf(LOG_ERR, "failed to create a new serializer for %s (%s)\n", mime, name);
+	}
+	p = (struct serializer_struct *) realloc(serializers, sizeof(struct serializer_struct) * (nserializers + 1));
+	if(!p)
+	{
+		quilt_logf(LOG_CRIT, "failed to allocate memory for serializer pool\n");
 		return NULL;
 	}
-	for(c = 0; namespaces[c].prefix; c++)
+	serializers = p;
+	serializer = librdf_new_serializer(quilt_world, name, mime, NULL);
+	if(!serializer)
+	{
+		quilt_logf(LOG_ERR, "failed to create a new serializer for %s (%s)\n", mime, (name ? name : "auto"));
+		return NULL;
+	}
+	for(c = 0; namespaces && namespaces[c].prefix; c++)
 	{
 		uri = librdf_new_uri(quilt_world, (const unsigned char *) namespaces[c].uri);
 		if(!uri)
 		{
 			quilt_logf(LOG_ERR, "failed to create new URI from <%s>\n", namespaces[c].uri);
-			return 0;
+			librdf_free_serializer(serializer);
+			return NULL;
 		}
 		librdf_serializer_set_namespace(serializer, uri, namespaces[c].prefix);
 		librdf_free_uri(uri);
 	}
-	buf = (char *) librdf_serializer_serialize_model_to_string(serializer, NULL, model);
-	librdf_free_serializer(serializer);
-	return buf;
+	serializers[nserializers].key = strdup(key);
+	if(!serializers[nserializers].key)
+	{
+		quilt_logf(LOG_CRIT, "failed to allocate memory for serializer pool\n");
+		librdf_free_serializer(serializer);
+		return NULL;
+	}
+	serializers[nserializers].serializer = serializer;
+	nserializers++;
+	quilt_logf(LOG_DEBUG, "created new serializer for %s\n", key);
+	return serializer;
 }
 
 static int
@@ -356,36 +490,192 @@ char *
 quilt_uri_contract(const char *uri)
 {
 	char *p;
-	const char *prefix;
-	size_t len, c;
+	int ns;
 
-	len = 0;
-	prefix = NULL;
-	
-	for(c = 0; namespaces[c].prefix; c++)
+	ns = quilt_ns_match_(uri);
+	if(ns >= 0)
 	{
-		if(namespaces[c].len > len &&
-		   !strncmp(uri, namespaces[c].uri, namespaces[c].len))
-		{
-			prefix = namespaces[c].prefix;
-			len = namespaces[c].len;
-		}
-	}
-	if(prefix)
-	{
-		p = (char *) malloc(strlen(uri) + strlen(prefix) + 2);
+		p = (char *) malloc(strlen(uri) - namespaces[ns].len + strlen(namespaces[ns].prefix) + 2);
 		if(!p)
 		{
 			return NULL;
 		}
-		strcpy(p, prefix);
+		strcpy(p, namespaces[ns].prefix);
 		strcat(p, ":");
-		strcat(p, &(uri[len]));
+		strcat(p, &(uri[namespaces[ns].len]));
 		return p;
 	}		
 	return strdup(uri);
 }
 
+/* Attempt to contract a URI to prefix:suffix form, writing the result to
+ * buf; returns 1 if the URI was contracted, 0 if it was copied unchanged,
+ * or -1 if buf is too small
+ */
+int
+quilt_uri_contract_buf(const char *uri, char *buf, size_t buflen)
+{
+	size_t plen, len;
+	int ns;
+
+	ns = quilt_ns_match_(uri);
+	if(ns < 0)
+	{
+		len = strlen(uri);
+		if(len + 1 > buflen)
+		{
+			return -1;
+		}
+		memcpy(buf, uri, len + 1);
+		return 0;
+	}
+	plen = strlen(namespaces[ns].prefix);
+	len = strlen(&(uri[namespaces[ns].len]));
+	if(plen + 1 + len + 1 > buflen)
+	{
+		return -1;
+	}
+	memcpy(buf, namespaces[ns].prefix, plen);
+	buf[plen] = ':';
+	memcpy(&(buf[plen + 1]), &(uri[namespaces[ns].len]), len + 1);
+	return 1;
+}
+
+/* Return the index of the longest namespace which uri begins with, or -1;
+ * where several namespaces share a URI, the first defined is used
+ */
+static int
+quilt_ns_match_(const char *uri)
+{
+	const unsigned char *p;
+	size_t node;
+	int ns;
+
+	ns = -1;
+	if(!nstrie)
+	{
+		return -1;
+	}
+	node = 0;
+	for(p = (const unsigned char *) uri; *p; p++)
+	{
+		for(node = nstrie[node].child; node; node = nstrie[node].sibling)
+		{
+			if(nstrie[node].ch == *p)
+			{
+				break;
+			}
+		}
+		if(!node)
+		{
+			break;
+		}
+		if(nstrie[node].ns >= 0)
+		{
+			ns = nstrie[node].ns;
+		}
+	}
+	return ns;
+}
+
+/* Compile the configured namespace URIs into the trie */
+static int
+quilt_ns_trie_build_(void)
+{
+	const unsigned char *p;
+	size_t c, node;
+
+	nstrie = (struct ns_trie_struct *) calloc(1, sizeof(struct ns_trie_struct));
+	if(!nstrie)
+	{
+		quilt_logf(LOG_CRIT, "failed to allocate memory for namespace trie\n");
+		return -1;
+	}
+	nstrie[0].ns = -1;
+	nstriecount = 1;
+	nstriesize = 1;
+	for(c = 0; c < nscount; c++)
+	{
+		node = 0;
+		for(p = (const unsigned char *) namespaces[c].uri; *p; p++)
+		{
+			node = quilt_ns_trie_add_(node, *p);
+			if(!node)
+			{
+				quilt_logf(LOG_CRIT, "failed to allocate memory for namespace trie\n");
+				return -1;
+			}
+		}
+		if(node && nstrie[node].ns < 0)
+		{
+			nstrie[node].ns = (int) c;
+		}
+	}
+	quilt_logf(LOG_DEBUG, "compiled %lu namespaces into %lu trie nodes\n", (unsigned long) nscount, (unsigned long) nstriecount);
+	return 0;
+}
+
+/* Return the child of parent for ch, adding it if needed; returns 0 on
+ * allocation failure
+ */
+static size_t
+quilt_ns_trie_add_(size_t parent, unsigned char ch)
+{
+	struct ns_trie_struct *p;
+	size_t node;
+
+	for(node = nstrie[parent].child; node; node = nstrie[node].sibling)
+	{
+		if(nstrie[node].ch == ch)
+		{
+			return node;
+		}
+	}
+	if(nstriecount + 1 > nstriesize)
+	{
+		p = (struct ns_trie_struct *) realloc(nstrie, sizeof(struct ns_trie_struct) * (nstriesize * 2));
+		if(!p)
+		{
+			return 0;
+		}
+		nstrie = p;
+		nstriesize *= 2;
+	}
+	node = nstriecount;
+	nstriecount++;
+	nstrie[node].ch = ch;
+	nstrie[node].ns = -1;
+	nstrie[node].child = 0;
+	nstrie[node].sibling = nstrie[parent].child;
+	nstrie[parent].child = node;
+	return node;
+}
+
+/* Invoke fn for each of the configured namespaces, in the order they were
+ * defined; if fn returns non-zero, iteration stops and that value is
+ * returned
+ */
+int
+quilt_ns_get_all(int (*fn)(const char *prefix, const char *uri, void *data), void *data)
+{
+	size_t c;
+	int r;
+
+	if(quilt_librdf_init_())
+	{
+		return -1;
+	}
+	for(c = 0; c < nscount; c++)
+	{
+		r = fn(namespaces[c].prefix, namespaces[c].uri, data);
+		if(r)
+		{
+			return r;
+		}
+	}
+	return 0;
+}
+
 /* Log events from librdf */
 static int
 quilt_librdf_logger_(void *data, librdf_log_message *message)
@@ -468,14 +758,13 @@ quilt_node_create_int(int value)
 	{
 		return NULL;
 	}
-	uri = librdf_new_uri(quilt_world, (const unsigned char *) "http://www.w3.org/2001/XMLSchema#integer");
+	uri = quilt_uri_intern("http://www.w3.org/2001/XMLSchema#integer");
 	if(!uri)
 	{
 		quilt_logf(LOG_CRIT, "failed top create URI for xsd:integer\n");
 		return NULL;
 	}
 	node = librdf_new_node_from_typed_literal(quilt_world, (const unsigned char *) buf, NULL, uri);
-	librdf_free_uri(uri);
 	if(!node)
 	{
 		quilt_logf(LOG_CRIT, "failed to create node for literal value\n");
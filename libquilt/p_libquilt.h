@@ -47,6 +47,14 @@
 # define QUILT_MIME_LEN                 64
 # define DEFAULT_LIMIT                  25
 # define MAX_LIMIT                      100
+/* The default time allowed for processing a request, in milliseconds */
+# define DEFAULT_TIMEOUT                30000
+/* The default time allowed for connecting to the SPARQL endpoint */
+# define DEFAULT_CONNECT_TIMEOUT        5000
+
+/* Flags for quilt_sparql_stream_() */
+# define QUILT_SPARQL_GRAPH             (1<<0)
+# define QUILT_SPARQL_BUFFER            (1<<1)
 
 # ifndef HAVE_STRLCPY
 #  undef strlcpy
@@ -185,8 +193,22 @@ QUILTREQ *quilt_request_create_uri_(QUILTIMPL *impl, QUILTIMPLDATA *data, const
 /* librdf wrapper */
 int quilt_librdf_init_(void);
 
+/* Model indexes */
+void quilt_index_destroy_(QUILTINDEX *index);
+
 /* SPARQL interface */
 int quilt_sparql_init_(void);
+int quilt_sparql_stream_init_(void);
+int quilt_sparql_stream_(const char *endpoint, const char *query, size_t len, librdf_model *model, int flags);
+void quilt_sparql_set_deadline_(unsigned long long deadline);
+unsigned long long quilt_sparql_deadline_(void);
+int quilt_sparql_timedout_(void);
+void quilt_sparql_set_timedout_(void);
+int quilt_sparql_rejected_(void);
+int quilt_breaker_init_(void);
+int quilt_breaker_acquire_(void);
+void quilt_breaker_release_(unsigned long long elapsed, int failed);
+void quilt_breaker_cancel_(void);
 
 /* Plug-ins */
 int quilt_plugin_init_(void);
@@ -26,6 +26,7 @@
 static URI *quilt_base_uri;
 static QUILTCB *quilt_engine_cb;
 static QUILTCB *quilt_bulk_cb;
+static int quilt_timeout;
 
 static int quilt_request_process_path_(QUILTREQ *req, const char *uri);
 static const char *quilt_request_match_ext_(QUILTREQ *req);
@@ -72,7 +73,7 @@ quilt_request_init_(void)
 int
 quilt_request_sanity_(void)
 {
-	char *engine;
+	char *engine, *key;
 
 	engine = quilt_config_geta("quilt:engine", NULL);
 	if(!engine)
@@ -88,6 +89,20 @@ quilt_request_sanity_(void)
 		return -1;
 	}
 	quilt_bulk_cb = quilt_plugin_cb_find_name_(QCB_BULK, engine);	
+	/* The time allowed for an engine to process a request, in milliseconds,
+	 * may be specified for the engine itself, or in the [quilt] section
+	 */
+	quilt_timeout = quilt_config_get_int("quilt:timeout", DEFAULT_TIMEOUT);
+	key = (char *) malloc(strlen(engine) + 9);
+	if(!key)
+	{
+		quilt_logf(LOG_CRIT, "failed to allocate memory for configuration key\n");
+		free(engine);
+		return -1;
+	}
+	sprintf(key, "%s:timeout", engine);
+	quilt_timeout = quilt_config_get_int(key, quilt_timeout);
+	free(key);
 	free(engine);
 	return 0;
 }
@@ -141,6 +156,7 @@ quilt_request_create_uri_(QUILTIMPL *impl, QUILTIMPLDATA *data, const char *uri)
 		return p;
 	}
 
+	/* See also quilt_request_subject_path() */
 	p->uri = uri_create_str(p->path, quilt_base_uri);
 	if(!p->uri)
 	{
@@ -360,6 +376,26 @@ quilt_request_base(void)
 	return uri_stralloc(quilt_base_uri);
 }
 
+/* Return the subject URI of a request for path (in the form of the path
+ * of a processed request, such as "/" or "/things/1"), exactly as
+ * quilt_request_subject() would for that request
+ */
+char *
+quilt_request_subject_path(const char *path)
+{
+	URI *uri;
+	char *str;
+
+	uri = uri_create_str(path, quilt_base_uri);
+	if(!uri)
+	{
+		return NULL;
+	}
+	str = uri_stralloc(uri);
+	uri_destroy(uri);
+	return str;
+}
+
 /* SAPI: Free the resources used by a request */
 int
 quilt_request_free(QUILTREQ *req)
@@ -384,6 +420,10 @@ quilt_request_free(QUILTREQ *req)
 	{
 		quilt_canon_destroy(req->canonical);
 	}
+	if(req->modelindex)
+	{
+		quilt_index_destroy_(req->modelindex);
+	}
 	if(req->model)
 	{
 		librdf_free_model(req->model);
@@ -417,7 +457,13 @@ quilt_request_process(QUILTREQ *request)
 		return 500;
 	}
 	quilt_logf(LOG_DEBUG, "query subject URI is <%s>\n", request->subject);	
+	if(quilt_timeout > 0)
+	{
+		request->deadline = quilt_clock() + quilt_timeout;
+	}
+	quilt_sparql_set_deadline_(request->deadline);
 	r = quilt_plugin_invoke_engine_(quilt_engine_cb, request);
+	quilt_sparql_set_deadline_(0);
 	/* A zero return means the engine performed output itself; any other
 	 * status indicates that output should be generated. If the status is 200,
 	 * pass the request to the serializer.
@@ -680,6 +726,51 @@ quilt_request_subject(QUILTREQ *req)
 	return req->subject;
 }
 
+unsigned long long
+quilt_request_deadline(QUILTREQ *req)
+{
+	return req->deadline;
+}
+
+/* Returns nonzero if the request's deadline has passed, or if a SPARQL query
+ * performed on its behalf timed out; engines should return 504 in this case
+ */
+int
+quilt_request_timedout(QUILTREQ *req)
+{
+	if(quilt_sparql_timedout_())
+	{
+		return 1;
+	}
+	if(req->deadline && quilt_clock() >= req->deadline)
+	{
+		return 1;
+	}
+	return 0;
+}
+
+/* Returns nonzero if a SPARQL query performed on behalf of the request was
+ * refused because the endpoint is considered to be unavailable; engines
+ * should return 503 in this case
+ */
+int
+quilt_request_unavailable(QUILTREQ *req)
+{
+	(void) req;
+
+	return quilt_sparql_rejected_();
+}
+
+/* Return a monotonic timestamp, in milliseconds */
+unsigned long long
+quilt_clock(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((unsigned long long) ts.tv_sec * 1000) + (ts.tv_nsec / 1000000);
+}
+
 int
 quilt_request_home(QUILTREQ *req)
 {
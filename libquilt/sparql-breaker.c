@@ -0,0 +1,475 @@
+/* Quilt: A Linked Open Data server
+ *
+ * Author: Mo McRoberts <mo.mcroberts@bbc.co.uk>
+ *
+ * Copyright (c) 2014-2017 BBC
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+
+/* Protection for the SPARQL endpoint when it is degraded: a circuit breaker
+ * which stops queries from being issued for a cool-down period once the
+ * proportion of failed (or excessively slow) queries within a window exceeds
+ * a threshold, and an adaptive limit on the number of queries in flight,
+ * which grows by one with each timely success and halves with each failure.
+ *
+ * Because each quilt-fcgid process is independent, the state is only
+ * meaningful across the whole set of workers if sparql:breaker-state names
+ * a file which they can all map; otherwise, it is private to the process.
+ * The timestamps in the state are taken from the monotonic clock, which
+ * restarts when the system does, and so a state file is reset whenever it
+ * was written during a different boot.
+ *
+ * Each process holding an in-flight slot records its pid in a lease, so that
+ * the slots held by processes which exited mid-query can be reclaimed
+ * without disturbing those of processes which are still running.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include "p_libquilt.h"
+
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/file.h>
+
+#define BREAKER_BOOTID                  "/proc/sys/kernel/random/boot_id"
+#define BREAKER_BOOTIDLEN               40
+/* The number of leases; a slot acquired while every lease is taken can't be
+ * reclaimed if the process holding it exits mid-query
+ */
+#define BREAKER_LEASES                  256
+
+typedef enum
+{
+	BS_CLOSED = 0,
+	BS_OPEN,
+	BS_HALFOPEN
+} BREAKERSTATE;
+
+/* This structure may be shared between processes, and so is only ever
+ * modified using atomic operations; a newly-created state file is zero-filled,
+ * which is a valid initial state.
+ */
+struct quilt_breaker_struct
+{
+	volatile unsigned int state;
+	volatile unsigned long long opened;
+	volatile unsigned long long window;
+	volatile unsigned int requests;
+	volatile unsigned int failures;
+	volatile unsigned int inflight;
+	/* The current in-flight limit; zero means not yet initialised */
+	volatile unsigned int limit;
+	/* The identifier of the boot during which the state was written */
+	char boot[BREAKER_BOOTIDLEN];
+	/* The pids of the processes holding in-flight slots (zero if unused) */
+	volatile pid_t leases[BREAKER_LEASES];
+};
+
+static struct quilt_breaker_struct *breaker;
+static int enabled;
+static unsigned int threshold, volume, maxinflight;
+static unsigned long long windowlen, cooldown, slow;
+/* The index of the lease held by this process, or -1 */
+static int lease = -1;
+/* Set while this process is performing the trial query, which it began
+ * when the breaker's opened time was trialopened
+ */
+static int trial;
+static unsigned long long trialopened;
+
+static void quilt_breaker_boot_(char *buf, size_t len);
+static void quilt_breaker_window_(unsigned long long now);
+static void quilt_breaker_trip_(unsigned long long now);
+static void quilt_breaker_lease_(void);
+static void quilt_breaker_unlease_(void);
+static void quilt_breaker_reclaim_(void);
+static void quilt_breaker_dec_(void);
+static int quilt_breaker_trial_(void);
+
+/* Internal: initialise the circuit breaker */
+int
+quilt_breaker_init_(void)
+{
+	char *path, boot[BREAKER_BOOTIDLEN];
+	int fd;
+	void *p;
+
+	enabled = quilt_config_get_bool("sparql:breaker", 1);
+	if(!enabled)
+	{
+		return 0;
+	}
+	/* Open the breaker when at least breaker-threshold percent of at least
+	 * breaker-volume queries within breaker-window milliseconds fail or take
+	 * longer than sparql:slow milliseconds; allow a single trial query once
+	 * breaker-cooldown milliseconds have elapsed.
+	 */
+	threshold = quilt_config_get_int("sparql:breaker-threshold", 50);
+	volume = quilt_config_get_int("sparql:breaker-volume", 10);
+	windowlen = quilt_config_get_int("sparql:breaker-window", 10000);
+	cooldown = quilt_config_get_int("sparql:breaker-cooldown", 5000);
+	slow = quilt_config_get_int("sparql:slow", 5000);
+	maxinflight = quilt_config_get_int("sparql:max-inflight", 64);
+	if(maxinflight < 1)
+	{
+		maxinflight = 1;
+	}
+	path = quilt_config_geta("sparql:breaker-state", NULL);
+	if(path)
+	{
+		fd = open(path, O_RDWR|O_CREAT, 0600);
+		if(fd == -1)
+		{
+			quilt_logf(LOG_CRIT, "failed to open SPARQL breaker state file %s: %s\n", path, strerror(errno));
+			free(path);
+			return -1;
+		}
+		/* Hold an exclusive lock while the state is checked, so that
+		 * workers starting together don't reset it beneath one another
+		 */
+		flock(fd, LOCK_EX);
+		if(ftruncate(fd, sizeof(struct quilt_breaker_struct)))
+		{
+			quilt_logf(LOG_CRIT, "failed to resize SPARQL breaker state file %s: %s\n", path, strerror(errno));
+			close(fd);
+			free(path);
+			return -1;
+		}
+		p = mmap(NULL, sizeof(struct quilt_breaker_struct), PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+		if(p == MAP_FAILED)
+		{
+			quilt_logf(LOG_CRIT, "failed to map SPARQL breaker state file %s: %s\n", path, strerror(errno));
+			close(fd);
+			free(path);
+			return -1;
+		}
+		breaker = (struct quilt_breaker_struct *) p;
+		quilt_breaker_boot_(boot, sizeof(boot));
+		if(memcmp(breaker->boot, boot, sizeof(boot)))
+		{
+			quilt_logf(LOG_INFO, "resetting SPARQL breaker state in %s, which was written before the system was restarted\n", path);
+			memset(p, 0, sizeof(struct quilt_breaker_struct));
+			memcpy(breaker->boot, boot, sizeof(boot));
+		}
+		flock(fd, LOCK_UN);
+		close(fd);
+		free(path);
+	}
+	else
+	{
+		breaker = (struct quilt_breaker_struct *) calloc(1, sizeof(struct quilt_breaker_struct));
+		if(!breaker)
+		{
+			quilt_logf(LOG_CRIT, "failed to allocate memory for SPARQL breaker state\n");
+			return -1;
+		}
+	}
+	__sync_bool_compare_and_swap(&(breaker->limit), 0, maxinflight);
+	return 0;
+}
+
+/* Internal: obtain permission to issue a query; returns -1 with errno set to
+ * EAGAIN if the query should not be issued
+ */
+int
+quilt_breaker_acquire_(void)
+{
+	unsigned long long now;
+	unsigned int state;
+
+	if(!enabled || !breaker)
+	{
+		return 0;
+	}
+	now = quilt_clock();
+	quilt_breaker_window_(now);
+	if(breaker->opened > now)
+	{
+		/* The breaker was opened according to a clock which has since
+		 * been reset
+		 */
+		breaker->opened = 0;
+	}
+	state = breaker->state;
+	if(state == BS_OPEN || state == BS_HALFOPEN)
+	{
+		/* Once the cool-down period has elapsed, permit a single trial
+		 * query; if a trial query was begun but never completed (because
+		 * the process performing it exited), another is permitted after
+		 * a further cool-down period.
+		 */
+		if(now < breaker->opened + cooldown ||
+		   !__sync_bool_compare_and_swap(&(breaker->state), state, BS_HALFOPEN))
+		{
+			errno = EAGAIN;
+			return -1;
+		}
+		breaker->opened = now;
+		trial = 1;
+		trialopened = now;
+		quilt_logf(LOG_NOTICE, "SPARQL circuit breaker is half-open; issuing trial query\n");
+	}
+	if(__sync_add_and_fetch(&(breaker->inflight), 1) > breaker->limit)
+	{
+		quilt_breaker_dec_();
+		quilt_logf(LOG_WARNING, "SPARQL query rejected: %u queries already in flight\n", breaker->limit);
+		if(quilt_breaker_trial_())
+		{
+			__sync_bool_compare_and_swap(&(breaker->state), BS_HALFOPEN, BS_OPEN);
+		}
+		errno = EAGAIN;
+		return -1;
+	}
+	quilt_breaker_lease_();
+	return 0;
+}
+
+/* Internal: record the outcome of a query permitted by
+ * quilt_breaker_acquire_()
+ */
+void
+quilt_breaker_release_(unsigned long long elapsed, int failed)
+{
+	unsigned long long now;
+	unsigned int limit, newlimit, requests, failures;
+
+	if(!enabled || !breaker)
+	{
+		return;
+	}
+	now = quilt_clock();
+	if(slow && elapsed > slow)
+	{
+		quilt_logf(LOG_WARNING, "SPARQL query took %llums\n", elapsed);
+		failed = 1;
+	}
+	quilt_breaker_unlease_();
+	quilt_breaker_dec_();
+	/* Additive increase, multiplicative decrease */
+	do
+	{
+		limit = breaker->limit;
+		if(failed)
+		{
+			newlimit = limit / 2;
+			if(newlimit < 1)
+			{
+				newlimit = 1;
+			}
+		}
+		else
+		{
+			newlimit = limit < maxinflight ? limit + 1 : maxinflight;
+		}
+	}
+	while(newlimit != limit && !__sync_bool_compare_and_swap(&(breaker->limit), limit, newlimit));
+	if(quilt_breaker_trial_())
+	{
+		if(failed)
+		{
+			quilt_logf(LOG_ERR, "SPARQL trial query failed; circuit breaker remains open\n");
+			breaker->opened = now;
+			__sync_bool_compare_and_swap(&(breaker->state), BS_HALFOPEN, BS_OPEN);
+		}
+		else
+		{
+			quilt_logf(LOG_NOTICE, "SPARQL trial query succeeded; closing circuit breaker\n");
+			breaker->window = now;
+			breaker->requests = 0;
+			breaker->failures = 0;
+			__sync_bool_compare_and_swap(&(breaker->state), BS_HALFOPEN, BS_CLOSED);
+		}
+		return;
+	}
+	if(breaker->state == BS_HALFOPEN)
+	{
+		/* The query was begun before the trial, and so its outcome
+		 * doesn't decide whether the breaker closes
+		 */
+		return;
+	}
+	quilt_breaker_window_(now);
+	requests = __sync_add_and_fetch(&(breaker->requests), 1);
+	failures = failed ? __sync_add_and_fetch(&(breaker->failures), 1) : breaker->failures;
+	if(requests >= volume && failures * 100 >= threshold * requests)
+	{
+		quilt_breaker_trip_(now);
+	}
+}
+
+/* Internal: give up permission obtained by quilt_breaker_acquire_() for a
+ * query which was never issued, without recording an outcome
+ */
+void
+quilt_breaker_cancel_(void)
+{
+	unsigned long long now;
+
+	if(!enabled || !breaker)
+	{
+		return;
+	}
+	quilt_breaker_unlease_();
+	quilt_breaker_dec_();
+	if(quilt_breaker_trial_())
+	{
+		/* Allow another trial query straight away */
+		now = quilt_clock();
+		breaker->opened = (now > cooldown ? now - cooldown : 0);
+		__sync_bool_compare_and_swap(&(breaker->state), BS_HALFOPEN, BS_OPEN);
+	}
+}
+
+/* Begin a new measurement window if the current one has expired */
+static void
+quilt_breaker_window_(unsigned long long now)
+{
+	unsigned long long window;
+
+	window = breaker->window;
+	/* A window beginning in the future was begun according to a clock
+	 * which has since been reset, and so has expired
+	 */
+	if((window <= now && now < window + windowlen) || !__sync_bool_compare_and_swap(&(breaker->window), window, now))
+	{
+		return;
+	}
+	quilt_breaker_reclaim_();
+	breaker->requests = 0;
+	breaker->failures = 0;
+}
+
+/* Obtain an identifier for the current boot of the system; if none is
+ * available, the buffer is zero-filled and the state file is only reset
+ * when it is first created
+ */
+static void
+quilt_breaker_boot_(char *buf, size_t len)
+{
+	FILE *f;
+
+	memset(buf, 0, len);
+	f = fopen(BREAKER_BOOTID, "r");
+	if(!f)
+	{
+		return;
+	}
+	if(!fgets(buf, len, f))
+	{
+		memset(buf, 0, len);
+	}
+	fclose(f);
+}
+
+/* Record this process as the holder of an in-flight slot */
+static void
+quilt_breaker_lease_(void)
+{
+	pid_t pid;
+	int c;
+
+	pid = getpid();
+	for(c = 0; c < BREAKER_LEASES; c++)
+	{
+		if(!breaker->leases[c] && __sync_bool_compare_and_swap(&(breaker->leases[c]), 0, pid))
+		{
+			lease = c;
+			return;
+		}
+	}
+	lease = -1;
+}
+
+static void
+quilt_breaker_unlease_(void)
+{
+	if(lease >= 0)
+	{
+		__sync_bool_compare_and_swap(&(breaker->leases[lease]), getpid(), 0);
+		lease = -1;
+	}
+}
+
+/* Release the slots leased to processes which no longer exist, and which
+ * therefore exited mid-query; a live holder's slot is never released on its
+ * behalf, as it will release the slot itself
+ */
+static void
+quilt_breaker_reclaim_(void)
+{
+	pid_t pid;
+	int c;
+
+	for(c = 0; c < BREAKER_LEASES; c++)
+	{
+		pid = breaker->leases[c];
+		if(!pid || kill(pid, 0) == 0 || errno != ESRCH)
+		{
+			continue;
+		}
+		if(__sync_bool_compare_and_swap(&(breaker->leases[c]), pid, 0))
+		{
+			quilt_logf(LOG_NOTICE, "reclaiming SPARQL in-flight slot held by process %ld, which has exited\n", (long) pid);
+			quilt_breaker_dec_();
+		}
+	}
+}
+
+/* Decrement the number of queries in flight, without ever wrapping below
+ * zero
+ */
+static void
+quilt_breaker_dec_(void)
+{
+	unsigned int n;
+
+	do
+	{
+		n = breaker->inflight;
+		if(!n)
+		{
+			return;
+		}
+	}
+	while(!__sync_bool_compare_and_swap(&(breaker->inflight), n, n - 1));
+}
+
+/* If this process was performing the trial query, clear the flag and return
+ * nonzero if the breaker is still waiting on that trial
+ */
+static int
+quilt_breaker_trial_(void)
+{
+	if(!trial)
+	{
+		return 0;
+	}
+	trial = 0;
+	return (breaker->state == BS_HALFOPEN && breaker->opened == trialopened);
+}
+
+static void
+quilt_breaker_trip_(unsigned long long now)
+{
+	if(__sync_bool_compare_and_swap(&(breaker->state), BS_CLOSED, BS_OPEN))
+	{
+		breaker->opened = now;
+		quilt_logf(LOG_ERR, "SPARQL circuit breaker opened: %u of %u queries failed\n", breaker->failures, breaker->requests);
+	}
+}
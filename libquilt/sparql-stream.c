@@ -0,0 +1,928 @@
+/* Quilt: A Linked Open Data server
+ *
+ * Author: Mo McRoberts <mo.mcroberts@bbc.co.uk>
+ *
+ * Copyright (c) 2014-2017 BBC
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+/* Streaming SPARQL query support: rather than buffering an entire response
+ * before converting it into triples, the response body is handed to a
+ * parser as each chunk arrives from the network, and statements are added
+ * to the target model as soon as they have been decoded.
+ *
+ * Graph results (CONSTRUCT, DESCRIBE) are parsed by raptor; SELECT results
+ * in the SPARQL Query Results XML Format are parsed with a libxml2 SAX push
+ * parser, mapping ?s, ?p and ?o to triples and the optional ?g to the
+ * context, exactly as sparql_query_model() does.
+ *
+ * Queries flagged with QUILT_SPARQL_GRAPH are expected to yield a graph, and
+ * so only RDF serialisations are requested, preferring the line-based ones;
+ * if QUILT_SPARQL_BUFFER is also set, the body is collected in full and
+ * handed to quilt_model_parse() rather than being parsed incrementally.
+ * Relative URIs in graph results are resolved against the endpoint's URI.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include "p_libquilt.h"
+
+#include <libxml/parserInternals.h>
+
+#define SPARQL_ACCEPT                   "application/sparql-results+xml, application/n-quads, application/n-triples;q=0.9, text/turtle;q=0.8, application/rdf+xml;q=0.5"
+#define SPARQL_GRAPH_ACCEPT             "application/n-triples, application/n-quads;q=0.9, text/turtle;q=0.5"
+#define SPARQL_RESULTS_NS               "http://www.w3.org/2005/sparql-results#"
+
+typedef enum
+{
+	SS_NONE,
+	SS_RDF,
+	SS_RESULTS,
+	SS_BUFFER
+} SSMODE;
+
+/* Indices of the bindings which are mapped to a statement */
+typedef enum
+{
+	SB_S,
+	SB_P,
+	SB_O,
+	SB_G,
+	SB_COUNT,
+	SB_OTHER = SB_COUNT
+} SSBINDING;
+
+/* The kind of term currently being read from a SPARQL XML result */
+typedef enum
+{
+	ST_NONE,
+	ST_URI,
+	ST_LITERAL,
+	ST_BNODE
+} SSTERM;
+
+struct quilt_sparql_stream_struct
+{
+	librdf_world *world;
+	librdf_model *model;
+	CURL *ch;
+	const char *endpoint;
+	SSMODE mode;
+	int flags;
+	char type[QUILT_MIME_LEN];
+	int error;
+	size_t triples;
+	/* Graph results */
+	raptor_parser *rdf;
+	/* Buffered graph results */
+	char *buf;
+	size_t buflen;
+	size_t bufsize;
+	/* SPARQL XML results */
+	xmlParserCtxtPtr xml;
+	int inresult;
+	SSBINDING binding;
+	SSTERM term;
+	char *lang;
+	char *datatype;
+	char *text;
+	size_t textlen;
+	size_t textsize;
+	librdf_node *nodes[SB_COUNT];
+};
+
+typedef struct quilt_sparql_stream_struct QUILTSTREAM;
+
+static CURL *quilt_sparql_curl_;
+static long quilt_sparql_connect_timeout_;
+
+static size_t quilt_sparql_stream_header_(char *ptr, size_t size, size_t nmemb, void *userdata);
+static size_t quilt_sparql_stream_write_(char *ptr, size_t size, size_t nmemb, void *userdata);
+static int quilt_sparql_stream_begin_(QUILTSTREAM *stream);
+static int quilt_sparql_stream_append_(QUILTSTREAM *stream, const char *ptr, size_t len);
+static int quilt_sparql_stream_finish_(QUILTSTREAM *stream);
+static void quilt_sparql_stream_cleanup_(QUILTSTREAM *stream);
+static void quilt_sparql_stream_statement_(void *data, raptor_statement *statement);
+static librdf_node *quilt_sparql_stream_term_(QUILTSTREAM *stream, raptor_term *term);
+static int quilt_sparql_stream_add_(QUILTSTREAM *stream, librdf_node *subject, librdf_node *predicate, librdf_node *object, librdf_node *context);
+static void quilt_sparql_results_start_(void *ctx, const xmlChar *localname, const xmlChar *prefix, const xmlChar *uri, int nb_namespaces, const xmlChar **namespaces, int nb_attributes, int nb_defaulted, const xmlChar **attributes);
+static void quilt_sparql_results_end_(void *ctx, const xmlChar *localname, const xmlChar *prefix, const xmlChar *uri);
+static void quilt_sparql_results_chars_(void *ctx, const xmlChar *ch, int len);
+static char *quilt_sparql_results_attr_(int nb_attributes, const xmlChar **attributes, const char *name, const char *nsuri);
+static void quilt_sparql_results_reset_(QUILTSTREAM *stream);
+
+/* Internal: prepare the streaming transport */
+int
+quilt_sparql_stream_init_(void)
+{
+	if(quilt_sparql_curl_)
+	{
+		return 0;
+	}
+	curl_global_init(CURL_GLOBAL_ALL);
+	xmlInitParser();
+	/* The handle is retained between queries so that connections to the
+	 * endpoint can be re-used.
+	 */
+	quilt_sparql_curl_ = curl_easy_init();
+	if(!quilt_sparql_curl_)
+	{
+		quilt_logf(LOG_CRIT, "failed to create cURL handle for SPARQL queries\n");
+		return -1;
+	}
+	/* The time allowed for establishing a connection, in milliseconds */
+	quilt_sparql_connect_timeout_ = quilt_config_get_int("sparql:connect-timeout", DEFAULT_CONNECT_TIMEOUT);
+	return 0;
+}
+
+/* Internal: Perform a SPARQL query against the endpoint, parsing the response
+ * into the model incrementally as it is received. Returns 0 on success, 1 if
+ * it was not issued because the request's deadline had already passed, -2 if
+ * the endpoint failed (the connection failed or timed out, or it responded
+ * with a 5xx status), or -1 if the query failed for any other reason (such
+ * as a 4xx status, or a response which couldn't be parsed), which says
+ * nothing about the health of the endpoint.
+ */
+int
+quilt_sparql_stream_(const char *endpoint, const char *query, size_t len, librdf_model *model, int flags)
+{
+	QUILTSTREAM stream;
+	struct curl_slist *headers;
+	char *body;
+	size_t bodylen;
+	long status, timeout, connect;
+	unsigned long long deadline, now;
+	CURLcode e;
+	int r;
+
+	if(!endpoint)
+	{
+		quilt_logf(LOG_ERR, "no SPARQL query endpoint has been configured\n");
+		return -1;
+	}
+	if(quilt_sparql_stream_init_())
+	{
+		return -1;
+	}
+	/* Any deadline applies to the whole transfer, including connection */
+	timeout = 0;
+	connect = quilt_sparql_connect_timeout_;
+	deadline = quilt_sparql_deadline_();
+	if(deadline)
+	{
+		now = quilt_clock();
+		if(now >= deadline)
+		{
+			quilt_logf(LOG_ERR, "deadline passed before SPARQL query to <%s> could be performed\n", endpoint);
+			quilt_sparql_set_timedout_();
+			return 1;
+		}
+		timeout = (long) (deadline - now);
+		if(connect <= 0 || connect > timeout)
+		{
+			connect = timeout;
+		}
+	}
+	memset(&stream, 0, sizeof(QUILTSTREAM));
+	stream.world = quilt_librdf_world();
+	stream.model = model;
+	stream.ch = quilt_sparql_curl_;
+	stream.endpoint = endpoint;
+	stream.flags = flags;
+	if(!stream.world)
+	{
+		return -1;
+	}
+	/* "query=" + urlencoded query */
+	bodylen = 6 + quilt_urlencode_lsize(query, len);
+	body = (char *) malloc(bodylen);
+	if(!body)
+	{
+		quilt_logf(LOG_CRIT, "failed to allocate %u bytes for SPARQL request body\n", (unsigned) bodylen);
+		return -1;
+	}
+	strcpy(body, "query=");
+	quilt_urlencode_l(query, len, &(body[6]), bodylen - 6);
+	if(flags & QUILT_SPARQL_GRAPH)
+	{
+		headers = curl_slist_append(NULL, "Accept: " SPARQL_GRAPH_ACCEPT);
+	}
+	else
+	{
+		headers = curl_slist_append(NULL, "Accept: " SPARQL_ACCEPT);
+	}
+	/* Don't wait for a 100-continue response before sending large queries */
+	headers = curl_slist_append(headers, "Expect:");
+	curl_easy_reset(stream.ch);
+	curl_easy_setopt(stream.ch, CURLOPT_URL, endpoint);
+	curl_easy_setopt(stream.ch, CURLOPT_POST, 1L);
+	curl_easy_setopt(stream.ch, CURLOPT_POSTFIELDS, body);
+	curl_easy_setopt(stream.ch, CURLOPT_POSTFIELDSIZE, (long) strlen(body));
+	curl_easy_setopt(stream.ch, CURLOPT_HTTPHEADER, headers);
+	curl_easy_setopt(stream.ch, CURLOPT_ACCEPT_ENCODING, "");
+	curl_easy_setopt(stream.ch, CURLOPT_FOLLOWLOCATION, 1L);
+	curl_easy_setopt(stream.ch, CURLOPT_NOSIGNAL, 1L);
+	if(connect > 0)
+	{
+		curl_easy_setopt(stream.ch, CURLOPT_CONNECTTIMEOUT_MS, connect);
+	}
+	if(timeout > 0)
+	{
+		curl_easy_setopt(stream.ch, CURLOPT_TIMEOUT_MS, timeout);
+	}
+	curl_easy_setopt(stream.ch, CURLOPT_HEADERFUNCTION, quilt_sparql_stream_header_);
+	curl_easy_setopt(stream.ch, CURLOPT_HEADERDATA, &stream);
+	curl_easy_setopt(stream.ch, CURLOPT_WRITEFUNCTION, quilt_sparql_stream_write_);
+	curl_easy_setopt(stream.ch, CURLOPT_WRITEDATA, &stream);
+	e = curl_easy_perform(stream.ch);
+	status = 0;
+	curl_easy_getinfo(stream.ch, CURLINFO_RESPONSE_CODE, &status);
+	r = 0;
+	if(e == CURLE_OPERATION_TIMEDOUT)
+	{
+		quilt_logf(LOG_ERR, "SPARQL query to <%s> timed out\n", endpoint);
+		r = -2;
+	}
+	else if(e != CURLE_OK)
+	{
+		/* If the transfer was aborted because the response couldn't be
+		 * processed, the endpoint itself didn't fail
+		 */
+		if(stream.error)
+		{
+			r = -1;
+		}
+		else
+		{
+			quilt_logf(LOG_ERR, "SPARQL query to <%s> failed: %s\n", endpoint, curl_easy_strerror(e));
+			r = -2;
+		}
+	}
+	else if(status < 200 || status > 299)
+	{
+		quilt_logf(LOG_ERR, "SPARQL query to <%s> failed with HTTP status %ld\n", endpoint, status);
+		r = (status >= 500 ? -2 : -1);
+	}
+	else if(quilt_sparql_stream_finish_(&stream))
+	{
+		r = -1;
+	}
+	else if(stream.mode == SS_BUFFER)
+	{
+		quilt_logf(LOG_DEBUG, "parsed %lu bytes of SPARQL response (%s)\n", (unsigned long) stream.buflen, stream.type);
+	}
+	else
+	{
+		quilt_logf(LOG_DEBUG, "added %lu triples from SPARQL response (%s)\n", (unsigned long) stream.triples, stream.type);
+	}
+	quilt_sparql_stream_cleanup_(&stream);
+	curl_slist_free_all(headers);
+	free(body);
+	if(e == CURLE_OPERATION_TIMEDOUT)
+	{
+		quilt_sparql_set_timedout_();
+	}
+	return r;
+}
+
+/* cURL callback: record the Content-Type of the response */
+static size_t
+quilt_sparql_stream_header_(char *ptr, size_t size, size_t nmemb, void *userdata)
+{
+	QUILTSTREAM *stream;
+	size_t len, c;
+	const char *t;
+
+	stream = (QUILTSTREAM *) userdata;
+	len = size * nmemb;
+	if(len > 13 && !strncasecmp(ptr, "Content-Type:", 13))
+	{
+		t = ptr + 13;
+		len -= 13;
+		while(len && isspace((unsigned char) *t))
+		{
+			t++;
+			len--;
+		}
+		for(c = 0; c < len && c + 1 < sizeof(stream->type); c++)
+		{
+			if(t[c] == ';' || isspace((unsigned char) t[c]))
+			{
+				break;
+			}
+			stream->type[c] = tolower((unsigned char) t[c]);
+		}
+		stream->type[c] = 0;
+	}
+	return size * nmemb;
+}
+
+/* cURL callback: pass a chunk of the response body to the parser */
+static size_t
+quilt_sparql_stream_write_(char *ptr, size_t size, size_t nmemb, void *userdata)
+{
+	QUILTSTREAM *stream;
+	size_t len;
+	long status;
+
+	stream = (QUILTSTREAM *) userdata;
+	len = size * nmemb;
+	if(stream->mode == SS_NONE)
+	{
+		status = 0;
+		curl_easy_getinfo(stream->ch, CURLINFO_RESPONSE_CODE, &status);
+		if(status < 200 || status > 299)
+		{
+			/* Discard the body of an error response */
+			return len;
+		}
+		if(quilt_sparql_stream_begin_(stream))
+		{
+			stream->error = 1;
+			return 0;
+		}
+	}
+	if(stream->mode == SS_RDF)
+	{
+		if(raptor_parser_parse_chunk(stream->rdf, (const unsigned char *) ptr, len, 0))
+		{
+			quilt_logf(LOG_ERR, "failed to parse SPARQL response as %s\n", stream->type);
+			stream->error = 1;
+		}
+	}
+	else if(stream->mode == SS_RESULTS)
+	{
+		if(xmlParseChunk(stream->xml, ptr, (int) len, 0))
+		{
+			quilt_logf(LOG_ERR, "failed to parse SPARQL query results\n");
+			stream->error = 1;
+		}
+	}
+	else if(stream->mode == SS_BUFFER)
+	{
+		if(quilt_sparql_stream_append_(stream, ptr, len))
+		{
+			stream->error = 1;
+		}
+	}
+	if(stream->error)
+	{
+		/* Returning a short count aborts the transfer */
+		return 0;
+	}
+	return len;
+}
+
+/* Create a parser suitable for the media type of the response */
+static int
+quilt_sparql_stream_begin_(QUILTSTREAM *stream)
+{
+	static xmlSAXHandler sax;
+	const char *name;
+	raptor_uri *base;
+	int r;
+
+	if(stream->flags & QUILT_SPARQL_BUFFER)
+	{
+		if(!stream->type[0])
+		{
+			quilt_logf(LOG_ERR, "SPARQL endpoint did not indicate the media type of its response\n");
+			return -1;
+		}
+		stream->mode = SS_BUFFER;
+		return 0;
+	}
+	if(!strcmp(stream->type, "application/sparql-results+xml"))
+	{
+		if(!sax.initialized)
+		{
+			sax.initialized = XML_SAX2_MAGIC;
+			sax.startElementNs = quilt_sparql_results_start_;
+			sax.endElementNs = quilt_sparql_results_end_;
+			sax.characters = quilt_sparql_results_chars_;
+		}
+		stream->xml = xmlCreatePushParserCtxt(&sax, stream, NULL, 0, NULL);
+		if(!stream->xml)
+		{
+			quilt_logf(LOG_CRIT, "failed to create SPARQL results parser\n");
+			return -1;
+		}
+		stream->binding = SB_OTHER;
+		stream->mode = SS_RESULTS;
+		return 0;
+	}
+	if(!strcmp(stream->type, "application/n-quads") || !strcmp(stream->type, "text/x-nquads"))
+	{
+		name = "nquads";
+	}
+	else if(!strcmp(stream->type, "application/n-triples") || !strcmp(stream->type, "text/plain"))
+	{
+		name = "ntriples";
+	}
+	else if(!strcmp(stream->type, "text/turtle") || !strcmp(stream->type, "application/x-turtle"))
+	{
+		name = "turtle";
+	}
+	else if(!strcmp(stream->type, "application/trig"))
+	{
+		name = "trig";
+	}
+	else if(!strcmp(stream->type, "application/rdf+xml"))
+	{
+		name = "rdfxml";
+	}
+	else
+	{
+		quilt_logf(LOG_ERR, "SPARQL endpoint returned unsupported media type '%s'\n", stream->type);
+		return -1;
+	}
+	stream->rdf = raptor_new_parser(librdf_world_get_raptor(stream->world), name);
+	if(!stream->rdf)
+	{
+		quilt_logf(LOG_CRIT, "failed to create a new raptor parser for %s\n", name);
+		return -1;
+	}
+	raptor_parser_set_statement_handler(stream->rdf, stream, quilt_sparql_stream_statement_);
+	/* Parsers such as Turtle and RDF/XML cannot start without a base URI;
+	 * the parser keeps its own copy
+	 */
+	base = raptor_new_uri(librdf_world_get_raptor(stream->world), (const unsigned char *) stream->endpoint);
+	if(!base)
+	{
+		quilt_logf(LOG_CRIT, "failed to create base URI <%s>\n", stream->endpoint);
+		return -1;
+	}
+	r = raptor_parser_parse_start(stream->rdf, base);
+	raptor_free_uri(base);
+	if(r)
+	{
+		quilt_logf(LOG_ERR, "failed to begin parsing SPARQL response as %s\n", name);
+		return -1;
+	}
+	stream->mode = SS_RDF;
+	return 0;
+}
+
+/* Signal the end of the response to the parser */
+static int
+quilt_sparql_stream_finish_(QUILTSTREAM *stream)
+{
+	if(stream->error)
+	{
+		return -1;
+	}
+	switch(stream->mode)
+	{
+	case SS_NONE:
+		/* An empty response */
+		return 0;
+	case SS_RDF:
+		if(raptor_parser_parse_chunk(stream->rdf, NULL, 0, 1))
+		{
+			quilt_logf(LOG_ERR, "failed to parse SPARQL response as %s\n", stream->type);
+			return -1;
+		}
+		break;
+	case SS_RESULTS:
+		if(xmlParseChunk(stream->xml, NULL, 0, 1) || !stream->xml->wellFormed)
+		{
+			quilt_logf(LOG_ERR, "failed to parse SPARQL query results\n");
+			return -1;
+		}
+		break;
+	case SS_BUFFER:
+		if(!stream->buflen)
+		{
+			return 0;
+		}
+		if(quilt_model_parse(stream->model, stream->type, stream->buf, stream->buflen))
+		{
+			quilt_logf(LOG_ERR, "failed to parse SPARQL response as %s\n", stream->type);
+			return -1;
+		}
+		break;
+	}
+	return stream->error ? -1 : 0;
+}
+
+static void
+quilt_sparql_stream_cleanup_(QUILTSTREAM *stream)
+{
+	if(stream->rdf)
+	{
+		raptor_free_parser(stream->rdf);
+		stream->rdf = NULL;
+	}
+	if(stream->xml)
+	{
+		xmlFreeParserCtxt(stream->xml);
+		stream->xml = NULL;
+	}
+	quilt_sparql_results_reset_(stream);
+	free(stream->text);
+	stream->text = NULL;
+	free(stream->buf);
+	stream->buf = NULL;
+}
+
+/* Append a chunk of the response body to the buffer */
+static int
+quilt_sparql_stream_append_(QUILTSTREAM *stream, const char *ptr, size_t len)
+{
+	char *p;
+	size_t newsize;
+
+	if(stream->buflen + len > stream->bufsize)
+	{
+		newsize = stream->bufsize ? stream->bufsize : 16384;
+		while(newsize < stream->buflen + len)
+		{
+			newsize *= 2;
+		}
+		p = (char *) realloc(stream->buf, newsize);
+		if(!p)
+		{
+			quilt_logf(LOG_CRIT, "failed to allocate %u bytes for SPARQL response\n", (unsigned) newsize);
+			return -1;
+		}
+		stream->buf = p;
+		stream->bufsize = newsize;
+	}
+	memcpy(&(stream->buf[stream->buflen]), ptr, len);
+	stream->buflen += len;
+	return 0;
+}
+
+/* raptor callback: a statement has been parsed from a graph result */
+static void
+quilt_sparql_stream_statement_(void *data, raptor_statement *statement)
+{
+	QUILTSTREAM *stream;
+	librdf_node *subject, *predicate, *object, *context;
+
+	stream = (QUILTSTREAM *) data;
+	if(stream->error)
+	{
+		return;
+	}
+	subject = quilt_sparql_stream_term_(stream, statement->subject);
+	predicate = quilt_sparql_stream_term_(stream, statement->predicate);
+	object = quilt_sparql_stream_term_(stream, statement->object);
+	context = quilt_sparql_stream_term_(stream, statement->graph);
+	if(subject && predicate && object)
+	{
+		if(quilt_sparql_stream_add_(stream, subject, predicate, object, context))
+		{
+			stream->error = 1;
+		}
+		subject = predicate = object = NULL;
+	}
+	if(subject)
+	{
+		librdf_free_node(subject);
+	}
+	if(predicate)
+	{
+		librdf_free_node(predicate);
+	}
+	if(object)
+	{
+		librdf_free_node(object);
+	}
+	if(context)
+	{
+		librdf_free_node(context);
+	}
+}
+
+/* Convert a raptor term into a new librdf node */
+static librdf_node *
+quilt_sparql_stream_term_(QUILTSTREAM *stream, raptor_term *term)
+{
+	librdf_uri *dt;
+	librdf_node *node;
+
+	if(!term)
+	{
+		return NULL;
+	}
+	switch(term->type)
+	{
+	case RAPTOR_TERM_TYPE_URI:
+		return librdf_new_node_from_uri_string(stream->world, raptor_uri_as_string(term->value.uri));
+	case RAPTOR_TERM_TYPE_BLANK:
+		return librdf_new_node_from_counted_blank_identifier(stream->world, term->value.blank.string, term->value.blank.string_len);
+	case RAPTOR_TERM_TYPE_LITERAL:
+		dt = NULL;
+		if(term->value.literal.datatype)
+		{
+			dt = librdf_new_uri(stream->world, raptor_uri_as_string(term->value.literal.datatype));
+		}
+		node = librdf_new_node_from_typed_counted_literal(stream->world, term->value.literal.string, term->value.literal.string_len,
+			(const char *) term->value.literal.language, term->value.literal.language_len, dt);
+		if(dt)
+		{
+			librdf_free_uri(dt);
+		}
+		return node;
+	default:
+		break;
+	}
+	return NULL;
+}
+
+/* Add a statement to the target model; takes ownership of the nodes */
+static int
+quilt_sparql_stream_add_(QUILTSTREAM *stream, librdf_node *subject, librdf_node *predicate, librdf_node *object, librdf_node *context)
+{
+	librdf_statement *st;
+	int r;
+
+	st = librdf_new_statement_from_nodes(stream->world, subject, predicate, object);
+	if(!st)
+	{
+		quilt_logf(LOG_CRIT, "failed to create new RDF statement\n");
+		return -1;
+	}
+	if(context)
+	{
+		r = librdf_model_context_add_statement(stream->model, context, st);
+	}
+	else
+	{
+		r = librdf_model_add_statement(stream->model, st);
+	}
+	librdf_free_statement(st);
+	if(r)
+	{
+		quilt_logf(LOG_ERR, "failed to add statement to model\n");
+		return -1;
+	}
+	stream->triples++;
+	return 0;
+}
+
+/* SAX callback: start of an element within a SPARQL XML result document */
+static void
+quilt_sparql_results_start_(void *ctx, const xmlChar *localname, const xmlChar *prefix, const xmlChar *uri, int nb_namespaces, const xmlChar **namespaces, int nb_attributes, int nb_defaulted, const xmlChar **attributes)
+{
+	QUILTSTREAM *stream;
+	const char *name;
+	char *var;
+
+	(void) prefix;
+	(void) nb_namespaces;
+	(void) namespaces;
+	(void) nb_defaulted;
+
+	stream = (QUILTSTREAM *) ctx;
+	name = (const char *) localname;
+	if(!uri || strcmp((const char *) uri, SPARQL_RESULTS_NS))
+	{
+		return;
+	}
+	if(!strcmp(name, "result"))
+	{
+		quilt_sparql_results_reset_(stream);
+		stream->inresult = 1;
+		return;
+	}
+	if(!stream->inresult)
+	{
+		return;
+	}
+	if(!strcmp(name, "binding"))
+	{
+		stream->binding = SB_OTHER;
+		var = quilt_sparql_results_attr_(nb_attributes, attributes, "name", NULL);
+		if(var && !var[1])
+		{
+			switch(var[0])
+			{
+			case 's':
+				stream->binding = SB_S;
+				break;
+			case 'p':
+				stream->binding = SB_P;
+				break;
+			case 'o':
+				stream->binding = SB_O;
+				break;
+			case 'g':
+				stream->binding = SB_G;
+				break;
+			}
+		}
+		free(var);
+		return;
+	}
+	if(stream->binding == SB_OTHER)
+	{
+		return;
+	}
+	stream->textlen = 0;
+	if(stream->text)
+	{
+		/* An empty term has no character data */
+		stream->text[0] = 0;
+	}
+	if(!strcmp(name, "uri"))
+	{
+		stream->term = ST_URI;
+	}
+	else if(!strcmp(name, "bnode"))
+	{
+		stream->term = ST_BNODE;
+	}
+	else if(!strcmp(name, "literal"))
+	{
+		stream->term = ST_LITERAL;
+		free(stream->lang);
+		free(stream->datatype);
+		stream->lang = quilt_sparql_results_attr_(nb_attributes, attributes, "lang", (const char *) XML_XML_NAMESPACE);
+		stream->datatype = quilt_sparql_results_attr_(nb_attributes, attributes, "datatype", NULL);
+	}
+}
+
+/* SAX callback: end of an element within a SPARQL XML result document */
+static void
+quilt_sparql_results_end_(void *ctx, const xmlChar *localname, const xmlChar *prefix, const xmlChar *uri)
+{
+	QUILTSTREAM *stream;
+	const char *name, *text;
+	librdf_node *node;
+	librdf_uri *dt;
+
+	(void) prefix;
+
+	stream = (QUILTSTREAM *) ctx;
+	name = (const char *) localname;
+	if(!uri || strcmp((const char *) uri, SPARQL_RESULTS_NS) || !stream->inresult)
+	{
+		return;
+	}
+	if(!strcmp(name, "result"))
+	{
+		if(stream->nodes[SB_S] && stream->nodes[SB_P] && stream->nodes[SB_O] && !stream->error)
+		{
+			if(quilt_sparql_stream_add_(stream, stream->nodes[SB_S], stream->nodes[SB_P], stream->nodes[SB_O], stream->nodes[SB_G]))
+			{
+				stream->error = 1;
+				xmlStopParser(stream->xml);
+			}
+			/* The statement now owns the subject, predicate and object */
+			stream->nodes[SB_S] = stream->nodes[SB_P] = stream->nodes[SB_O] = NULL;
+		}
+		quilt_sparql_results_reset_(stream);
+		return;
+	}
+	if(!strcmp(name, "binding"))
+	{
+		stream->binding = SB_OTHER;
+		return;
+	}
+	if(stream->binding == SB_OTHER || stream->term == ST_NONE)
+	{
+		return;
+	}
+	text = stream->text ? stream->text : "";
+	node = NULL;
+	switch(stream->term)
+	{
+	case ST_URI:
+		node = librdf_new_node_from_uri_string(stream->world, (const unsigned char *) text);
+		break;
+	case ST_BNODE:
+		node = librdf_new_node_from_blank_identifier(stream->world, (const unsigned char *) text);
+		break;
+	case ST_LITERAL:
+		dt = NULL;
+		if(stream->datatype)
+		{
+			dt = librdf_new_uri(stream->world, (const unsigned char *) stream->datatype);
+		}
+		node = librdf_new_node_from_typed_counted_literal(stream->world, (const unsigned char *) text, stream->textlen,
+			stream->lang, stream->lang ? strlen(stream->lang) : 0, dt);
+		if(dt)
+		{
+			librdf_free_uri(dt);
+		}
+		break;
+	case ST_NONE:
+		break;
+	}
+	stream->term = ST_NONE;
+	if(!node)
+	{
+		quilt_logf(LOG_ERR, "failed to create node from SPARQL result binding\n");
+		return;
+	}
+	if(stream->nodes[stream->binding])
+	{
+		librdf_free_node(stream->nodes[stream->binding]);
+	}
+	stream->nodes[stream->binding] = node;
+}
+
+/* SAX callback: character data */
+static void
+quilt_sparql_results_chars_(void *ctx, const xmlChar *ch, int len)
+{
+	QUILTSTREAM *stream;
+	char *p;
+	size_t newsize;
+
+	stream = (QUILTSTREAM *) ctx;
+	if(stream->term == ST_NONE || len < 1)
+	{
+		return;
+	}
+	if(stream->textlen + len + 1 > stream->textsize)
+	{
+		newsize = ((stream->textlen + len + 1) | 127) + 1;
+		p = (char *) realloc(stream->text, newsize);
+		if(!p)
+		{
+			quilt_logf(LOG_CRIT, "failed to allocate %u bytes for SPARQL result value\n", (unsigned) newsize);
+			stream->error = 1;
+			xmlStopParser(stream->xml);
+			return;
+		}
+		stream->text = p;
+		stream->textsize = newsize;
+	}
+	memcpy(&(stream->text[stream->textlen]), ch, len);
+	stream->textlen += len;
+	stream->text[stream->textlen] = 0;
+}
+
+/* Obtain a copy of the value of a (namespaced) attribute passed to a SAX2
+ * start-element callback; attributes are passed as quintuples of
+ * localname, prefix, URI, value and end of value.
+ */
+static char *
+quilt_sparql_results_attr_(int nb_attributes, const xmlChar **attributes, const char *name, const char *nsuri)
+{
+	int c;
+	size_t len;
+	char *p;
+
+	for(c = 0; c < nb_attributes; c++, attributes += 5)
+	{
+		if(strcmp((const char *) attributes[0], name))
+		{
+			continue;
+		}
+		if(nsuri && (!attributes[2] || strcmp((const char *) attributes[2], nsuri)))
+		{
+			continue;
+		}
+		len = attributes[4] - attributes[3];
+		p = (char *) malloc(len + 1);
+		if(!p)
+		{
+			return NULL;
+		}
+		memcpy(p, attributes[3], len);
+		p[len] = 0;
+		return p;
+	}
+	return NULL;
+}
+
+/* Discard any bindings accumulated for the current result */
+static void
+quilt_sparql_results_reset_(QUILTSTREAM *stream)
+{
+	size_t c;
+
+	for(c = 0; c < SB_COUNT; c++)
+	{
+		if(stream->nodes[c])
+		{
+			librdf_free_node(stream->nodes[c]);
+			stream->nodes[c] = NULL;
+		}
+	}
+	free(stream->lang);
+	free(stream->datatype);
+	stream->lang = NULL;
+	stream->datatype = NULL;
+	stream->inresult = 0;
+	stream->binding = SB_OTHER;
+	stream->term = ST_NONE;
+	stream->textlen = 0;
+}
@@ -24,11 +24,20 @@
 #include "p_libquilt.h"
 
 static SPARQL *sparql;
+static char *endpoint;
+static int streaming;
+static size_t batchsize;
+static unsigned long long deadline;
+static int timedout;
+static int rejected;
+
+static int quilt_sparql_perform_(const char *query, librdf_model *model, int flags);
+static int quilt_sparql_query_batch_(const char *const *graphs, size_t count, librdf_model *model);
+static int quilt_sparql_iri_valid_(const char *iri);
 
 int
 quilt_sparql_init_(void)
 {
-	char *buf;
 	librdf_world *world;
 
 	world = quilt_librdf_world();
@@ -42,12 +51,31 @@ quilt_sparql_init_(void)
 		quilt_logf(LOG_CRIT, "failed to create SPARQL query object\n");
 		return -1;
 	}
-	buf = quilt_config_geta("sparql:query", NULL);
-	sparql_set_query_uri(sparql, buf);
-	free(buf);
+	endpoint = quilt_config_geta("sparql:query", NULL);
+	sparql_set_query_uri(sparql, endpoint);
 	sparql_set_world(sparql, world);
 	sparql_set_logger(sparql, quilt_vlogf);
 	sparql_set_verbose(sparql, quilt_config_get_int("sparql:verbose", 1));
+	/* Unless disabled, responses to queries performed via
+	 * quilt_sparql_query_rdf() are parsed as they are received
+	 */
+	streaming = quilt_config_get_bool("sparql:stream", 1);
+	/* The maximum number of graphs retrieved by a single query issued by
+	 * quilt_sparql_query_graphs()
+	 */
+	batchsize = quilt_config_get_int("sparql:batch", 32);
+	if(batchsize < 1)
+	{
+		batchsize = 1;
+	}
+	if(streaming && quilt_sparql_stream_init_())
+	{
+		return -1;
+	}
+	if(quilt_breaker_init_())
+	{
+		return -1;
+	}
 	return 0;
 }
 
@@ -58,14 +86,210 @@ quilt_sparql(void)
 }
 
 /* Perform a SPARQL query: the variables ?s, ?p, and ?o will be mapped to
- * triples, with the optional ?g being mapped to the context.
+ * triples, with the optional ?g being mapped to the context. If the query
+ * is a CONSTRUCT or DESCRIBE, the resulting graph is added to the model.
  */
 int
 quilt_sparql_query_rdf(const char *query, librdf_model *model)
 {
-	if(sparql_query_model(sparql, query, strlen(query), model))
+	return quilt_sparql_perform_(query, model, 0);
+}
+
+/* Perform a SPARQL CONSTRUCT or DESCRIBE query, requesting the resulting
+ * graph as N-Triples (or N-Quads) and adding it to the model. If streaming
+ * has been disabled, the response is parsed via quilt_model_parse() once it
+ * has been received in full.
+ */
+int
+quilt_sparql_query_graph(const char *query, librdf_model *model)
+{
+	return quilt_sparql_perform_(query, model, QUILT_SPARQL_GRAPH);
+}
+
+/* Issue a query, subject to the circuit breaker and in-flight limit; if the
+ * query is refused, errno is set to EAGAIN
+ */
+static int
+quilt_sparql_perform_(const char *query, librdf_model *model, int flags)
+{
+	unsigned long long start;
+	int r;
+
+	/* A query refused because the request has run out of time says
+	 * nothing about the health of the endpoint, and so must not be
+	 * recorded by the circuit breaker
+	 */
+	if(deadline && quilt_clock() >= deadline)
 	{
+		quilt_logf(LOG_ERR, "deadline passed before SPARQL query could be performed\n");
+		quilt_sparql_set_timedout_();
 		return -1;
 	}
+	if(quilt_breaker_acquire_())
+	{
+		quilt_logf(LOG_ERR, "SPARQL query was not performed because the endpoint is unavailable\n");
+		rejected = 1;
+		errno = EAGAIN;
+		return -1;
+	}
+	start = quilt_clock();
+	if(flags & QUILT_SPARQL_GRAPH)
+	{
+		r = quilt_sparql_stream_(endpoint, query, strlen(query), model, flags | (streaming ? 0 : QUILT_SPARQL_BUFFER));
+	}
+	else if(streaming)
+	{
+		r = quilt_sparql_stream_(endpoint, query, strlen(query), model, flags);
+	}
+	else
+	{
+		/* libsparqlclient doesn't report why a query failed, and so
+		 * every failure is attributed to the endpoint
+		 */
+		r = sparql_query_model(sparql, query, strlen(query), model) ? -2 : 0;
+	}
+	if(r > 0)
+	{
+		/* The deadline passed after permission was obtained */
+		quilt_breaker_cancel_();
+		return -1;
+	}
+	/* Only failures of the endpoint itself count towards opening the
+	 * breaker and reducing the in-flight limit; a query which the endpoint
+	 * rejected, or whose response couldn't be parsed, would fail however
+	 * healthy the endpoint was
+	 */
+	quilt_breaker_release_(quilt_clock() - start, (r == -2));
+	return (r ? -1 : 0);
+}
+
+/* Retrieve the contents of a set of named graphs, issuing a single query for
+ * each batch of (up to sparql:batch) graphs rather than one per graph. The
+ * triples from each graph are added to the model within a context named
+ * for that graph.
+ */
+int
+quilt_sparql_query_graphs(const char *const *graphs, size_t count, librdf_model *model)
+{
+	size_t c, n;
+
+	for(c = 0; c < count; c += n)
+	{
+		n = count - c;
+		if(n > batchsize)
+		{
+			n = batchsize;
+		}
+		if(quilt_sparql_query_batch_(&(graphs[c]), n, model))
+		{
+			return -1;
+		}
+	}
 	return 0;
 }
+
+static int
+quilt_sparql_query_batch_(const char *const *graphs, size_t count, librdf_model *model)
+{
+	static const char *prefix = "SELECT ?g ?s ?p ?o WHERE { VALUES ?g {";
+	static const char *suffix = " } GRAPH ?g { ?s ?p ?o } }";
+	char *query, *p;
+	size_t c, len;
+	int r;
+
+	len = strlen(prefix) + strlen(suffix) + 1;
+	for(c = 0; c < count; c++)
+	{
+		if(!quilt_sparql_iri_valid_(graphs[c]))
+		{
+			quilt_logf(LOG_ERR, "cannot query graph <%s>: not a valid IRI\n", graphs[c]);
+			return -1;
+		}
+		/* " <" + IRI + ">" */
+		len += strlen(graphs[c]) + 3;
+	}
+	query = (char *) malloc(len);
+	if(!query)
+	{
+		quilt_logf(LOG_CRIT, "failed to allocate %u bytes for SPARQL query\n", (unsigned) len);
+		return -1;
+	}
+	strcpy(query, prefix);
+	p = strchr(query, 0);
+	for(c = 0; c < count; c++)
+	{
+		*p = ' ';
+		p++;
+		*p = '<';
+		p++;
+		strcpy(p, graphs[c]);
+		p = strchr(p, 0);
+		*p = '>';
+		p++;
+	}
+	strcpy(p, suffix);
+	r = quilt_sparql_query_rdf(query, model);
+	free(query);
+	return r;
+}
+
+/* Determine whether an IRI can be safely written as an IRIREF within a
+ * query without escaping
+ */
+static int
+quilt_sparql_iri_valid_(const char *iri)
+{
+	const unsigned char *p;
+
+	if(!*iri)
+	{
+		return 0;
+	}
+	for(p = (const unsigned char *) iri; *p; p++)
+	{
+		if(*p <= 32 || strchr("<>\"{}|^`\\", *p))
+		{
+			return 0;
+		}
+	}
+	return 1;
+}
+
+/* Internal: set the time by which any queries performed must complete;
+ * invoked by quilt_request_process() before and after the engine is
+ * invoked.
+ */
+void
+quilt_sparql_set_deadline_(unsigned long long when)
+{
+	deadline = when;
+	timedout = 0;
+	rejected = 0;
+}
+
+unsigned long long
+quilt_sparql_deadline_(void)
+{
+	return deadline;
+}
+
+/* Internal: record that a query failed because it timed out */
+void
+quilt_sparql_set_timedout_(void)
+{
+	timedout = 1;
+	errno = ETIMEDOUT;
+}
+
+int
+quilt_sparql_timedout_(void)
+{
+	return timedout;
+}
+
+/* Internal: returns nonzero if a query was refused by the circuit breaker */
+int
+quilt_sparql_rejected_(void)
+{
+	return rejected;
+}
@@ -139,7 +139,7 @@ quilt_urlencode(const char *src, char *dest, size_t destlen)
 }
 
 int
-twine_urlencode_l(const char *src, size_t srclen, char *dest, size_t destlen)
+quilt_urlencode_l(const char *src, size_t srclen, char *dest, size_t destlen)
 {
 	static const char *xdigit = "0123456789abcdef";
 
@@ -23,7 +23,30 @@
 
 #include "p_html.h"
 
-struct class_struct html_classes[] = {
+/* Classes are resolved using a hash of their URIs, built by
+ * html_classes_init(). The table searched comprises any classes defined in
+ * the [html-classes] section of the configuration, in the order given,
+ * followed by the built-in classes below; where a subject has several
+ * recognised types, the one appearing earliest in the table is used.
+ */
+
+struct class_slot_struct
+{
+	librdf_uri *uri;
+	struct class_struct *cls;
+};
+
+struct class_struct *html_classes;
+size_t html_nclasses;
+
+static struct class_slot_struct *slots;
+static size_t nslots;
+
+static int html_classes_config_cb_(const char *key, const char *value, void *data);
+static int html_classes_add_(const char *uri, const char *cssClass, const char *label, const char *suffix, const char *definite);
+static unsigned int html_classes_hash_(const char *str);
+
+static struct class_struct builtin_classes[] = {
 	{
 		"http://xmlns.com/foaf/0.1/Person",
 		"person",
@@ -110,51 +133,193 @@ struct class_struct html_classes[] = {
 	}
 };
 
-struct class_struct *
-html_class_match(librdf_model *model, librdf_node *subject)
-{   
-	size_t c, score;
-	librdf_world *world;
-	librdf_stream *st;
-	librdf_statement *query, *statement;
-	librdf_node *obj;
+/* Compile the class table */
+int
+html_classes_init(void)
+{
+	size_t c, slot;
 	const char *uri;
-	struct class_struct *match;
-
-	match = NULL;
-	score = 100;
-	world = quilt_librdf_world();	
-	query = librdf_new_statement(world);
-	librdf_statement_set_subject(query, librdf_new_node_from_node(subject));
-	obj = librdf_new_node_from_uri_string(world, (const unsigned char *) "http://www.w3.org/1999/02/22-rdf-syntax-ns#type");
-	librdf_statement_set_predicate(query, obj);
-	st = librdf_model_find_statements(model, query);
-	while(!librdf_stream_end(st))
-	{
-		statement = librdf_stream_get_object(st);
-		obj = librdf_statement_get_object(statement);
-		if(librdf_node_is_resource(obj))
+
+	if(quilt_config_get_all("html-classes", NULL, html_classes_config_cb_, NULL) < 0)
+	{
+		return -1;
+	}
+	for(c = 0; builtin_classes[c].uri; c++)
+	{
+		if(html_classes_add_(builtin_classes[c].uri, builtin_classes[c].cssClass, builtin_classes[c].label, builtin_classes[c].suffix, builtin_classes[c].definite))
+		{
+			return -1;
+		}
+	}
+	/* Keep the hash no more than half full */
+	for(nslots = 16; nslots < html_nclasses * 2; nslots *= 2);
+	slots = (struct class_slot_struct *) calloc(nslots, sizeof(struct class_slot_struct));
+	if(!slots)
+	{
+		quilt_logf(LOG_CRIT, QUILT_PLUGIN_NAME ": failed to allocate memory for class table\n");
+		return -1;
+	}
+	for(c = 0; c < html_nclasses; c++)
+	{
+		uri = html_classes[c].uri;
+		for(slot = html_classes_hash_(uri) & (nslots - 1); slots[slot].cls; slot = (slot + 1) & (nslots - 1))
 		{
-			uri = (const char *) librdf_uri_as_string(librdf_node_get_uri(obj));
-			if(uri)
+			if(!strcmp(slots[slot].cls->uri, uri))
 			{
-				for(c = 0; html_classes[c].uri; c++)
-				{
-					if(c > score)
-					{
-						break;
-					}
-					if(!strcmp(html_classes[c].uri, uri))
-					{
-						match = &(html_classes[c]);
-						score = c;
-					}
-				}
+				break;
 			}
 		}
-		librdf_stream_next(st);
+		if(slots[slot].cls)
+		{
+			/* An earlier definition takes precedence */
+			continue;
+		}
+		slots[slot].uri = quilt_uri_intern(uri);
+		if(!slots[slot].uri)
+		{
+			return -1;
+		}
+		slots[slot].cls = &(html_classes[c]);
+	}
+	quilt_logf(LOG_DEBUG, QUILT_PLUGIN_NAME ": %lu classes defined\n", (unsigned long) html_nclasses);
+	return 0;
+}
+
+/* Find the known class, if any, corresponding to an rdf:type object */
+struct class_struct *
+html_class_match(librdf_node *type)
+{   
+	librdf_uri *uri;
+	const char *str;
+	size_t slot;
+
+	if(!slots || !librdf_node_is_resource(type))
+	{
+		return NULL;
+	}
+	uri = librdf_node_get_uri(type);
+	str = (const char *) librdf_uri_as_string(uri);
+	if(!str)
+	{
+		return NULL;
+	}
+	for(slot = html_classes_hash_(str) & (nslots - 1); slots[slot].cls; slot = (slot + 1) & (nslots - 1))
+	{
+		/* URIs are ordinarily interned by librdf, so the class's interned
+		 * URI will usually be the same object as the node's
+		 */
+		if(slots[slot].uri == uri || !strcmp(slots[slot].cls->uri, str))
+		{
+			return slots[slot].cls;
+		}
+	}
+	return NULL;
+}
+
+/* Add a class from the configuration, specified in the form:
+ *
+ *   css-class=<class-uri> Label|definite description
+ *
+ * If the definite description is omitted, the label is used in its place
+ */
+static int
+html_classes_config_cb_(const char *key, const char *value, void *data)
+{
+	const char *prefix = "html-classes:";
+	char *buf, *label, *definite, *suffix;
+	size_t l;
+	int r;
+
+	(void) data;
+
+	l = strlen(prefix);
+	if(strncmp(key, prefix, l))
+	{
+		return 0;
+	}
+	key += l;
+	buf = strdup(value);
+	if(!buf)
+	{
+		quilt_logf(LOG_CRIT, QUILT_PLUGIN_NAME ": failed to allocate memory for class definition\n");
+		return -1;
+	}
+	for(label = buf; *label && !isspace((unsigned char) *label); label++);
+	if(*label)
+	{
+		*label = 0;
+		label++;
+	}
+	while(isspace((unsigned char) *label))
+	{
+		label++;
+	}
+	if(!buf[0] || !*label)
+	{
+		quilt_logf(LOG_ERR, QUILT_PLUGIN_NAME ": ignoring incomplete definition of class '%s' (expected '<class-uri> Label|definite description')\n", key);
+		free(buf);
+		return 0;
+	}
+	definite = strchr(label, '|');
+	if(definite)
+	{
+		*definite = 0;
+		definite++;
+	}
+	else
+	{
+		definite = label;
+	}
+	suffix = (char *) malloc(strlen(label) + 3);
+	if(!suffix)
+	{
+		quilt_logf(LOG_CRIT, QUILT_PLUGIN_NAME ": failed to allocate memory for class definition\n");
+		free(buf);
+		return -1;
+	}
+	sprintf(suffix, "(%s)", label);
+	r = html_classes_add_(buf, key, label, suffix, definite);
+	free(suffix);
+	free(buf);
+	return r;
+}
+
+static int
+html_classes_add_(const char *uri, const char *cssClass, const char *label, const char *suffix, const char *definite)
+{
+	struct class_struct *p, *c;
+
+	p = (struct class_struct *) realloc(html_classes, sizeof(struct class_struct) * (html_nclasses + 1));
+	if(!p)
+	{
+		quilt_logf(LOG_CRIT, QUILT_PLUGIN_NAME ": failed to allocate memory for class table\n");
+		return -1;
+	}
+	html_classes = p;
+	c = &(html_classes[html_nclasses]);
+	c->uri = strdup(uri);
+	c->cssClass = strdup(cssClass);
+	c->label = strdup(label);
+	c->suffix = strdup(suffix);
+	c->definite = strdup(definite);
+	if(!c->uri || !c->cssClass || !c->label || !c->suffix || !c->definite)
+	{
+		quilt_logf(LOG_CRIT, QUILT_PLUGIN_NAME ": failed to allocate memory for class table\n");
+		return -1;
+	}
+	html_nclasses++;
+	return 0;
+}
+
+static unsigned int
+html_classes_hash_(const char *str)
+{
+	const unsigned char *p;
+	unsigned int h;
+
+	for(h = 5381, p = (const unsigned char *) str; *p; p++)
+	{
+		h = ((h << 5) + h) + *p;
 	}
-	librdf_free_stream(st);
-	librdf_free_statement(query);
-	return match;
+	return h;
 }
@@ -27,6 +27,7 @@ char *html_baseuri;
 size_t html_baseurilen;
 
 static int html_serialize(QUILTREQ *req);
+static int html_write_(const char *buf, size_t len, void *data);
 
 /* Quilt plug-in entry-point */
 int
@@ -41,7 +42,7 @@ quilt_plugin_init(void)
 		return -1;
 	}
 	html_baseurilen = strlen(html_baseuri);
-	if(html_template_init())
+	if(html_classes_init() || html_template_init())
 	{
 		free(html_baseuri);
 		html_baseuri = NULL;
@@ -59,8 +60,9 @@ html_serialize(QUILTREQ *req)
 {
 	QUILTCANON *canon;
 	LIQUIFYTPL *tpl;
+	HTMLMODEL *model;
 	json_t *dict;
-	char *buf, *loc;
+	char *loc;
 	int status;
 
 	status = 500;
@@ -68,13 +70,12 @@ html_serialize(QUILTREQ *req)
 	dict = json_object();
 	html_add_common(dict, req);
 	html_add_request(dict, req);
-	html_add_model(dict, req);
+	model = html_model_create(req, dict);
 	tpl = html_template(req);
-	if(tpl)
+	if(model && tpl)
 	{
 		/* Set status to zero to suppress output */
 		status = 0;
-		buf = liquify_apply(tpl, dict);
 		loc = quilt_canon_str(canon, QCO_CONCRETE|QCO_NOABSOLUTE);
 		quilt_request_headerf(req, "Status: %d %s\n", quilt_request_status(req), quilt_request_statustitle(req));
 		quilt_request_headerf(req, "Content-Type: %s; charset=utf-8\n", quilt_request_type(req));
@@ -82,9 +83,26 @@ html_serialize(QUILTREQ *req)
 		quilt_request_headers(req, "Vary: Accept\n");
 		quilt_request_headers(req, "Server: " PACKAGE_SIGNATURE "\n");
 		free(loc);
-		quilt_request_puts(req, buf);
-		free(buf);
+		/* The page is written to the request as it is generated */
+		if(liquify_apply_stream(tpl, &html_model_provider, model, html_write_, req))
+		{
+			quilt_logf(LOG_ERR, QUILT_PLUGIN_NAME ": failed to write HTML response\n");
+		}
+	}
+	if(model)
+	{
+		html_model_destroy(model);
 	}
 	json_decref(dict);
 	return status;
 }
+
+static int
+html_write_(const char *buf, size_t len, void *data)
+{
+	if(quilt_request_put((QUILTREQ *) data, (const unsigned char *) buf, len) < 0)
+	{
+		return -1;
+	}
+	return 0;
+}
@@ -0,0 +1,248 @@
+/* Quilt: A Linked Open Data server
+ *
+ * Native JSON-LD serializer
+ *
+ * The model is written in compacted form: a @context is generated from the
+ * configured namespaces, and each subject becomes a node object within
+ * @graph. Statements are sorted (see sort.c) and written directly to the
+ * response, so no JSON document tree is constructed.
+ *
+ * Author: Mo McRoberts <mo.mcroberts@bbc.co.uk>
+ *
+ * Copyright (c) 2017 BBC
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include "p_rdf.h"
+
+struct jsonld_context_struct
+{
+	RDFWRITER *writer;
+	int count;
+};
+
+static int jsonld_serialize(QUILTREQ *req);
+static int jsonld_context_cb_(const char *prefix, const char *uri, void *data);
+static int jsonld_write_string_(RDFWRITER *writer, const char *str, size_t len);
+static int jsonld_write_id_(RDFWRITER *writer, librdf_node *node);
+static int jsonld_write_uri_(RDFWRITER *writer, librdf_uri *uri);
+static int jsonld_write_object_(RDFWRITER *writer, librdf_node *node);
+
+static QUILTTYPE jsonld_type = { "application/ld+json", "jsonld", "JSON-LD", 0.8f, 1, NULL };
+
+int
+jsonld_init(void)
+{
+	return quilt_plugin_register_serializer(&jsonld_type, jsonld_serialize);
+}
+
+static int
+jsonld_serialize(QUILTREQ *req)
+{
+	struct jsonld_context_struct ctx;
+	RDFWRITER writer;
+	librdf_statement **list, *st;
+	librdf_node *subject, *predicate;
+	size_t count, c, next;
+	int newsubj, multiple, istype;
+
+	if(rdf_sort_model(quilt_request_model(req), &list, &count))
+	{
+		return 500;
+	}
+	rdf_writer_init(&writer, req);
+	rdf_writer_headers(&writer, jsonld_type.mimetype);
+	rdf_writer_puts(&writer, "{\n\t\"@context\": {");
+	ctx.writer = &writer;
+	ctx.count = 0;
+	quilt_ns_get_all(jsonld_context_cb_, &ctx);
+	rdf_writer_puts(&writer, "\n\t},\n\t\"@graph\": [");
+	for(c = 0; c < count && !writer.error; c = next)
+	{
+		st = list[c];
+		subject = librdf_statement_get_subject(st);
+		predicate = librdf_statement_get_predicate(st);
+		newsubj = (!c || rdf_node_cmp(librdf_statement_get_subject(list[c - 1]), subject));
+		if(newsubj)
+		{
+			rdf_writer_puts(&writer, (c ? "\n\t\t},\n\t\t{\n\t\t\t\"@id\": " : "\n\t\t{\n\t\t\t\"@id\": "));
+			jsonld_write_id_(&writer, subject);
+		}
+		/* Only resources and blank nodes can be written as @type: a literal
+		 * rdf:type is written as an ordinary property. Literals sort after
+		 * other nodes, and so form a run of their own.
+		 */
+		istype = rdf_node_is_type(predicate) && !librdf_node_is_literal(librdf_statement_get_object(st));
+		/* Find the extent of the run of statements sharing this subject and
+		 * predicate
+		 */
+		for(next = c + 1; next < count; next++)
+		{
+			if(rdf_node_cmp(librdf_statement_get_subject(list[next]), subject) ||
+			   rdf_node_cmp(librdf_statement_get_predicate(list[next]), predicate) ||
+			   (istype && librdf_node_is_literal(librdf_statement_get_object(list[next]))))
+			{
+				break;
+			}
+		}
+		multiple = (next - c > 1);
+		rdf_writer_puts(&writer, ",\n\t\t\t");
+		if(istype)
+		{
+			rdf_writer_puts(&writer, "\"@type\": ");
+		}
+		else
+		{
+			jsonld_write_uri_(&writer, librdf_node_get_uri(predicate));
+			rdf_writer_put(&writer, ": ", 2);
+		}
+		if(multiple)
+		{
+			rdf_writer_putc(&writer, '[');
+		}
+		for(; c < next; c++)
+		{
+			if(multiple)
+			{
+				rdf_writer_puts(&writer, "\n\t\t\t\t");
+			}
+			if(istype)
+			{
+				jsonld_write_id_(&writer, librdf_statement_get_object(list[c]));
+			}
+			else
+			{
+				jsonld_write_object_(&writer, librdf_statement_get_object(list[c]));
+			}
+			if(multiple && c + 1 < next)
+			{
+				rdf_writer_putc(&writer, ',');
+			}
+		}
+		if(multiple)
+		{
+			rdf_writer_puts(&writer, "\n\t\t\t]");
+		}
+	}
+	if(count)
+	{
+		rdf_writer_puts(&writer, "\n\t\t}\n\t");
+	}
+	rdf_writer_puts(&writer, "]\n}\n");
+	rdf_writer_flush(&writer);
+	if(writer.error)
+	{
+		quilt_logf(LOG_ERR, QUILT_PLUGIN_NAME ": failed to write JSON-LD response\n");
+	}
+	rdf_sort_free(list, count);
+	return 0;
+}
+
+static int
+jsonld_context_cb_(const char *prefix, const char *uri, void *data)
+{
+	struct jsonld_context_struct *ctx;
+
+	ctx = (struct jsonld_context_struct *) data;
+	rdf_writer_puts(ctx->writer, (ctx->count ? ",\n\t\t" : "\n\t\t"));
+	jsonld_write_string_(ctx->writer, prefix, strlen(prefix));
+	rdf_writer_put(ctx->writer, ": ", 2);
+	jsonld_write_string_(ctx->writer, uri, strlen(uri));
+	ctx->count++;
+	return 0;
+}
+
+static int
+jsonld_write_string_(RDFWRITER *writer, const char *str, size_t len)
+{
+	rdf_writer_putc(writer, '"');
+	rdf_writer_escape(writer, RWE_STRING, str, len);
+	return rdf_writer_putc(writer, '"');
+}
+
+/* Write the identifier of a subject or of an rdf:type object, which is
+ * always a resource or a blank node
+ */
+static int
+jsonld_write_id_(RDFWRITER *writer, librdf_node *node)
+{
+	const char *str;
+	size_t len;
+
+	if(librdf_node_is_blank(node))
+	{
+		str = (const char *) librdf_node_get_counted_blank_identifier(node, &len);
+		rdf_writer_put(writer, "\"_:", 3);
+		rdf_writer_escape(writer, RWE_STRING, str, len);
+		return rdf_writer_putc(writer, '"');
+	}
+	return jsonld_write_uri_(writer, librdf_node_get_uri(node));
+}
+
+/* Write a URI as a compact IRI if possible, or in full otherwise */
+static int
+jsonld_write_uri_(RDFWRITER *writer, librdf_uri *uri)
+{
+	const char *str, *local;
+	char contracted[RDF_CONTRACT_BUFSIZE];
+	size_t len;
+
+	str = (const char *) librdf_uri_as_counted_string(uri, &len);
+	if(quilt_uri_contract_buf(str, contracted, sizeof(contracted)) == 1 &&
+	   (local = strchr(contracted, ':')) && strncmp(local + 1, "//", 2))
+	{
+		return jsonld_write_string_(writer, contracted, strlen(contracted));
+	}
+	return jsonld_write_string_(writer, str, len);
+}
+
+static int
+jsonld_write_object_(RDFWRITER *writer, librdf_node *node)
+{
+	const char *str, *lang;
+	librdf_uri *dt;
+	size_t len;
+
+	if(!librdf_node_is_literal(node))
+	{
+		rdf_writer_puts(writer, "{ \"@id\": ");
+		jsonld_write_id_(writer, node);
+		return rdf_writer_put(writer, " }", 2);
+	}
+	str = (const char *) librdf_node_get_literal_value_as_counted_string(node, &len);
+	lang = librdf_node_get_literal_value_language(node);
+	dt = librdf_node_get_literal_value_datatype_uri(node);
+	if((!lang || !lang[0]) && (!dt || !strcmp((const char *) librdf_uri_as_string(dt), NS_XSD "string")))
+	{
+		/* Plain strings are written as-is */
+		return jsonld_write_string_(writer, str, len);
+	}
+	rdf_writer_puts(writer, "{ \"@value\": ");
+	jsonld_write_string_(writer, str, len);
+	if(lang && lang[0])
+	{
+		rdf_writer_puts(writer, ", \"@language\": ");
+		jsonld_write_string_(writer, lang, strlen(lang));
+	}
+	else
+	{
+		rdf_writer_puts(writer, ", \"@type\": ");
+		jsonld_write_uri_(writer, dt);
+	}
+	return rdf_writer_put(writer, " }", 2);
+}
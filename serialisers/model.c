@@ -26,664 +26,726 @@
 #include <libquilt.h>
 #include "model.h"
 
-/* Populate the template data with information from the RDF model.
+/* Build the data passed to templates from the RDF model, wrapping 'dict',
+ * which holds the request and common information.
  *
- * The following dictionary members may be set:
+ * The following members are provided in addition to those of 'dict' (see
+ * provider.c):
  *
- * 'data': a hash (where the subject URI is the key) of all of the data in
+ * 'data': an object (where the subject URI is the key) of all of the data in
  *    the model.
  * 'results': an ordered array of Result items.
  * 'abstractUri': the URI of the abstract document
- * 'abstract': copied from data[abstractUri]
+ * 'abstract': data[abstractUri]
  * 'primaryTopicUri': the URI of the primary topic in the model
- * 'primaryTopic': the primary topic of the model, copied from
- *    data[primaryTopicUri]
+ * 'primaryTopic': the primary topic of the model, data[primaryTopicUri]
  * 'object': an alias for primaryTopic
  * 'title': if known, the title/label of 'primaryTopic'
  */
-int
-html_add_model(json_t *dict, QUILTREQ *req)
+HTMLMODEL *
+html_model_create(QUILTREQ *req, json_t *dict)
 {
-	json_t *items, *item, *primaryTopic, *results, *k;
-	librdf_model *model;
-	char *abstractUri, *primaryTopicUri;
+	HTMLMODEL *model;
+	QUILTINDEX *index;
+	QUILTCANON *reqcanon;
 
-	primaryTopic = NULL;
-	model = quilt_request_model(req);
-	items = html_model_items_(req, model);
+	model = (HTMLMODEL *) calloc(1, sizeof(HTMLMODEL));
+	if(!model)
+	{
+		quilt_logf(LOG_CRIT, QUILT_PLUGIN_NAME ": failed to allocate memory for template data\n");
+		return NULL;
+	}
+	model->req = req;
+	model->dict = dict;
+	index = quilt_request_model_index(req);
+	if(!index)
+	{
+		quilt_logf(LOG_ERR, QUILT_PLUGIN_NAME ": failed to obtain index of model\n");
+		html_model_destroy(model);
+		return NULL;
+	}
+	if(html_model_items_(model, index) ||
+	   html_model_hash_(model) ||
+	   html_model_results_(model))
+	{
+		html_model_destroy(model);
+		return NULL;
+	}
+	reqcanon = quilt_request_canonical(req);
 	/* Locate the 'abstract document URI' and data */
-	abstractUri = html_model_abstract_(req, model, items, &item);
-	if(abstractUri)
+	model->abstractUri = quilt_canon_str(reqcanon, (quilt_request_ext(req) ? QCO_ABSTRACT : QCO_REQUEST));
+	if(model->abstractUri)
 	{
-		json_object_set_new(dict, "abstractUri", json_string(abstractUri));
-		if(item)
+		model->abstract = html_model_item(model, model->abstractUri);
+		if(model->abstract)
 		{
-			json_object_set(dict, "abstract", item);
-			if((k = json_object_get(item, "title")))
-			{
-				json_object_set(dict, "title", k);
-			}
+			model->abstract->abstract = 1;
 		}
 	}
 	/* Locate the primary topic of the document */
-	primaryTopicUri = html_model_primaryTopic_(req, model, items, abstractUri, &item);
-	if(primaryTopicUri)
+	model->primaryTopicUri = quilt_canon_str(reqcanon, QCO_NOEXT|QCO_FRAGMENT);
+	if(model->primaryTopicUri)
 	{
-		json_object_set_new(dict, "primaryTopicUri", json_string(primaryTopicUri));
-		if(item)
+		model->primaryTopic = html_model_item(model, model->primaryTopicUri);
+		if(model->primaryTopic)
 		{
-			primaryTopic = item;
-			json_object_set(dict, "primaryTopic", item);
-			json_object_set(dict, "object", item);
-			if((k = json_object_get(item, "title")))
-			{
-				json_object_set(dict, "title", k);
-			}
+			model->primaryTopic->me = 1;
 		}
-		results = html_model_results_(req, items);
-	}
-	/* Return either the sorted set of results (if any) or the raw data */
-	if (json_array_size(results) > 0)
-	{
-		json_object_set_new(dict, "results", results);
 	}
-	json_object_set_new(dict, "data", items);
-	free(abstractUri);
-	free(primaryTopicUri);
-	return 0;
+	return model;
 }
 
-/* Determine the abstract document URI, and if available return the data
- * relating to it from the 'items' dictionary.
- *
- * If an item was found, the 'abstract' member of it is set to true
- */
-static char *
-html_model_abstract_(QUILTREQ *req, librdf_model *model, json_t *items, json_t **item)
+void
+html_model_destroy(HTMLMODEL *model)
 {
-	QUILTCANON *reqcanon;
-	char *uri;
-
-	(void) model;
-
-	*item = NULL;
-	reqcanon = quilt_request_canonical(req);
-	uri = quilt_canon_str(reqcanon, (quilt_request_ext(req) ? QCO_ABSTRACT : QCO_REQUEST));
-	*item = json_object_get(items, uri);
-	if(*item)
-	{	
-		json_object_set_new(*item, "abstract", json_true());
-	}
-	return uri;
+	struct html_strings_struct *p;
+
+	while(model->strings)
+	{
+		p = model->strings->next;
+		free(model->strings);
+		model->strings = p;
+	}
+	free(model->items);
+	free(model->props);
+	free(model->values);
+	free(model->slots);
+	free(model->results);
+	free(model->abstractUri);
+	free(model->primaryTopicUri);
+	free(model);
 }
 
-/* Locate the primary topic of the model and return its URI; attempt to locate
- * the data about it in the 'items' dictionary.
- *
- * If located, the entry in the dictionary will the member 'me' set to true.
- */
-static char *
-html_model_primaryTopic_(QUILTREQ *req, librdf_model *model, json_t *items, const char *abstract, json_t **item)
+/* Locate the item for a subject URI */
+struct html_item_struct *
+html_model_item(HTMLMODEL *model, const char *uri)
 {
-	QUILTCANON *reqcanon;
-	char *uri;
-
-	(void) model;
-	(void) abstract;
+	size_t slot;
 
-	*item = NULL;
-	reqcanon = quilt_request_canonical(req);
-	uri = quilt_canon_str(reqcanon, QCO_NOEXT|QCO_FRAGMENT);
-	*item = json_object_get(items, uri);
-	if(*item)
-	{	
-		json_object_set_new(*item, "me", json_true());
+	if(!model->nslots)
+	{
+		return NULL;
 	}
-	return uri;
+	for(slot = html_model_hash_str_(uri) & (model->nslots - 1); model->slots[slot]; slot = (slot + 1) & (model->nslots - 1))
+	{
+		if(!strcmp(model->slots[slot]->subject, uri))
+		{
+			return model->slots[slot];
+		}
+	}
+	return NULL;
 }
 
-/* Create an object based upon the content of the model, organised by subject.
+/* Create an item for each subject in the model, along with its properties
+ * and their values.
  *
- * The resulting object is substituted into the template with the name 'data',
- * and takes the following form:
+ * Each item has the form:
 
 	data[subject] = {
 		subject: 'http://...',
-		subjectLink: '<a href="...">...</a>',
+		link: '/...',
+		uri: '/...',
 		classLabel: 'Thing',
 		classSuffix: '(Thing)',
 		props: {
-			'@': [
+			'http://...': [
 				{
-				    predicate: '...',
+				    predicateUri: '...',
+				    predicateUriLabel: '...',
 				    value: 'abc123',
-				    htmlValue: '<a href="...">abc123</a>',
 				    type: 'literal',
+				    isLiteral: true,
 				    datatype: null,
-				    language: null
+				    lang: null
 				}
 			]
 		}
 	}
  */
-static json_t *
-html_model_items_(QUILTREQ *req, librdf_model *model)
+static int
+html_model_items_(HTMLMODEL *model, QUILTINDEX *index)
 {
-	json_t *items, *item, *props, *prop, *value;
-	librdf_world *world;
-	librdf_statement *query, *statement;
-	librdf_stream *st;
-	librdf_node *subj, *pred, *obj;
+	const QUILTTRIPLE *triples;
+	struct digest_struct digest;
+	struct html_item_struct *item;
+	struct html_prop_struct *prop;
+	struct html_value_struct *value;
+	librdf_node *subj, *pred;
 	const char *uri;
+	size_t n, ns, c, count, nitems, nvalues;
+	int kind;
 
-	world = quilt_librdf_world();
-	items = json_object();
-	query = librdf_new_statement(world);
-	st = librdf_model_find_statements(model, query);
-	while(!librdf_stream_end(st))
-	{
-		statement = librdf_stream_get_object(st);
-		subj = librdf_statement_get_subject(statement);
-		pred = librdf_statement_get_predicate(statement);
-		obj = librdf_statement_get_object(statement);
-		if(librdf_node_is_resource(subj) && librdf_node_is_resource(pred))
-		{
-			uri = (const char *) librdf_uri_as_string(librdf_node_get_uri(subj));
-			item = json_object_get(items, uri);
-			if(item)
+	/* Determine the number of items and values */
+	nitems = 0;
+	nvalues = 0;
+	ns = quilt_index_nsubjects(index);
+	for(n = 0; n < ns; n++)
+	{
+		subj = quilt_index_subject_at(index, n);
+		if(!librdf_node_is_resource(subj))
+		{
+			continue;
+		}
+		nitems++;
+		triples = quilt_index_subject(index, subj, &count);
+		for(c = 0; c < count; c++)
+		{
+			if(librdf_node_is_resource(triples[c].predicate))
 			{
-				/* An entry for this subject URI already exists */
-				props = json_object_get(item, "props");
+				nvalues++;
 			}
-			else
+		}
+	}
+	if(!nitems)
+	{
+		return 0;
+	}
+	model->items = (struct html_item_struct *) calloc(nitems, sizeof(struct html_item_struct));
+	if(nvalues)
+	{
+		/* Each value may be of a distinct predicate */
+		model->props = (struct html_prop_struct *) calloc(nvalues, sizeof(struct html_prop_struct));
+		model->values = (struct html_value_struct *) calloc(nvalues, sizeof(struct html_value_struct));
+	}
+	if(!model->items || (nvalues && (!model->props || !model->values)))
+	{
+		quilt_logf(LOG_CRIT, QUILT_PLUGIN_NAME ": failed to allocate memory for template data\n");
+		return -1;
+	}
+	/* The index holds each subject's triples together, so each subject can
+	 * be summarised as its properties are added, in a single pass
+	 */
+	for(n = 0; n < ns; n++)
+	{
+		subj = quilt_index_subject_at(index, n);
+		if(!librdf_node_is_resource(subj))
+		{
+			continue;
+		}
+		triples = quilt_index_subject(index, subj, &count);
+		item = &(model->items[model->nitems]);
+		model->nitems++;
+		item->props = &(model->props[model->nprops]);
+		memset(&digest, 0, sizeof(digest));
+		pred = NULL;
+		prop = NULL;
+		kind = DK_NONE;
+		for(c = 0; c < count; c++)
+		{
+			if(!librdf_node_is_resource(triples[c].predicate))
 			{
-				/* Populate a new item structure */
-				item = json_object();
-				json_object_set_new(items, uri, item);
-				json_object_set_new(item, "me", json_false());
-				json_object_set_new(item, "slot", json_false());
-				json_object_set_new(item, "result", json_false());
-				json_object_set_new(item, "abstract", json_false());
-				html_model_subject_(req, item, model, subj, uri);
-				props = json_object();
-				json_object_set_new(item, "props", props);
+				continue;
 			}
-
-			/* Obtain the array of values for this predicate URI */
-			uri = (const char *) librdf_uri_as_string(librdf_node_get_uri(pred));
-			prop = json_object_get(props, uri);
-			if(!prop)
+			if(triples[c].predicate != pred)
 			{
-				/* This is the first instance of this predicate that we've
-				 * seen for this object; create a new array to hold the
-				 * values */
-				prop = json_array();
-				json_object_set_new(props, uri, prop);
+				/* Terms within the index are unique, and triples are sorted
+				 * by predicate within each subject, so this is the first
+				 * value of a new predicate
+				 */
+				pred = triples[c].predicate;
+				uri = (const char *) librdf_uri_as_string(librdf_node_get_uri(pred));
+				kind = html_model_digest_kind_(uri);
+				prop = &(model->props[model->nprops]);
+				model->nprops++;
+				item->nprops++;
+				prop->predicateUri = uri;
+				prop->predicateUriLabel = html_model_contract_(model, uri);
+				prop->values = &(model->values[model->nvalues]);
 			}
-			/* Add a new 'value' structure to the array of values (prop) */
-			value = json_object();
-			json_array_append_new(prop, value);
-			html_model_predicate_(req, value, pred, uri);
-			html_model_object_(req, value, obj);
+			html_model_digest_add_(&digest, kind, triples[c].object);
+			value = &(model->values[model->nvalues]);
+			model->nvalues++;
+			prop->nvalues++;
+			value->prop = prop;
+			if(html_model_value_(model, value, triples[c].object))
+			{
+				return -1;
+			}
+		}
+		if(html_model_subject_(model, item, (const char *) librdf_uri_as_string(librdf_node_get_uri(subj)), &digest))
+		{
+			return -1;
 		}
-		librdf_stream_next(st);
 	}
-	librdf_free_stream(st);
-	librdf_free_statement(query);
-	return items;
+	return 0;
 }
 
-/* Add the details of a specific subject to an 'item' structure which is
- * passed into the template.
+/* Determine which member of a subject digest, if any, the values of a
+ * predicate contribute to
  */
 static int
-html_model_subject_(QUILTREQ *req, json_t *item, librdf_model *model, librdf_node *subject, const char *uri)
+html_model_digest_kind_(const char *predicate)
 {
-	double lon, lat;
-	json_t *sub;
-	struct class_struct *c;
-	char *buf, *str;
-	URI *uriobj;
-	URI_INFO *info;
-
-	uriobj = uri_create_str(uri, NULL);
-	if(!uriobj)
+	if(!strcmp(predicate, NS_RDF "type"))
 	{
-		quilt_logf(LOG_ERR, QUILT_PLUGIN_NAME ": failed to parse subject URI <%s>\n", uri);
-		return -1;
+		return DK_TYPE;
 	}
-	info = uri_info(uriobj);
-
-	json_object_set_new(item, "subject", json_string(uri));
-	if(!strncmp(uri, html_baseuri, html_baseurilen))
+	if(!strcmp(predicate, NS_RDFS "label"))
 	{
-		buf = (char *) malloc(strlen(uri) + 32);
-		buf[0] = '/';
-		strcpy(&(buf[1]), &(uri[html_baseurilen]));
-		json_object_set_new(item, "link", json_string(buf));
-		json_object_set_new(item, "uri", json_string(buf));
+		return DK_TITLE;
 	}
-	else
+	if(!strcmp(predicate, NS_RDFS "comment"))
 	{
-		buf = quilt_uri_contract(uri);
-		json_object_set_new(item, "link", json_string(uri));
-		json_object_set_new(item, "uri", json_string(buf));
+		return DK_SHORTDESC;
 	}
-	c = html_class_match(model, subject);
-	str = get_title(req, model, subject);
-	if(str)
+	if(!strcmp(predicate, NS_DCT "description"))
 	{
-		json_object_set_new(item, "hasTitle", json_true());
-		json_object_set_new(item, "title", json_string(str));
-		free(str);
+		return DK_LONGDESC;
 	}
-	else
+	if(!strcmp(predicate, NS_GEO "lat"))
 	{
-		json_object_set_new(item, "hasTitle", json_false());
-		json_object_set_new(item, "title", json_string(buf));
+		return DK_LAT;
 	}
-	str = get_shortdesc(req, model, subject);
-	if(str)
+	if(!strcmp(predicate, NS_GEO "long"))
 	{
-		json_object_set_new(item, "shortdesc", json_string(str));
-		free(str);
+		return DK_LONG;
 	}
-	else
+	if(!strcmp(predicate, NS_OLO "index"))
 	{
-		json_object_set_new(item, "shortdesc", json_string(""));
+		return DK_OLOINDEX;
 	}
-	str = get_longdesc(req, model, subject);
+	if(!strcmp(predicate, NS_OLO "item"))
+	{
+		return DK_OLOITEM;
+	}
+	return DK_NONE;
+}
+
+/* Update a subject digest with the object of one of its triples */
+static void
+html_model_digest_add_(struct digest_struct *digest, int kind, librdf_node *object)
+{
+	struct class_struct *c;
+	librdf_node **lit;
+	librdf_uri *dt;
+	const char *lang, *value;
+	/* XXX perform proper language negotiation */
+	const char *slang = "en-GB", *glang = "en";
+	char *endp;
+	double d;
+	int g;
+
+	switch(kind)
+	{
+	case DK_TYPE:
+		if(librdf_node_is_resource(object) &&
+		   !strcmp((const char *) librdf_uri_as_string(librdf_node_get_uri(object)), NS_OLO "Slot"))
+		{
+			digest->slot = 1;
+		}
+		/* Where several types are known classes, the one appearing first
+		 * in the class table is used
+		 */
+		c = html_class_match(object);
+		if(c && (!digest->cls || c < digest->cls))
+		{
+			digest->cls = c;
+		}
+		return;
+	case DK_TITLE:
+	case DK_SHORTDESC:
+	case DK_LONGDESC:
+		if(!librdf_node_is_literal(object) ||
+		   librdf_node_get_literal_value_datatype_uri(object))
+		{
+			return;
+		}
+		lit = digest->literal[kind];
+		lang = librdf_node_get_literal_value_language(object);
+		if(!lang)
+		{
+			if(!lit[DL_NONE])
+			{
+				lit[DL_NONE] = object;
+			}
+		}
+		else if(!strcasecmp(lang, slang))
+		{
+			if(!lit[DL_SPECIFIC])
+			{
+				lit[DL_SPECIFIC] = object;
+			}
+		}
+		else if(!strcasecmp(lang, glang))
+		{
+			if(!lit[DL_GENERIC])
+			{
+				lit[DL_GENERIC] = object;
+			}
+		}
+		return;
+	case DK_LAT:
+	case DK_LONG:
+		g = (kind == DK_LAT ? DG_LAT : DG_LONG);
+		if(digest->hasgeo[g] ||
+		   !librdf_node_is_literal(object) ||
+		   !(value = (const char *) librdf_node_get_literal_value(object)) ||
+		   !(dt = librdf_node_get_literal_value_datatype_uri(object)) ||
+		   strcmp((const char *) librdf_uri_as_string(dt), NS_XSD "decimal"))
+		{
+			return;
+		}
+		endp = NULL;
+		d = strtod(value, &endp);
+		if(!endp || !endp[0])
+		{
+			digest->geo[g] = d;
+			digest->hasgeo[g] = 1;
+		}
+		return;
+	case DK_OLOINDEX:
+	case DK_OLOITEM:
+		if(librdf_node_is_resource(object))
+		{
+			value = (const char *) librdf_uri_as_string(librdf_node_get_uri(object));
+		}
+		else if(librdf_node_is_literal(object))
+		{
+			value = (const char *) librdf_node_get_literal_value(object);
+		}
+		else
+		{
+			return;
+		}
+		if(kind == DK_OLOINDEX)
+		{
+			digest->index = value;
+		}
+		else
+		{
+			digest->key = value;
+		}
+		return;
+	}
+}
+
+/* Return the most suitable literal value for a member of a subject digest,
+ * or NULL if there is none
+ */
+static const char *
+html_model_digest_literal_(struct digest_struct *digest, int kind)
+{
+	int c;
+
+	for(c = 0; c < DL_COUNT; c++)
+	{
+		if(digest->literal[kind][c])
+		{
+			return (const char *) librdf_node_get_literal_value(digest->literal[kind][c]);
+		}
+	}
+	return NULL;
+}
+
+/* Populate an item from the digest of its subject */
+static int
+html_model_subject_(HTMLMODEL *model, struct html_item_struct *item, const char *uri, struct digest_struct *digest)
+{
+	const char *str;
+	char *buf;
+	URI *uriobj;
+	URI_INFO *info;
+
+	item->subject = uri;
+	str = html_model_local_(model, uri);
 	if(str)
 	{
-		json_object_set_new(item, "description", json_string(str));
-		free(str);
+		item->link = str;
+		item->uri = str;
 	}
 	else
 	{
-		json_object_set_new(item, "description", json_string(""));
+		item->link = uri;
+		item->uri = html_model_contract_(model, uri);
 	}
-	if(buf[0] == '/' || !info->host)
+	if(!item->uri)
 	{
-		json_object_set_new(item, "from", json_string(""));
+		return -1;
+	}
+	item->title = html_model_digest_literal_(digest, DK_TITLE);
+	if(item->title)
+	{
+		item->hasTitle = 1;
 	}
 	else
 	{
-		strcpy(buf, "from ");
-		strcpy(&(buf[5]), info->host);
-		json_object_set_new(item, "from", json_string(buf));
-	}		
-	uri_info_destroy(info);
-	free(buf);
-	if(c)
+		item->title = item->uri;
+	}
+	str = html_model_digest_literal_(digest, DK_SHORTDESC);
+	item->shortdesc = (str ? str : "");
+	str = html_model_digest_literal_(digest, DK_LONGDESC);
+	item->description = (str ? str : "");
+	item->from = "";
+	if(item->uri[0] != '/')
 	{
-		json_object_set_new(item, "class", json_string(c->cssClass));
-		json_object_set_new(item, "classLabel", json_string(c->label));
-		json_object_set_new(item, "classSuffix", json_string(c->suffix));
-		json_object_set_new(item, "classDefinite", json_string(c->definite));
+		uriobj = uri_create_str(uri, NULL);
+		if(!uriobj)
+		{
+			quilt_logf(LOG_ERR, QUILT_PLUGIN_NAME ": failed to parse subject URI <%s>\n", uri);
+			return -1;
+		}
+		info = uri_info(uriobj);
+		if(info && info->host)
+		{
+			buf = (char *) malloc(strlen(info->host) + 8);
+			if(buf)
+			{
+				strcpy(buf, "from ");
+				strcat(buf, info->host);
+				item->from = html_model_strdup_(model, buf, strlen(buf));
+				free(buf);
+			}
+		}
+		if(info)
+		{
+			uri_info_destroy(info);
+		}
+		uri_destroy(uriobj);
 	}
-	else
+	item->cls = digest->cls;
+	if(digest->hasgeo[DG_LONG] && digest->hasgeo[DG_LAT])
 	{
-		json_object_set_new(item, "class", json_string(""));
-		json_object_set_new(item, "classSuffix", json_string(""));
+		item->hasgeo = 1;
+		item->lon = digest->geo[DG_LONG];
+		item->lat = digest->geo[DG_LAT];
 	}
-
-	if(quilt_model_find_double(model, uri, NS_GEO "long", &lon) == 1 &&
-	   quilt_model_find_double(model, uri, NS_GEO "lat", &lat) == 1)
+	item->slot = digest->slot;
+	if(item->slot)
 	{
-		sub = json_object();
-		json_object_set_new(sub, "long", json_real(lon));
-		json_object_set_new(sub, "lat", json_real(lat));
-		json_object_set_new(item, "geo", sub);
+		item->index = digest->index;
+		item->key = digest->key;
 	}
-	return 0;
+	return (item->from ? 0 : -1);
 }
 
-/* Add the details of a specific predicate to a 'value' structure which is
- * passed into the template.
- */
+/* Populate a value from the object of a triple */
 static int
-html_model_predicate_(QUILTREQ *req, json_t *value, librdf_node *predicate, const char *uri)
+html_model_value_(HTMLMODEL *model, struct html_value_struct *value, librdf_node *object)
 {
-	char *contracted;
-
-	(void) req;
-	(void) predicate;
-
-	json_object_set_new(value, "predicateUri", json_string(uri));
-	contracted = quilt_uri_contract(uri);
-	json_object_set_new(value, "predicateUriLabel", json_string(contracted));
-	free(contracted);
-	return 0;
-}
-
-/* Add the details of a triple's object to a 'value' structure which is
- * passed into the template
- */
-static int
-html_model_object_(QUILTREQ *req, json_t *value, librdf_node *object)
-{
-	const char *str, *dtstr, *lang;
-	char *buf;
 	librdf_uri *dt;
+	const char *str;
 
-	(void) req;
-
+	value->object = object;
 	if(librdf_node_is_resource(object))
 	{
 		str = (const char *) librdf_uri_as_string(librdf_node_get_uri(object));
-		json_object_set_new(value, "type", json_string("uri"));
-		json_object_set_new(value, "isUri", json_true());
-		json_object_set_new(value, "value", json_string(str));
-		if(!strncmp(str, html_baseuri, html_baseurilen))
+		value->value = str;
+		value->link = html_model_local_(model, str);
+		if(value->link)
 		{
-			buf = (char *) malloc(strlen(str) + 32);
-			buf[0] = '/';
-			strcpy(&(buf[1]), &(str[html_baseurilen]));
-			json_object_set_new(value, "link", json_string(buf));
-			json_object_set_new(value, "uri", json_string(buf));
+			value->uri = value->link;
 		}
 		else
 		{
-			buf = quilt_uri_contract(str);
-			json_object_set_new(value, "uri", json_string(buf));
-			json_object_set_new(value, "link", json_string(str));
+			value->uri = html_model_contract_(model, str);
+			value->link = str;
 		}
-		free(buf);
+		return (value->uri ? 0 : -1);
 	}
-	else if(librdf_node_is_literal(object))
+	if(librdf_node_is_literal(object))
 	{
-		str = (const char *) librdf_node_get_literal_value(object);
-
-		json_object_set_new(value, "type", json_string("literal"));
-		json_object_set_new(value, "isLiteral", json_true());
-		json_object_set_new(value, "value", json_string(str));
-
-		lang = librdf_node_get_literal_value_language(object);
-		if(lang)
-		{
-			json_object_set_new(value, "lang", json_string(lang));
-		}
+		value->value = (const char *) librdf_node_get_literal_value(object);
+		value->lang = librdf_node_get_literal_value_language(object);
 		dt = librdf_node_get_literal_value_datatype_uri(object);
 		if(dt)
 		{
-			dtstr = (const char *) librdf_uri_as_string(dt);
-			if(dtstr)
+			value->datatype = (const char *) librdf_uri_as_string(dt);
+			if(value->datatype)
 			{
-				json_object_set_new(value, "datatype", json_string(dtstr));
-				buf = quilt_uri_contract(dtstr);
-				json_object_set_new(value, "datatypeUri", json_string(buf));
-				free(buf);
+				value->datatypeUri = html_model_contract_(model, value->datatype);
+				if(!value->datatypeUri)
+				{
+					return -1;
+				}
 			}
 		}
-		else
-		{
-			dtstr = NULL;
-		}
 	}
 	return 0;
 }
 
-/* Generate and return 'results' array, which is an ordered list
- * of slot entries, each of which has the form:
- * [ {
- *	   <result item data>...,
- *	   slot: true/false,
- *	   index: value of olo:index,
- *	   key: value of olo:item,
- *	   item: { <the item object referenced by olo:item> },
- *	 }
- * ]
- *
- * Any objects in 'items' whose classes include olo:Slot have
- * their 'slot' member set to true so that templates can skip them.
- * 
- * Returns:
- *	 json_t *sorted_results
- */
-static json_t *
-html_model_results_(QUILTREQ *req, json_t *items)
+/* Build the hash of items by subject URI */
+static int
+html_model_hash_(HTMLMODEL *model)
 {
-	json_t *item, *value, *props;
-	const char *key;
-	int i;
-	int size = MAX(req->limit, req->deflimit);
-	json_t* results[size];
-	int item_index=0;
+	size_t c, slot;
 
-	json_object_foreach(items, key, item)
+	if(!model->nitems)
 	{
-		quilt_logf(LOG_ERR, QUILT_PLUGIN_NAME "key: <%s>\n", key);
-		if(html_model_item_is_(item, NS_OLO "Slot"))
-		{
-			json_object_set_new(item, "slot", json_true());
-			props = json_object_get(item, "props");
-
-			/* get the index value and store in item.index */
-			json_t *olo_index = json_object_get(props, NS_OLO "index");
-			json_array_foreach(olo_index, i, value)
-			{
-				json_t *index = json_object_get(value, "value");
-				if (json_typeof(index) == JSON_STRING)
-				{
-					json_object_set(item, "index", index);
-				}
-			}
-
-			/* get the item value and store in item.key */
-			json_t *olo_item = json_object_get(props, NS_OLO "item");
-			json_array_foreach(olo_item, i, value)
-			{
-				json_t *item_value = json_object_get(value, "value");
-				if (json_typeof(item_value) == JSON_STRING)
-				{
-					json_object_set(item, "key", item_value);
-					json_object_set(item, "item", json_object_get(items, json_string_value(item_value)));
-				}
-			}
-
-		/* store item in results array for sorting */
-		results[item_index++] = item;
-		}
+		return 0;
 	}
-
-	sort_items_by_index(results, item_index);
-
-	/* Convert C array back to json */
-	json_t *sorted_items = json_array();
-	for (i=0; i<item_index; i++)
+	/* Keep the hash no more than half full */
+	for(model->nslots = 16; model->nslots < model->nitems * 2; model->nslots *= 2);
+	model->slots = (struct html_item_struct **) calloc(model->nslots, sizeof(struct html_item_struct *));
+	if(!model->slots)
 	{
-		json_array_append(sorted_items, results[i]);
+		quilt_logf(LOG_CRIT, QUILT_PLUGIN_NAME ": failed to allocate memory for template data\n");
+		model->nslots = 0;
+		return -1;
 	}
-
-	return sorted_items;
-}
-
-/* Compare two items by item.index */
-static int
-cmp_index(const void *a, const void *b)
-{
-	json_t *item_a = *(json_t * const *)a;
-	json_t *item_b = *(json_t * const *)b;
-	char *json_index_a = json_string_value(json_object_get(item_a, "index"));
-	char *json_index_b = json_string_value(json_object_get(item_b, "index"));
-	long index_a = strtol(json_index_a, NULL, 10);
-	long index_b = strtol(json_index_b, NULL, 10);
-
-	return (index_a - index_b);
+	for(c = 0; c < model->nitems; c++)
+	{
+		for(slot = html_model_hash_str_(model->items[c].subject) & (model->nslots - 1); model->slots[slot]; slot = (slot + 1) & (model->nslots - 1));
+		model->slots[slot] = &(model->items[c]);
+	}
+	return 0;
 }
 
-
-/* Sort an array of result items by the item.index value
- * Args:
- *	json_t *items - json_object of key/value pairs where value is item
+/* Generate the ordered list of results: the items whose classes include
+ * olo:Slot, sorted by their olo:index, each of which refers to another item
+ * via olo:item.
  */
-int
-sort_items_by_index(json_t **items, int size)
-{
-	qsort(items, size, sizeof(items[0]), cmp_index);
-	return(0);
-}
-
-
-/* Determine if the object 'item' has the RDF class 'classuri' */
 static int
-html_model_item_is_(json_t *item, const char *classuri)
+html_model_results_(HTMLMODEL *model)
 {
-	json_t *props, *prop, *value, *k;
-	size_t index;
+	size_t c;
 
-	props = json_object_get(item, "props");
-	if(!props)
-	{
-		return 0;
-	}
-	prop = json_object_get(props, NS_RDF "type");
-	if(!prop)
+	for(c = 0; c < model->nitems; c++)
 	{
-		return 0;
-	}
-	json_array_foreach(prop, index, value)
-	{
-		k = json_object_get(value, "isUri");
-		if(!k || json_typeof(k) != JSON_TRUE)
+		if(!model->items[c].slot)
 		{
 			continue;
 		}
-		k = json_object_get(value, "value");
-		if(!k || json_typeof(k) != JSON_STRING)
+		if(!model->results)
 		{
-			continue;
+			model->results = (struct html_item_struct **) calloc(model->nitems, sizeof(struct html_item_struct *));
+			if(!model->results)
+			{
+				quilt_logf(LOG_CRIT, QUILT_PLUGIN_NAME ": failed to allocate memory for template data\n");
+				return -1;
+			}
 		}
-		if(!strcmp(json_string_value(k), classuri))
+		if(model->items[c].key)
 		{
-			return 1;
+			model->items[c].item = html_model_item(model, model->items[c].key);
 		}
+		model->results[model->nresults] = &(model->items[c]);
+		model->nresults++;
+	}
+	if(model->nresults)
+	{
+		qsort(model->results, model->nresults, sizeof(struct html_item_struct *), cmp_item_index);
 	}
 	return 0;
 }
 
-/* Obtain the title of a particular subject, suitable for substituting into
- * a template. This function should allocate the buffer it returns, or return
- * NULL if no suitable title could be found.
+/* If a URI is beneath the base URI, return it as a path relative to the
+ * root; otherwise, return NULL
  */
-static char *
-get_title(QUILTREQ *req, librdf_model *model, librdf_node *subject)
+static const char *
+html_model_local_(HTMLMODEL *model, const char *uri)
 {
-	return get_literal(req, model, subject, NS_RDFS "label");
-}
+	const char *str;
+	char *p;
+	size_t len;
 
-/* Obtain the short description of a particular subject, suitable for
- * substituting into a template. This function should allocate the buffer
- * it returns, or return NULL if no suitable title could be found.
- */
-static char *
-get_shortdesc(QUILTREQ *req, librdf_model *model, librdf_node *subject)
-{
-	return get_literal(req, model, subject, NS_RDFS "comment");
+	if(strncmp(uri, html_baseuri, html_baseurilen))
+	{
+		return NULL;
+	}
+	uri += html_baseurilen;
+	len = strlen(uri);
+	str = html_model_strdup_(model, NULL, len + 1);
+	if(str)
+	{
+		p = (char *) str;
+		p[0] = '/';
+		memcpy(&(p[1]), uri, len);
+	}
+	return str;
 }
 
-/* Obtain the short description of a particular subject, suitable for
- * substituting into a template. This function should allocate the buffer
- * it returns, or return NULL if no suitable title could be found.
+/* Return a URI contracted to prefix:suffix form if possible, or the URI
+ * itself otherwise
  */
-static char *
-get_longdesc(QUILTREQ *req, librdf_model *model, librdf_node *subject)
+static const char *
+html_model_contract_(HTMLMODEL *model, const char *uri)
 {
-	return get_literal(req, model, subject, NS_DCT "description");
-}
+	char buf[512], *p;
+	const char *str;
+	int r;
 
-static char *
-get_literal(QUILTREQ *req, librdf_model *model, librdf_node *subject, const char *predicate)
-{
-	librdf_world *world;
-	librdf_statement *query, *st;
-	librdf_stream *stream;
-	librdf_node *obj;
-	char *specific, *generic, *none;
-	/* XXX perform proper language negotiation */
-	const char *slang = "en-GB", *glang = "en";
-	const char *l, *value;
-
-	(void) req;
-
-	world = quilt_librdf_world();
-	specific = NULL;
-	generic = NULL;
-	none = NULL;
-	obj = librdf_new_node_from_uri_string(world, (const unsigned char *) predicate);
-	if(!obj)
+	r = quilt_uri_contract_buf(uri, buf, sizeof(buf));
+	if(r == 0)
 	{
-		quilt_logf(LOG_ERR, QUILT_PLUGIN_NAME ": failed to create new URI for <%s>\n", predicate);
-		return NULL;
+		return uri;
 	}
-	query = librdf_new_statement(world);
-	if(!query)
+	if(r > 0)
 	{
-		quilt_logf(LOG_ERR, QUILT_PLUGIN_NAME ": failed to create new statement for query\n");
-		librdf_free_node(obj);
-		return NULL;
+		return html_model_strdup_(model, buf, strlen(buf));
 	}
-	subject = librdf_new_node_from_node(subject);
-	if(!subject)
+	p = quilt_uri_contract(uri);
+	if(!p)
 	{
-		quilt_logf(LOG_ERR, QUILT_PLUGIN_NAME ": failed to duplicate subject node\n");
-		librdf_free_node(obj);
-		librdf_free_statement(query);
 		return NULL;
 	}
-	librdf_statement_set_subject(query, subject);
-	librdf_statement_set_predicate(query, obj);
-	stream = librdf_model_find_statements(model, query);
-	if(!stream)
-	{
-		quilt_logf(LOG_ERR, QUILT_PLUGIN_NAME ": failed to create stream for model query\n");
-		librdf_free_statement(query);
-		return NULL;
-	}
-	while(!librdf_stream_end(stream))
+	str = html_model_strdup_(model, p, strlen(p));
+	free(p);
+	return str;
+}
+
+/* Copy a string into the model's string storage; if str is NULL, len bytes
+ * are reserved (plus a terminating NUL)
+ */
+static const char *
+html_model_strdup_(HTMLMODEL *model, const char *str, size_t len)
+{
+	struct html_strings_struct *p;
+	char *dest;
+	size_t size;
+
+	if(!model->strings || model->strings->used + len + 1 > model->strings->size)
 	{
-		st = librdf_stream_get_object(stream);
-		obj = librdf_statement_get_object(st);
-		if(!obj)
+		size = HTML_STRINGS_BLOCK;
+		if(len + 1 > size)
 		{
-			quilt_logf(LOG_ERR, QUILT_PLUGIN_NAME ": failed to obtain object of statement\n");
+			size = len + 1;
 		}
-		else if(librdf_node_is_literal(obj) &&
-		   !librdf_node_get_literal_value_datatype_uri(obj))
+		p = (struct html_strings_struct *) malloc(sizeof(struct html_strings_struct) + size);
+		if(!p)
 		{
-			l = librdf_node_get_literal_value_language(obj);
-			value = (const char *) librdf_node_get_literal_value(obj);
-			if(!l)
-			{
-				if(!generic && !none)
-				{
-					none = strdup(value);
-				}
-			}
-			else if(!strcasecmp(l, slang))
-			{
-				specific = strdup(value);
-				break;
-			}
-			else if(!strcasecmp(l, glang) && !generic)
-			{
-				generic = strdup(value);
-			}
+			quilt_logf(LOG_CRIT, QUILT_PLUGIN_NAME ": failed to allocate memory for template data\n");
+			return NULL;
 		}
-		librdf_stream_next(stream);
+		p->next = model->strings;
+		p->used = 0;
+		p->size = size;
+		model->strings = p;
+	}
+	dest = &(model->strings->buf[model->strings->used]);
+	if(str)
+	{
+		memcpy(dest, str, len);
 	}
-	librdf_free_stream(stream);
-	librdf_free_statement(query);
-	if(specific)
+	dest[len] = 0;
+	model->strings->used += len + 1;
+	return dest;
+}
+
+static unsigned int
+html_model_hash_str_(const char *str)
+{
+	const unsigned char *p;
+	unsigned int h;
+
+	for(h = 5381, p = (const unsigned char *) str; *p; p++)
 	{
-		free(generic);
-		free(none);
-		return specific;
+		h = ((h << 5) + h) + *p;
 	}
-	if(generic)
+	return h;
+}
+
+/* Compare two slot items by their olo:index values */
+int
+cmp_item_index(const void *a, const void *b)
+{
+	const struct html_item_struct *item_a = *(struct html_item_struct * const *) a;
+	const struct html_item_struct *item_b = *(struct html_item_struct * const *) b;
+	long index_a = (item_a->index ? strtol(item_a->index, NULL, 10) : 0);
+	long index_b = (item_b->index ? strtol(item_b->index, NULL, 10) : 0);
+
+	if(index_a == index_b)
 	{
-		free(none);
-		return generic;
+		return 0;
 	}
-	return none;
+	return (index_a < index_b ? -1 : 1);
 }
@@ -2,18 +2,72 @@
 #include <jansson.h>
 #include <libquilt.h>
 
-#define MAX(x, y) (((x) > (y)) ? (x) : (y))
-
-static json_t *html_model_items_(QUILTREQ *req, librdf_model *model);
-static int html_model_subject_(QUILTREQ *req, json_t *item, librdf_model *model, librdf_node *subject, const char *uri);
-static int html_model_predicate_(QUILTREQ *req, json_t *value, librdf_node *predicate, const char *uri);
-static int html_model_object_(QUILTREQ *req, json_t *value, librdf_node *object);
-static char *html_model_abstract_(QUILTREQ *req, librdf_model *model, json_t *items, json_t **item);
-static char *html_model_primaryTopic_(QUILTREQ *req, librdf_model *model, json_t *items, const char *abstractUri, json_t **item);
-static json_t *html_model_results_(QUILTREQ *req, json_t *items);
-static int html_model_item_is_(json_t *item, const char *classuri);
-static char *get_title(QUILTREQ *req, librdf_model *model, librdf_node *subject);
-static char *get_shortdesc(QUILTREQ *req, librdf_model *model, librdf_node *subject);
-static char *get_longdesc(QUILTREQ *req, librdf_model *model, librdf_node *subject);
-static char *get_literal(QUILTREQ *req, librdf_model *model, librdf_node *subject, const char *predicate);
-static int cmp_index(const void *a, const void *b);
+/* The members of a subject digest which a predicate's values contribute to */
+enum
+{
+	DK_TITLE,
+	DK_SHORTDESC,
+	DK_LONGDESC,
+	DK_LAT,
+	DK_LONG,
+	DK_TYPE,
+	DK_OLOINDEX,
+	DK_OLOITEM,
+	DK_NONE
+};
+
+/* The number of literal members (DK_TITLE to DK_LONGDESC) */
+#define DK_LITERALS                     3
+
+/* Candidate literals, in order of preference */
+enum
+{
+	DL_SPECIFIC,
+	DL_GENERIC,
+	DL_NONE,
+	DL_COUNT
+};
+
+enum
+{
+	DG_LAT,
+	DG_LONG
+};
+
+/* A summary of the properties of a subject which are used to describe it,
+ * gathered while its triples are added to the template data
+ */
+struct digest_struct
+{
+	struct class_struct *cls;
+	librdf_node *literal[DK_LITERALS][DL_COUNT];
+	double geo[2];
+	int hasgeo[2];
+	int slot;
+	const char *index;
+	const char *key;
+};
+
+/* The size of each block of storage for generated strings */
+#define HTML_STRINGS_BLOCK              8192
+
+struct html_strings_struct
+{
+	struct html_strings_struct *next;
+	size_t used;
+	size_t size;
+	char buf[];
+};
+
+static int html_model_items_(HTMLMODEL *model, QUILTINDEX *index);
+static int html_model_digest_kind_(const char *predicate);
+static void html_model_digest_add_(struct digest_struct *digest, int kind, librdf_node *object);
+static const char *html_model_digest_literal_(struct digest_struct *digest, int kind);
+static int html_model_subject_(HTMLMODEL *model, struct html_item_struct *item, const char *uri, struct digest_struct *digest);
+static int html_model_value_(HTMLMODEL *model, struct html_value_struct *value, librdf_node *object);
+static int html_model_hash_(HTMLMODEL *model);
+static int html_model_results_(HTMLMODEL *model);
+static const char *html_model_local_(HTMLMODEL *model, const char *uri);
+static const char *html_model_contract_(HTMLMODEL *model, const char *uri);
+static const char *html_model_strdup_(HTMLMODEL *model, const char *str, size_t len);
+static unsigned int html_model_hash_str_(const char *str);
@@ -0,0 +1,103 @@
+/* Quilt: A Linked Open Data server
+ *
+ * Native N-Triples and N-Quads serializer
+ *
+ * Author: Mo McRoberts <mo.mcroberts@bbc.co.uk>
+ *
+ * Copyright (c) 2017 BBC
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include "p_rdf.h"
+
+static int ntriples_serialize(QUILTREQ *req);
+static int nquads_serialize(QUILTREQ *req);
+static int ntriples_serialize_model(QUILTREQ *req, const char *mimetype, int quads);
+
+static QUILTTYPE ntriples_type = { "application/n-triples", "nt", "N-Triples", 0.75f, 1, NULL };
+static QUILTTYPE nquads_type = { "application/n-quads", "nq", "N-Quads", 0.85f, 1, NULL };
+
+int
+ntriples_init(void)
+{
+	if(quilt_plugin_register_serializer(&ntriples_type, ntriples_serialize))
+	{
+		return -1;
+	}
+	if(quilt_plugin_register_serializer(&nquads_type, nquads_serialize))
+	{
+		return -1;
+	}
+	return 0;
+}
+
+static int
+ntriples_serialize(QUILTREQ *req)
+{
+	return ntriples_serialize_model(req, ntriples_type.mimetype, 0);
+}
+
+static int
+nquads_serialize(QUILTREQ *req)
+{
+	return ntriples_serialize_model(req, nquads_type.mimetype, 1);
+}
+
+static int
+ntriples_serialize_model(QUILTREQ *req, const char *mimetype, int quads)
+{
+	RDFWRITER writer;
+	librdf_stream *stream;
+	librdf_statement *st;
+	librdf_node *context;
+
+	stream = librdf_model_as_stream(quilt_request_model(req));
+	if(!stream)
+	{
+		quilt_logf(LOG_ERR, QUILT_PLUGIN_NAME ": failed to obtain stream from model\n");
+		return 500;
+	}
+	rdf_writer_init(&writer, req);
+	rdf_writer_headers(&writer, mimetype);
+	while(!librdf_stream_end(stream) && !writer.error)
+	{
+		st = librdf_stream_get_object(stream);
+		rdf_writer_node(&writer, librdf_statement_get_subject(st));
+		rdf_writer_putc(&writer, ' ');
+		rdf_writer_node(&writer, librdf_statement_get_predicate(st));
+		rdf_writer_putc(&writer, ' ');
+		rdf_writer_node(&writer, librdf_statement_get_object(st));
+		if(quads && (context = librdf_stream_get_context2(stream)))
+		{
+			rdf_writer_putc(&writer, ' ');
+			rdf_writer_node(&writer, context);
+		}
+		rdf_writer_put(&writer, " .\n", 3);
+		librdf_stream_next(stream);
+	}
+	librdf_free_stream(stream);
+	rdf_writer_flush(&writer);
+	if(writer.error)
+	{
+		/* The headers have already been sent, so there is nothing more
+		 * useful to be done
+		 */
+		quilt_logf(LOG_ERR, QUILT_PLUGIN_NAME ": failed to write %s response\n", mimetype);
+	}
+	return 0;
+}
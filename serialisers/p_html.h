@@ -1,9 +1,11 @@
 #ifndef P_HTML_H_
 # define P_HTML_H_                     1
 
+# include <stdio.h>
 # include <stdlib.h>
 # include <string.h>
 # include <errno.h>
+# include <ctype.h>
 # include <librdf.h>
 
 # include "libquilt.h"
@@ -17,6 +19,7 @@
 # define NS_GEO                         "http://www.w3.org/2003/01/geo/wgs84_pos#"
 # define NS_OLO                         "http://purl.org/ontology/olo/core#"
 # define NS_FOAF                        "http://xmlns.com/foaf/0.1/"
+# define NS_XSD                         "http://www.w3.org/2001/XMLSchema#"
 
 struct class_struct
 {
@@ -27,8 +30,87 @@ struct class_struct
 	const char *definite;
 };
 
+typedef struct html_model_struct HTMLMODEL;
+
+/* A value of a property of a subject */
+struct html_value_struct
+{
+	struct html_prop_struct *prop;
+	librdf_node *object;
+	const char *value;
+	const char *link;
+	const char *uri;
+	const char *lang;
+	const char *datatype;
+	const char *datatypeUri;
+};
+
+/* The values of a particular predicate for a subject */
+struct html_prop_struct
+{
+	const char *predicateUri;
+	const char *predicateUriLabel;
+	struct html_value_struct *values;
+	size_t nvalues;
+};
+
+/* A subject in the model, as presented to templates */
+struct html_item_struct
+{
+	const char *subject;
+	const char *link;
+	const char *uri;
+	const char *title;
+	int hasTitle;
+	const char *shortdesc;
+	const char *description;
+	const char *from;
+	struct class_struct *cls;
+	int hasgeo;
+	double lat, lon;
+	int me;
+	int slot;
+	int abstract;
+	/* For slots, the value of olo:index, and the item referred to by
+	 * olo:item
+	 */
+	const char *index;
+	const char *key;
+	struct html_item_struct *item;
+	struct html_prop_struct *props;
+	size_t nprops;
+};
+
+/* The data passed to templates: the contents of the model, together with
+ * a dictionary of request and common information
+ */
+struct html_model_struct
+{
+	QUILTREQ *req;
+	json_t *dict;
+	struct html_item_struct *items;
+	size_t nitems;
+	struct html_prop_struct *props;
+	size_t nprops;
+	struct html_value_struct *values;
+	size_t nvalues;
+	/* Items, hashed by subject URI */
+	struct html_item_struct **slots;
+	size_t nslots;
+	/* Slot items, sorted by index */
+	struct html_item_struct **results;
+	size_t nresults;
+	char *abstractUri;
+	struct html_item_struct *abstract;
+	char *primaryTopicUri;
+	struct html_item_struct *primaryTopic;
+	/* Storage for strings generated from the model */
+	struct html_strings_struct *strings;
+};
+
 extern QUILTTYPE html_types[];
-extern struct class_struct html_classes[];
+extern struct class_struct *html_classes;
+extern size_t html_nclasses;
 extern char *html_baseuri;
 extern size_t html_baseurilen;
 
@@ -37,15 +119,25 @@ LIQUIFYTPL *html_template(QUILTREQ *req);
 
 /* Check whether a MIME type is handled by this module */
 int html_type(const char *type);
-/* Attempt to determine which of the known classes the subject belongs to */
-struct class_struct *html_class_match(librdf_model *model, librdf_node *subject);
+/* Compile the table of known classes */
+int html_classes_init(void);
+/* Find the known class, if any, corresponding to an rdf:type object */
+struct class_struct *html_class_match(librdf_node *type);
 
 int html_add_common(json_t *dict, QUILTREQ *req);
 int html_add_request(json_t *dict, QUILTREQ *req);
-int html_add_model(json_t *dict, QUILTREQ *req);
+
+/* Build the template data for a request, wrapping dict */
+HTMLMODEL *html_model_create(QUILTREQ *req, json_t *dict);
+void html_model_destroy(HTMLMODEL *model);
+/* Locate the item for a subject URI */
+struct html_item_struct *html_model_item(HTMLMODEL *model, const char *uri);
+
+/* The data provider through which templates access a HTMLMODEL */
+extern const LIQUIFYPROVIDER html_model_provider;
 
 /* Make functions available for cunit */
-int sort_items_by_index(json_t **items, int size);
+int cmp_item_index(const void *a, const void *b);
 
 /* Debian Wheezy ships with libjansson 2.3, which doesn't include
  * json_array_foreach()
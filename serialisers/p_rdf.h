@@ -0,0 +1,80 @@
+/* Quilt: A Linked Open Data server
+ *
+ * Author: Mo McRoberts <mo.mcroberts@bbc.co.uk>
+ *
+ * Copyright (c) 2017 BBC
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef P_RDF_H_
+# define P_RDF_H_                       1
+
+# include <stdlib.h>
+# include <string.h>
+# include <errno.h>
+# include <librdf.h>
+
+# include "libquilt.h"
+
+# define QUILT_PLUGIN_NAME              "rdf"
+
+# define NS_RDF                         "http://www.w3.org/1999/02/22-rdf-syntax-ns#"
+# define NS_XSD                         "http://www.w3.org/2001/XMLSchema#"
+
+/* The amount of output buffered before it is passed to the SAPI */
+# define RDF_WRITER_BUFSIZE             8192
+
+/* The size of the buffer used to contract URIs; longer URIs are written in
+ * full
+ */
+# define RDF_CONTRACT_BUFSIZE           512
+
+/* Escaping rules applied by rdf_writer_escape() */
+typedef enum
+{
+	/* The contents of a quoted string literal */
+	RWE_STRING,
+	/* The contents of an IRI reference */
+	RWE_IRI
+} RDFESCAPE;
+
+/* Buffered output to a request */
+typedef struct
+{
+	QUILTREQ *req;
+	size_t len;
+	int error;
+	unsigned char buf[RDF_WRITER_BUFSIZE];
+} RDFWRITER;
+
+void rdf_writer_init(RDFWRITER *writer, QUILTREQ *req);
+int rdf_writer_headers(RDFWRITER *writer, const char *mimetype);
+int rdf_writer_put(RDFWRITER *writer, const char *bytes, size_t len);
+int rdf_writer_puts(RDFWRITER *writer, const char *str);
+int rdf_writer_putc(RDFWRITER *writer, int ch);
+int rdf_writer_escape(RDFWRITER *writer, RDFESCAPE rules, const char *str, size_t len);
+int rdf_writer_iri(RDFWRITER *writer, const char *iri, size_t len);
+int rdf_writer_node(RDFWRITER *writer, librdf_node *node);
+int rdf_writer_flush(RDFWRITER *writer);
+
+int rdf_sort_model(librdf_model *model, librdf_statement ***list, size_t *count);
+void rdf_sort_free(librdf_statement **list, size_t count);
+int rdf_node_cmp(librdf_node *a, librdf_node *b);
+int rdf_node_is_type(librdf_node *node);
+
+int ntriples_init(void);
+int turtle_init(void);
+int jsonld_init(void);
+
+#endif /*!P_RDF_H_*/
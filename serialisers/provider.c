@@ -0,0 +1,620 @@
+/* Quilt: A Linked Open Data server
+ *
+ * Author: Mo McRoberts <mo.mcroberts@bbc.co.uk>
+ *
+ * Copyright (c) 2017 BBC
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+/* The data providers through which templates access a HTMLMODEL (see
+ * model.c): the records built from the model are presented to templates
+ * directly, rather than being converted to JSON first. Members which are
+ * not part of the model are obtained from the request dictionary.
+ *
+ * Where the members of an object are iterated, they are visited in the same
+ * order as those of the equivalent JSON object would be.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include "p_html.h"
+
+static int html_root_get_(void *obj, const char *key, LIQUIFYVALUE *value);
+static int html_root_iter_(void *obj, LIQUIFYITER *iter);
+static int html_root_next_(void *obj, LIQUIFYITER *iter, LIQUIFYVALUE *value);
+static void html_root_iter_end_(void *obj, LIQUIFYITER *iter);
+static int html_data_get_(void *obj, const char *key, LIQUIFYVALUE *value);
+static int html_data_iter_(void *obj, LIQUIFYITER *iter);
+static int html_data_next_(void *obj, LIQUIFYITER *iter, LIQUIFYVALUE *value);
+static int html_results_iter_(void *obj, LIQUIFYITER *iter);
+static int html_results_next_(void *obj, LIQUIFYITER *iter, LIQUIFYVALUE *value);
+static int html_item_get_(void *obj, const char *key, LIQUIFYVALUE *value);
+static int html_geo_get_(void *obj, const char *key, LIQUIFYVALUE *value);
+static int html_props_get_(void *obj, const char *key, LIQUIFYVALUE *value);
+static int html_props_iter_(void *obj, LIQUIFYITER *iter);
+static int html_props_next_(void *obj, LIQUIFYITER *iter, LIQUIFYVALUE *value);
+static int html_values_iter_(void *obj, LIQUIFYITER *iter);
+static int html_values_next_(void *obj, LIQUIFYITER *iter, LIQUIFYVALUE *value);
+static int html_value_get_(void *obj, const char *key, LIQUIFYVALUE *value);
+static int html_none_iter_(void *obj, LIQUIFYITER *iter);
+static int html_none_next_(void *obj, LIQUIFYITER *iter, LIQUIFYVALUE *value);
+static void html_item_value_(struct html_item_struct *item, LIQUIFYVALUE *value);
+
+/* The template data as a whole (obj is a HTMLMODEL) */
+const LIQUIFYPROVIDER html_model_provider = {
+	html_root_get_,
+	html_root_iter_,
+	html_root_next_,
+	html_root_iter_end_,
+	NULL
+};
+
+/* data: the items in the model, by subject URI (obj is a HTMLMODEL) */
+static const LIQUIFYPROVIDER html_data_provider = {
+	html_data_get_,
+	html_data_iter_,
+	html_data_next_,
+	NULL,
+	NULL
+};
+
+/* results: the slot items, in order (obj is a HTMLMODEL) */
+static const LIQUIFYPROVIDER html_results_provider = {
+	NULL,
+	html_results_iter_,
+	html_results_next_,
+	NULL,
+	NULL
+};
+
+/* An item (obj is a struct html_item_struct) */
+static const LIQUIFYPROVIDER html_item_provider = {
+	html_item_get_,
+	html_none_iter_,
+	html_none_next_,
+	NULL,
+	NULL
+};
+
+/* item.geo (obj is a struct html_item_struct) */
+static const LIQUIFYPROVIDER html_geo_provider = {
+	html_geo_get_,
+	html_none_iter_,
+	html_none_next_,
+	NULL,
+	NULL
+};
+
+/* item.props: the values of an item, by predicate URI (obj is a struct
+ * html_item_struct)
+ */
+static const LIQUIFYPROVIDER html_props_provider = {
+	html_props_get_,
+	html_props_iter_,
+	html_props_next_,
+	NULL,
+	NULL
+};
+
+/* item.props[predicate]: a list of values (obj is a struct
+ * html_prop_struct)
+ */
+static const LIQUIFYPROVIDER html_values_provider = {
+	NULL,
+	html_values_iter_,
+	html_values_next_,
+	NULL,
+	NULL
+};
+
+/* A value (obj is a struct html_value_struct) */
+static const LIQUIFYPROVIDER html_value_provider = {
+	html_value_get_,
+	html_none_iter_,
+	html_none_next_,
+	NULL,
+	NULL
+};
+
+static int
+html_root_get_(void *obj, const char *key, LIQUIFYVALUE *value)
+{
+	HTMLMODEL *model;
+
+	model = (HTMLMODEL *) obj;
+	if(!strcmp(key, "data"))
+	{
+		liquify_value_object(value, &html_data_provider, (void *) model);
+		return 1;
+	}
+	if(!strcmp(key, "results"))
+	{
+		if(!model->nresults)
+		{
+			return 0;
+		}
+		liquify_value_list(value, &html_results_provider, (void *) model);
+		return 1;
+	}
+	if(!strcmp(key, "primaryTopic") || !strcmp(key, "object"))
+	{
+		if(!model->primaryTopic)
+		{
+			return 0;
+		}
+		html_item_value_(model->primaryTopic, value);
+		return 1;
+	}
+	if(!strcmp(key, "abstract"))
+	{
+		if(!model->abstract)
+		{
+			return 0;
+		}
+		html_item_value_(model->abstract, value);
+		return 1;
+	}
+	if(!strcmp(key, "primaryTopicUri"))
+	{
+		if(!model->primaryTopicUri)
+		{
+			return 0;
+		}
+		liquify_value_string(value, model->primaryTopicUri);
+		return 1;
+	}
+	if(!strcmp(key, "abstractUri"))
+	{
+		if(!model->abstractUri)
+		{
+			return 0;
+		}
+		liquify_value_string(value, model->abstractUri);
+		return 1;
+	}
+	if(!strcmp(key, "title"))
+	{
+		/* The title of the primary topic is preferred to that of the
+		 * abstract document
+		 */
+		if(model->primaryTopic)
+		{
+			liquify_value_string(value, model->primaryTopic->title);
+			return 1;
+		}
+		if(model->abstract)
+		{
+			liquify_value_string(value, model->abstract->title);
+			return 1;
+		}
+	}
+	return liquify_json_provider.get((void *) model->dict, key, value);
+}
+
+/* Iterating the template data visits the members of the request dictionary
+ * only
+ */
+static int
+html_root_iter_(void *obj, LIQUIFYITER *iter)
+{
+	return liquify_json_provider.iter((void *) ((HTMLMODEL *) obj)->dict, iter);
+}
+
+static int
+html_root_next_(void *obj, LIQUIFYITER *iter, LIQUIFYVALUE *value)
+{
+	return liquify_json_provider.next((void *) ((HTMLMODEL *) obj)->dict, iter, value);
+}
+
+static void
+html_root_iter_end_(void *obj, LIQUIFYITER *iter)
+{
+	liquify_json_provider.iter_end((void *) ((HTMLMODEL *) obj)->dict, iter);
+}
+
+static int
+html_data_get_(void *obj, const char *key, LIQUIFYVALUE *value)
+{
+	struct html_item_struct *item;
+
+	item = html_model_item((HTMLMODEL *) obj, key);
+	if(!item)
+	{
+		return 0;
+	}
+	html_item_value_(item, value);
+	return 1;
+}
+
+/* Items are visited in the reverse of the order in which they were added */
+static int
+html_data_iter_(void *obj, LIQUIFYITER *iter)
+{
+	iter->index = 0;
+	iter->count = ((HTMLMODEL *) obj)->nitems;
+	iter->data = NULL;
+	return 0;
+}
+
+static int
+html_data_next_(void *obj, LIQUIFYITER *iter, LIQUIFYVALUE *value)
+{
+	HTMLMODEL *model;
+
+	model = (HTMLMODEL *) obj;
+	if(iter->index >= iter->count)
+	{
+		return 0;
+	}
+	html_item_value_(&(model->items[iter->count - iter->index - 1]), value);
+	iter->index++;
+	return 1;
+}
+
+static int
+html_results_iter_(void *obj, LIQUIFYITER *iter)
+{
+	iter->index = 0;
+	iter->count = ((HTMLMODEL *) obj)->nresults;
+	iter->data = NULL;
+	return 0;
+}
+
+static int
+html_results_next_(void *obj, LIQUIFYITER *iter, LIQUIFYVALUE *value)
+{
+	HTMLMODEL *model;
+
+	model = (HTMLMODEL *) obj;
+	if(iter->index >= iter->count)
+	{
+		return 0;
+	}
+	html_item_value_(model->results[iter->index], value);
+	iter->index++;
+	return 1;
+}
+
+static int
+html_item_get_(void *obj, const char *key, LIQUIFYVALUE *value)
+{
+	struct html_item_struct *item;
+
+	item = (struct html_item_struct *) obj;
+	switch(key[0])
+	{
+	case 'a':
+		if(!strcmp(key, "abstract"))
+		{
+			liquify_value_bool(value, item->abstract);
+			return 1;
+		}
+		break;
+	case 'c':
+		if(!strcmp(key, "class"))
+		{
+			liquify_value_string(value, (item->cls ? item->cls->cssClass : ""));
+			return 1;
+		}
+		if(!strcmp(key, "classSuffix"))
+		{
+			liquify_value_string(value, (item->cls ? item->cls->suffix : ""));
+			return 1;
+		}
+		if(!item->cls)
+		{
+			break;
+		}
+		if(!strcmp(key, "classLabel"))
+		{
+			liquify_value_string(value, item->cls->label);
+			return 1;
+		}
+		if(!strcmp(key, "classDefinite"))
+		{
+			liquify_value_string(value, item->cls->definite);
+			return 1;
+		}
+		break;
+	case 'd':
+		if(!strcmp(key, "description"))
+		{
+			liquify_value_string(value, item->description);
+			return 1;
+		}
+		break;
+	case 'f':
+		if(!strcmp(key, "from"))
+		{
+			liquify_value_string(value, item->from);
+			return 1;
+		}
+		break;
+	case 'g':
+		if(item->hasgeo && !strcmp(key, "geo"))
+		{
+			liquify_value_object(value, &html_geo_provider, obj);
+			return 1;
+		}
+		break;
+	case 'h':
+		if(!strcmp(key, "hasTitle"))
+		{
+			liquify_value_bool(value, item->hasTitle);
+			return 1;
+		}
+		break;
+	case 'i':
+		if(item->index && !strcmp(key, "index"))
+		{
+			liquify_value_string(value, item->index);
+			return 1;
+		}
+		if(item->item && !strcmp(key, "item"))
+		{
+			html_item_value_(item->item, value);
+			return 1;
+		}
+		break;
+	case 'k':
+		if(item->key && !strcmp(key, "key"))
+		{
+			liquify_value_string(value, item->key);
+			return 1;
+		}
+		break;
+	case 'l':
+		if(!strcmp(key, "link"))
+		{
+			liquify_value_string(value, item->link);
+			return 1;
+		}
+		break;
+	case 'm':
+		if(!strcmp(key, "me"))
+		{
+			liquify_value_bool(value, item->me);
+			return 1;
+		}
+		break;
+	case 'p':
+		if(!strcmp(key, "props"))
+		{
+			liquify_value_object(value, &html_props_provider, obj);
+			return 1;
+		}
+		break;
+	case 'r':
+		if(!strcmp(key, "result"))
+		{
+			liquify_value_bool(value, 0);
+			return 1;
+		}
+		break;
+	case 's':
+		if(!strcmp(key, "subject"))
+		{
+			liquify_value_string(value, item->subject);
+			return 1;
+		}
+		if(!strcmp(key, "shortdesc"))
+		{
+			liquify_value_string(value, item->shortdesc);
+			return 1;
+		}
+		if(!strcmp(key, "slot"))
+		{
+			liquify_value_bool(value, item->slot);
+			return 1;
+		}
+		break;
+	case 't':
+		if(!strcmp(key, "title"))
+		{
+			liquify_value_string(value, item->title);
+			return 1;
+		}
+		break;
+	case 'u':
+		if(!strcmp(key, "uri"))
+		{
+			liquify_value_string(value, item->uri);
+			return 1;
+		}
+		break;
+	}
+	return 0;
+}
+
+static int
+html_geo_get_(void *obj, const char *key, LIQUIFYVALUE *value)
+{
+	struct html_item_struct *item;
+
+	item = (struct html_item_struct *) obj;
+	if(!strcmp(key, "lat"))
+	{
+		liquify_value_real(value, item->lat);
+		return 1;
+	}
+	if(!strcmp(key, "long"))
+	{
+		liquify_value_real(value, item->lon);
+		return 1;
+	}
+	return 0;
+}
+
+static int
+html_props_get_(void *obj, const char *key, LIQUIFYVALUE *value)
+{
+	struct html_item_struct *item;
+	size_t c;
+
+	item = (struct html_item_struct *) obj;
+	for(c = 0; c < item->nprops; c++)
+	{
+		if(!strcmp(item->props[c].predicateUri, key))
+		{
+			liquify_value_list(value, &html_values_provider, (void *) &(item->props[c]));
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/* Properties are visited in the reverse of the order in which they were
+ * added
+ */
+static int
+html_props_iter_(void *obj, LIQUIFYITER *iter)
+{
+	iter->index = 0;
+	iter->count = ((struct html_item_struct *) obj)->nprops;
+	iter->data = NULL;
+	return 0;
+}
+
+static int
+html_props_next_(void *obj, LIQUIFYITER *iter, LIQUIFYVALUE *value)
+{
+	struct html_item_struct *item;
+
+	item = (struct html_item_struct *) obj;
+	if(iter->index >= iter->count)
+	{
+		return 0;
+	}
+	liquify_value_list(value, &html_values_provider, (void *) &(item->props[iter->count - iter->index - 1]));
+	iter->index++;
+	return 1;
+}
+
+static int
+html_values_iter_(void *obj, LIQUIFYITER *iter)
+{
+	iter->index = 0;
+	iter->count = ((struct html_prop_struct *) obj)->nvalues;
+	iter->data = NULL;
+	return 0;
+}
+
+static int
+html_values_next_(void *obj, LIQUIFYITER *iter, LIQUIFYVALUE *value)
+{
+	struct html_prop_struct *prop;
+
+	prop = (struct html_prop_struct *) obj;
+	if(iter->index >= iter->count)
+	{
+		return 0;
+	}
+	liquify_value_object(value, &html_value_provider, (void *) &(prop->values[iter->index]));
+	iter->index++;
+	return 1;
+}
+
+static int
+html_value_get_(void *obj, const char *key, LIQUIFYVALUE *value)
+{
+	struct html_value_struct *v;
+	const char *str;
+	int isuri, isliteral;
+
+	v = (struct html_value_struct *) obj;
+	isuri = librdf_node_is_resource(v->object);
+	isliteral = librdf_node_is_literal(v->object);
+	str = NULL;
+	if(!strcmp(key, "predicateUri"))
+	{
+		str = v->prop->predicateUri;
+	}
+	else if(!strcmp(key, "predicateUriLabel"))
+	{
+		str = v->prop->predicateUriLabel;
+	}
+	else if(!strcmp(key, "type"))
+	{
+		str = (isuri ? "uri" : (isliteral ? "literal" : NULL));
+	}
+	else if(!strcmp(key, "isUri") || !strcmp(key, "isLiteral"))
+	{
+		if(key[2] == 'U' ? !isuri : !isliteral)
+		{
+			return 0;
+		}
+		liquify_value_bool(value, 1);
+		return 1;
+	}
+	else if(!strcmp(key, "value"))
+	{
+		str = v->value;
+	}
+	else if(!strcmp(key, "link"))
+	{
+		str = v->link;
+	}
+	else if(!strcmp(key, "uri"))
+	{
+		str = v->uri;
+	}
+	else if(!strcmp(key, "lang"))
+	{
+		str = v->lang;
+	}
+	else if(!strcmp(key, "datatype"))
+	{
+		str = v->datatype;
+	}
+	else if(!strcmp(key, "datatypeUri"))
+	{
+		str = v->datatypeUri;
+	}
+	if(!str)
+	{
+		return 0;
+	}
+	liquify_value_string(value, str);
+	return 1;
+}
+
+/* Records which are not intended to be iterated have no members to visit */
+static int
+html_none_iter_(void *obj, LIQUIFYITER *iter)
+{
+	(void) obj;
+
+	iter->index = 0;
+	iter->count = 0;
+	iter->data = NULL;
+	return 0;
+}
+
+static int
+html_none_next_(void *obj, LIQUIFYITER *iter, LIQUIFYVALUE *value)
+{
+	(void) obj;
+	(void) iter;
+	(void) value;
+
+	return 0;
+}
+
+static void
+html_item_value_(struct html_item_struct *item, LIQUIFYVALUE *value)
+{
+	liquify_value_object(value, &html_item_provider, (void *) item);
+}
@@ -0,0 +1,45 @@
+/* Quilt: A Linked Open Data server
+ *
+ * Native serializers for RDF syntaxes, which write directly to the
+ * response rather than serialising the model to a string first
+ *
+ * Author: Mo McRoberts <mo.mcroberts@bbc.co.uk>
+ *
+ * Copyright (c) 2017 BBC
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include "p_rdf.h"
+
+int
+quilt_plugin_init(void)
+{
+	if(ntriples_init())
+	{
+		return -1;
+	}
+	if(turtle_init())
+	{
+		return -1;
+	}
+	if(jsonld_init())
+	{
+		return -1;
+	}
+	return 0;
+}
@@ -0,0 +1,198 @@
+/* Quilt: A Linked Open Data server
+ *
+ * Sorted lists of statements, shared by the native serializers which
+ * produce deterministic output
+ *
+ * Author: Mo McRoberts <mo.mcroberts@bbc.co.uk>
+ *
+ * Copyright (c) 2017 BBC
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include "p_rdf.h"
+
+static int rdf_sort_cmp_(const void *a, const void *b);
+static int rdf_sort_cmp_pred_(librdf_node *a, librdf_node *b);
+
+/* Obtain copies of all of the statements in the model, sorted by subject,
+ * predicate (with rdf:type first) and object; the same triple present in
+ * more than one graph appears only once
+ */
+int
+rdf_sort_model(librdf_model *model, librdf_statement ***list, size_t *count)
+{
+	librdf_stream *stream;
+	librdf_statement **p, *st;
+	size_t size, c, n;
+
+	*list = NULL;
+	*count = 0;
+	size = 0;
+	stream = librdf_model_as_stream(model);
+	if(!stream)
+	{
+		quilt_logf(LOG_ERR, QUILT_PLUGIN_NAME ": failed to obtain stream from model\n");
+		return -1;
+	}
+	for(; !librdf_stream_end(stream); librdf_stream_next(stream))
+	{
+		if(*count + 1 > size)
+		{
+			size = (size ? size * 2 : 256);
+			p = (librdf_statement **) realloc(*list, size * sizeof(librdf_statement *));
+			if(!p)
+			{
+				break;
+			}
+			*list = p;
+		}
+		st = librdf_new_statement_from_statement(librdf_stream_get_object(stream));
+		if(!st)
+		{
+			break;
+		}
+		(*list)[*count] = st;
+		(*count)++;
+	}
+	if(!librdf_stream_end(stream))
+	{
+		quilt_logf(LOG_CRIT, QUILT_PLUGIN_NAME ": failed to allocate memory for statements\n");
+		librdf_free_stream(stream);
+		rdf_sort_free(*list, *count);
+		*list = NULL;
+		*count = 0;
+		return -1;
+	}
+	librdf_free_stream(stream);
+	if(*count < 2)
+	{
+		return 0;
+	}
+	qsort(*list, *count, sizeof(librdf_statement *), rdf_sort_cmp_);
+	/* Discard duplicates */
+	for(c = 1, n = 1; c < *count; c++)
+	{
+		if(rdf_sort_cmp_(&((*list)[n - 1]), &((*list)[c])))
+		{
+			(*list)[n] = (*list)[c];
+			n++;
+		}
+		else
+		{
+			librdf_free_statement((*list)[c]);
+		}
+	}
+	*count = n;
+	return 0;
+}
+
+void
+rdf_sort_free(librdf_statement **list, size_t count)
+{
+	size_t c;
+
+	for(c = 0; c < count; c++)
+	{
+		librdf_free_statement(list[c]);
+	}
+	free(list);
+}
+
+/* Order nodes by type (URIs, then blank nodes, then literals), and then by
+ * value
+ */
+int
+rdf_node_cmp(librdf_node *a, librdf_node *b)
+{
+	const char *sa, *sb;
+	librdf_uri *ua, *ub;
+	int ta, tb, r;
+
+	ta = librdf_node_is_resource(a) ? 0 : (librdf_node_is_blank(a) ? 1 : 2);
+	tb = librdf_node_is_resource(b) ? 0 : (librdf_node_is_blank(b) ? 1 : 2);
+	if(ta != tb)
+	{
+		return ta - tb;
+	}
+	switch(ta)
+	{
+	case 0:
+		return strcmp((const char *) librdf_uri_as_string(librdf_node_get_uri(a)), (const char *) librdf_uri_as_string(librdf_node_get_uri(b)));
+	case 1:
+		return strcmp((const char *) librdf_node_get_blank_identifier(a), (const char *) librdf_node_get_blank_identifier(b));
+	}
+	r = strcmp((const char *) librdf_node_get_literal_value(a), (const char *) librdf_node_get_literal_value(b));
+	if(r)
+	{
+		return r;
+	}
+	sa = librdf_node_get_literal_value_language(a);
+	sb = librdf_node_get_literal_value_language(b);
+	r = strcmp(sa ? sa : "", sb ? sb : "");
+	if(r)
+	{
+		return r;
+	}
+	ua = librdf_node_get_literal_value_datatype_uri(a);
+	ub = librdf_node_get_literal_value_datatype_uri(b);
+	sa = ua ? (const char *) librdf_uri_as_string(ua) : "";
+	sb = ub ? (const char *) librdf_uri_as_string(ub) : "";
+	return strcmp(sa, sb);
+}
+
+/* Determine whether a node is the URI rdf:type */
+int
+rdf_node_is_type(librdf_node *node)
+{
+	return librdf_node_is_resource(node) && !strcmp((const char *) librdf_uri_as_string(librdf_node_get_uri(node)), NS_RDF "type");
+}
+
+static int
+rdf_sort_cmp_(const void *a, const void *b)
+{
+	librdf_statement *sa, *sb;
+	int r;
+
+	sa = *(librdf_statement *const *) a;
+	sb = *(librdf_statement *const *) b;
+	r = rdf_node_cmp(librdf_statement_get_subject(sa), librdf_statement_get_subject(sb));
+	if(!r)
+	{
+		r = rdf_sort_cmp_pred_(librdf_statement_get_predicate(sa), librdf_statement_get_predicate(sb));
+	}
+	if(!r)
+	{
+		r = rdf_node_cmp(librdf_statement_get_object(sa), librdf_statement_get_object(sb));
+	}
+	return r;
+}
+
+/* As rdf_node_cmp(), except that rdf:type always sorts first */
+static int
+rdf_sort_cmp_pred_(librdf_node *a, librdf_node *b)
+{
+	int ta, tb;
+
+	ta = rdf_node_is_type(a);
+	tb = rdf_node_is_type(b);
+	if(ta || tb)
+	{
+		return tb - ta;
+	}
+	return rdf_node_cmp(a, b);
+}
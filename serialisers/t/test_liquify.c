@@ -0,0 +1,262 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <jansson.h>
+#include "CUnit/Basic.h"
+#include "libliquify.h"
+
+static LIQUIFY *env;
+
+int init_suite(void)
+{
+    env = liquify_create();
+    return env ? 0 : -1;
+}
+
+int clean_suite(void)
+{
+    liquify_destroy(env);
+    return 0;
+}
+
+/* Apply a template to a dictionary given as JSON text */
+static char *apply(LIQUIFYTPL *tpl, const char *json)
+{
+    json_t *dict = json_loads(json, 0, NULL);
+    char *out = liquify_apply(tpl, dict);
+    json_decref(dict);
+    return out;
+}
+
+static int check(LIQUIFYTPL *tpl, const char *json, const char *expected)
+{
+    char *out = apply(tpl, json);
+    int r = (out != NULL && strcmp(out, expected) == 0);
+    if (!r)
+        printf("expected '%s', got '%s'\n", expected, out ? out : "(null)");
+    free(out);
+    return r;
+}
+
+void test_apply(void)
+{
+    printf("\nTest liquify_apply\n");
+    const char *doc = "Hello {{ name }}!{% if list %}{% for x in list %}[{{ x }}]{% endfor %}{% endif %}";
+    LIQUIFYTPL *tpl = liquify_parse(env, "apply", doc, strlen(doc));
+
+    CU_ASSERT_FATAL(tpl != NULL);
+    CU_ASSERT(check(tpl, "{\"name\": \"World\"}", "Hello World!"));
+    CU_ASSERT(check(tpl, "{\"name\": \"you\", \"list\": [1, \"two\", true]}", "Hello you![1][two][true]"));
+}
+
+void test_constant(void)
+{
+    printf("\nTest liquify_set_constant\n");
+    const char *doc = "<h1>{{ site.title }}</h1>{{ page }}{% for site in pages %}({{ site }}){% endfor %}";
+    LIQUIFYTPL *tpl = liquify_parse(env, "constant", doc, strlen(doc));
+
+    CU_ASSERT_FATAL(tpl != NULL);
+    /* Declaring a constant after the template has been compiled causes it
+     * to be compiled again
+     */
+    CU_ASSERT(liquify_set_constant(env, "site") == 0);
+    tpl = liquify_locate(env, "constant");
+    CU_ASSERT_FATAL(tpl != NULL);
+    CU_ASSERT(check(tpl, "{\"site\": {\"title\": \"A\"}, \"page\": \"one\", \"pages\": []}", "<h1>A</h1>one"));
+    /* The output of the constant fragment is re-used, while everything
+     * else follows the data
+     */
+    CU_ASSERT(check(tpl, "{\"site\": {\"title\": \"B\"}, \"page\": \"two\", \"pages\": []}", "<h1>A</h1>two"));
+    /* A loop variable shadowing the constant is not mistaken for it */
+    CU_ASSERT(check(tpl, "{\"site\": {\"title\": \"A\"}, \"page\": \"three\", \"pages\": [\"x\", \"y\"]}", "<h1>A</h1>three(x)(y)"));
+}
+
+/* A provider whose root has a single member, "obj", which fails to be
+ * emitted the first time it is asked to
+ */
+static int failures;
+
+static int failing_get(void *obj, const char *key, LIQUIFYVALUE *value);
+static int failing_emit(LIQUIFYCTX *ctx, void *obj);
+
+static const LIQUIFYPROVIDER failing_provider = {
+    failing_get, NULL, NULL, NULL, failing_emit
+};
+
+static int failing_get(void *obj, const char *key, LIQUIFYVALUE *value)
+{
+    if (strcmp(key, "obj"))
+        return 0;
+    liquify_value_object(value, &failing_provider, obj);
+    return 1;
+}
+
+static int failing_emit(LIQUIFYCTX *ctx, void *obj)
+{
+    if (failures) {
+        failures--;
+        return -1;
+        }
+    return liquify_emit_str(ctx, "ok");
+}
+
+void test_fragment_failure(void)
+{
+    printf("\nTest fragment failure\n");
+    const char *doc = "<p>{{ obj }}</p>";
+    LIQUIFYTPL *tpl;
+    char *out;
+
+    CU_ASSERT(liquify_set_constant(env, "obj") == 0);
+    tpl = liquify_parse(env, "failure", doc, strlen(doc));
+    CU_ASSERT_FATAL(tpl != NULL);
+    failures = 1;
+    out = liquify_apply_data(tpl, &failing_provider, (void *) &failures);
+    CU_ASSERT(out == NULL);
+    free(out);
+    /* The partial output of the failed attempt must not have been kept */
+    out = liquify_apply_data(tpl, &failing_provider, (void *) &failures);
+    CU_ASSERT(out != NULL && strcmp(out, "<p>ok</p>") == 0);
+    free(out);
+}
+
+/* Templates which are made available to the include tests by their loader */
+static const char *includes[][2] = {
+    { "item", "[{{ x }}]" },
+    { "list", "{% if list %}{% for i in list %}<{{ i }}>{% endfor %}{% else %}none{% endif %}" },
+    { "bad", "{% if obj %}[{{ obj }}]{% endif %}" },
+    { "undefined", "{% if x %}({% for y in missing %}{{ y }}{% endfor %}){% endif %}" },
+    { NULL, NULL }
+};
+
+static LIQUIFYTPL *loader(LIQUIFY *env, const char *name, void *data)
+{
+    for (int i=0; includes[i][0]; i++) {
+        if (!strcmp(includes[i][0], name))
+            return liquify_parse(env, name, includes[i][1], strlen(includes[i][1]));
+        }
+    return NULL;
+}
+
+void test_include(void)
+{
+    printf("\nTest include\n");
+    const char *doc = "{% for x in list %}{% include 'item' %}{% endfor %}|{% include 'list' %}|{% if list %}end{% endif %}";
+    LIQUIFY *incenv = liquify_create();
+    LIQUIFYTPL *tpl;
+
+    CU_ASSERT_FATAL(incenv != NULL);
+    CU_ASSERT(liquify_set_loader(incenv, loader, NULL) == 0);
+    tpl = liquify_parse(incenv, "include", doc, strlen(doc));
+    CU_ASSERT_FATAL(tpl != NULL);
+    /* The included templates are compiled in place, with the jumps of
+     * their blocks adjusted to match, and can see the loop variables of
+     * the template which includes them
+     */
+    CU_ASSERT(check(tpl, "{\"list\": [1, 2]}", "[1][2]|<1><2>|end"));
+    CU_ASSERT(check(tpl, "{\"list\": [\"a\"]}", "[a]|<a>|end"));
+    CU_ASSERT(check(tpl, "{\"list\": false}", "|none|"));
+    liquify_destroy(incenv);
+}
+
+void test_include_failure(void)
+{
+    printf("\nTest include failure\n");
+    const char *doc = "<p>{% include 'bad' %}{% if obj %}({{ obj }}){% endif %}</p>";
+    LIQUIFY *incenv = liquify_create();
+    LIQUIFYTPL *tpl;
+    char *out;
+
+    CU_ASSERT_FATAL(incenv != NULL);
+    CU_ASSERT(liquify_set_loader(incenv, loader, NULL) == 0);
+    tpl = liquify_parse(incenv, "include-failure", doc, strlen(doc));
+    CU_ASSERT_FATAL(tpl != NULL);
+    /* The output and the blocks of the included template which failed are
+     * discarded, and the template which included it continues
+     */
+    failures = 1;
+    out = liquify_apply_data(tpl, &failing_provider, (void *) &failures);
+    CU_ASSERT(out != NULL && strcmp(out, "<p>[failed to include 'bad'](ok)</p>") == 0);
+    free(out);
+    failures = 0;
+    out = liquify_apply_data(tpl, &failing_provider, (void *) &failures);
+    CU_ASSERT(out != NULL && strcmp(out, "<p>[ok](ok)</p>") == 0);
+    free(out);
+    /* A loop in the including template is unaffected by the blocks which
+     * were open in the included one when it failed
+     */
+    doc = "{% for x in list %}{% include 'undefined' %}{{ x }}{% endfor %}.";
+    tpl = liquify_parse(incenv, "include-loop", doc, strlen(doc));
+    CU_ASSERT_FATAL(tpl != NULL);
+    CU_ASSERT(check(tpl, "{\"list\": [1, 2]}", "[failed to include 'undefined']1[failed to include 'undefined']2."));
+    liquify_destroy(incenv);
+}
+
+struct stream_data {
+    char buf[256];
+    size_t len;
+    int fail;
+};
+
+static int stream_write(const char *buf, size_t len, void *data)
+{
+    struct stream_data *p = (struct stream_data *) data;
+
+    if (p->fail)
+        return -1;
+    if (p->len + len >= sizeof(p->buf))
+        return -1;
+    memcpy(&(p->buf[p->len]), buf, len);
+    p->len += len;
+    p->buf[p->len] = 0;
+    return 0;
+}
+
+void test_stream(void)
+{
+    printf("\nTest liquify_apply_stream\n");
+    const char *doc = "Hello {{ name }}!{% for x in list %}[{{ x }}]{% endfor %}";
+    LIQUIFYTPL *tpl = liquify_parse(env, "stream", doc, strlen(doc));
+    json_t *dict = json_loads("{\"name\": \"World\", \"list\": [1, 2]}", 0, NULL);
+    struct stream_data data;
+
+    CU_ASSERT_FATAL(tpl != NULL);
+    memset(&data, 0, sizeof(data));
+    CU_ASSERT(liquify_apply_stream(tpl, &liquify_json_provider, dict, stream_write, &data) == 0);
+    CU_ASSERT(strcmp(data.buf, "Hello World![1][2]") == 0);
+    /* A failure to write stops the template from being applied */
+    memset(&data, 0, sizeof(data));
+    data.fail = 1;
+    CU_ASSERT(liquify_apply_stream(tpl, &liquify_json_provider, dict, stream_write, &data) == -1);
+    json_decref(dict);
+}
+
+int main()
+{
+   CU_pSuite pSuite = NULL;
+
+   if (CUE_SUCCESS != CU_initialize_registry())
+      return CU_get_error();
+
+   pSuite = CU_add_suite("Quilt_Test", init_suite, clean_suite);
+   if (NULL == pSuite) {
+      CU_cleanup_registry();
+      return CU_get_error();
+   }
+
+   if (NULL == CU_add_test(pSuite, "test liquify_apply", test_apply) ||
+       NULL == CU_add_test(pSuite, "test liquify_set_constant", test_constant) ||
+       NULL == CU_add_test(pSuite, "test fragment failure", test_fragment_failure) ||
+       NULL == CU_add_test(pSuite, "test include", test_include) ||
+       NULL == CU_add_test(pSuite, "test include failure", test_include_failure) ||
+       NULL == CU_add_test(pSuite, "test liquify_apply_stream", test_stream))
+   {
+      CU_cleanup_registry();
+      return CU_get_error();
+   }
+
+   CU_basic_set_mode(CU_BRM_VERBOSE);
+   CU_basic_run_tests();
+   CU_cleanup_registry();
+   return CU_get_error();
+}
@@ -1,4 +1,5 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <jansson.h>
 #include "CUnit/Basic.h"
@@ -14,25 +15,30 @@ int clean_suite(void)
     return 0;
 }
 
-void test_sort_items_by_index(void)
+void test_cmp_item_index(void)
 {
-    printf("\nTest sort_items_by_index\n");
-    int size = 3;
-    json_t *items[size];
+    printf("\nTest cmp_item_index\n");
+    const char *indexes[] = { "3", "10", NULL, "9", "1" };
+    int size = 5;
+    struct html_item_struct items[size];
+    struct html_item_struct *results[size];
     for (int i=0; i<size; i++) {
-        items[i] = json_object();
-        char index[80];
-        sprintf(index, "%d", size-i);
-        json_object_set(items[i], "index", json_string(index));
-        char *value = json_string_value(json_object_get(items[i], "index"));
-        printf("test data: item[%d] = %s\n", i, value);
+        memset(&items[i], 0, sizeof(items[i]));
+        items[i].index = indexes[i];
+        results[i] = &items[i];
+        printf("test data: item[%d] = %s\n", i, indexes[i] ? indexes[i] : "(none)");
         }
 
-    sort_items_by_index(items, size);
+    qsort(results, size, sizeof(results[0]), cmp_item_index);
 
-    CU_ASSERT(strcmp(json_string_value(json_object_get(items[0], "index")), "1") == 0);
-    CU_ASSERT(strcmp(json_string_value(json_object_get(items[1], "index")), "2") == 0);
-    CU_ASSERT(strcmp(json_string_value(json_object_get(items[2], "index")), "3") == 0);
+    /* Items without an index sort as though their index were zero, and
+     * indexes are compared numerically
+     */
+    CU_ASSERT(results[0]->index == NULL);
+    CU_ASSERT(strcmp(results[1]->index, "1") == 0);
+    CU_ASSERT(strcmp(results[2]->index, "3") == 0);
+    CU_ASSERT(strcmp(results[3]->index, "9") == 0);
+    CU_ASSERT(strcmp(results[4]->index, "10") == 0);
 }
 
 int main()
@@ -48,7 +54,7 @@ int main()
       return CU_get_error();
    }
 
-   if (NULL == CU_add_test(pSuite, "test sort_items_by_index", test_sort_items_by_index))
+   if (NULL == CU_add_test(pSuite, "test cmp_item_index", test_cmp_item_index))
    {
       CU_cleanup_registry();
       return CU_get_error();
@@ -0,0 +1,91 @@
+#include <stdio.h>
+#include <string.h>
+#include "CUnit/Basic.h"
+#include "../p_rdf.h"
+
+static RDFWRITER writer;
+
+int init_suite(void)
+{
+    return 0;
+}
+
+int clean_suite(void)
+{
+    return 0;
+}
+
+/* Escape len bytes of str, returning what was written; the output is
+ * small enough never to be flushed, and so no request is needed
+ */
+static const char *escape(RDFESCAPE rules, const char *str, size_t len)
+{
+    rdf_writer_init(&writer, NULL);
+    CU_ASSERT(rdf_writer_escape(&writer, rules, str, len) == 0);
+    writer.buf[writer.len] = 0;
+    return (const char *) writer.buf;
+}
+
+void test_escape_string(void)
+{
+    printf("\nTest rdf_writer_escape (RWE_STRING)\n");
+    CU_ASSERT(strcmp(escape(RWE_STRING, "plain text", 10), "plain text") == 0);
+    CU_ASSERT(strcmp(escape(RWE_STRING, "", 0), "") == 0);
+    CU_ASSERT(strcmp(escape(RWE_STRING, "say \"hi\"", 8), "say \\\"hi\\\"") == 0);
+    CU_ASSERT(strcmp(escape(RWE_STRING, "back\\slash", 10), "back\\\\slash") == 0);
+    CU_ASSERT(strcmp(escape(RWE_STRING, "\b\t\n\f\r", 5), "\\b\\t\\n\\f\\r") == 0);
+    /* Other control characters, including NUL, are written as \uXXXX */
+    CU_ASSERT(strcmp(escape(RWE_STRING, "a\001b\037", 4), "a\\u0001b\\u001F") == 0);
+    CU_ASSERT(strcmp(escape(RWE_STRING, "a\0b", 3), "a\\u0000b") == 0);
+    /* Characters which are only special within IRIs, and UTF-8, are not */
+    CU_ASSERT(strcmp(escape(RWE_STRING, "<a b>{}|^`", 10), "<a b>{}|^`") == 0);
+    CU_ASSERT(strcmp(escape(RWE_STRING, "caf\303\251", 5), "caf\303\251") == 0);
+    /* Only the specified number of bytes are written */
+    CU_ASSERT(strcmp(escape(RWE_STRING, "abc\"def", 3), "abc") == 0);
+}
+
+void test_escape_iri(void)
+{
+    printf("\nTest rdf_writer_escape (RWE_IRI)\n");
+    CU_ASSERT(strcmp(escape(RWE_IRI, "http://example.com/a?b=c&d#e", 28), "http://example.com/a?b=c&d#e") == 0);
+    CU_ASSERT(strcmp(escape(RWE_IRI, "a b", 3), "a\\u0020b") == 0);
+    CU_ASSERT(strcmp(escape(RWE_IRI, "<>\"{}|^`\\", 9), "\\u003C\\u003E\\u0022\\u007B\\u007D\\u007C\\u005E\\u0060\\u005C") == 0);
+    CU_ASSERT(strcmp(escape(RWE_IRI, "\n", 1), "\\u000A") == 0);
+    CU_ASSERT(strcmp(escape(RWE_IRI, "caf\303\251", 5), "caf\303\251") == 0);
+}
+
+void test_writer_iri(void)
+{
+    printf("\nTest rdf_writer_iri\n");
+    rdf_writer_init(&writer, NULL);
+    CU_ASSERT(rdf_writer_iri(&writer, "http://example.com/a b", 22) == 0);
+    writer.buf[writer.len] = 0;
+    CU_ASSERT(strcmp((const char *) writer.buf, "<http://example.com/a\\u0020b>") == 0);
+}
+
+int main()
+{
+   CU_pSuite pSuite = NULL;
+
+   if (CUE_SUCCESS != CU_initialize_registry())
+      return CU_get_error();
+
+   pSuite = CU_add_suite("Quilt_Test", init_suite, clean_suite);
+   if (NULL == pSuite) {
+      CU_cleanup_registry();
+      return CU_get_error();
+   }
+
+   if (NULL == CU_add_test(pSuite, "test rdf_writer_escape (RWE_STRING)", test_escape_string) ||
+       NULL == CU_add_test(pSuite, "test rdf_writer_escape (RWE_IRI)", test_escape_iri) ||
+       NULL == CU_add_test(pSuite, "test rdf_writer_iri", test_writer_iri))
+   {
+      CU_cleanup_registry();
+      return CU_get_error();
+   }
+
+   CU_basic_set_mode(CU_BRM_VERBOSE);
+   CU_basic_run_tests();
+   CU_cleanup_registry();
+   return CU_get_error();
+}
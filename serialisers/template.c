@@ -53,6 +53,10 @@ html_template_init(void)
 	}
 	liquify_set_logger(liquify, quilt_vlogf);
 	liquify_set_loader(liquify, html_parse_, NULL);
+	/* Information about the package (see html_add_common()) is the same for
+	 * every request
+	 */
+	liquify_set_constant(liquify, "package");
 	tpl_home = liquify_load(liquify, "home.liquid");
 	tpl_item = liquify_load(liquify, "item.liquid");
 	tpl_index = liquify_load(liquify, "index.liquid");
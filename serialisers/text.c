@@ -109,11 +109,10 @@ static int
 text_serialize_uri(QUILTREQ *req, librdf_uri *uri)
 {
 	const char *str;
-	char *contracted;
+	char contracted[512];
 
 	str = (const char *) librdf_uri_as_string(uri);
-	contracted = quilt_uri_contract(str);
-	if(strcmp(contracted, str))
+	if(quilt_uri_contract_buf(str, contracted, sizeof(contracted)) == 1)
 	{		
 		quilt_request_puts(req, contracted);
 	}
@@ -121,7 +120,6 @@ text_serialize_uri(QUILTREQ *req, librdf_uri *uri)
 	{
 		quilt_request_printf(req, "<%s>", str);
 	}
-	free(contracted);
 	return 0;
 }
 
@@ -176,7 +174,7 @@ text_serialize_subject(QUILTREQ *req, librdf_node *context, librdf_node *subject
 	/* Always emit rdf:type first */
 	query = librdf_new_statement(world);
 	librdf_statement_set_subject(query, librdf_new_node_from_node(subject));
-	librdf_statement_set_predicate(query, quilt_node_create_uri("http://www.w3.org/1999/02/22-rdf-syntax-ns#type"));
+	librdf_statement_set_predicate(query, librdf_new_node_from_node(quilt_node_intern("http://www.w3.org/1999/02/22-rdf-syntax-ns#type")));
 	if(context)
 	{
 		stream = librdf_model_find_statements_with_options(model, query, context, NULL);
@@ -0,0 +1,208 @@
+/* Quilt: A Linked Open Data server
+ *
+ * Native Turtle serializer
+ *
+ * Statements are sorted (see sort.c) before being written, so that the
+ * same model always produces the same output. Triples
+ * are grouped by subject and predicate, and URIs are abbreviated using the
+ * configured namespaces wherever the result is a valid prefixed name.
+ *
+ * Author: Mo McRoberts <mo.mcroberts@bbc.co.uk>
+ *
+ * Copyright (c) 2017 BBC
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include "p_rdf.h"
+
+static int turtle_serialize(QUILTREQ *req);
+static int turtle_prefix_cb_(const char *prefix, const char *uri, void *data);
+static int turtle_write_predicate_(RDFWRITER *writer, librdf_node *node);
+static int turtle_write_node_(RDFWRITER *writer, librdf_node *node);
+static int turtle_write_uri_(RDFWRITER *writer, librdf_uri *uri);
+static int turtle_local_valid_(const char *local);
+
+static QUILTTYPE turtle_type = { "text/turtle", "ttl", "Turtle", 0.9f, 1, NULL };
+
+int
+turtle_init(void)
+{
+	return quilt_plugin_register_serializer(&turtle_type, turtle_serialize);
+}
+
+static int
+turtle_serialize(QUILTREQ *req)
+{
+	RDFWRITER writer;
+	librdf_statement **list, *st, *prev;
+	librdf_node *subject, *predicate;
+	size_t count, c;
+
+	if(rdf_sort_model(quilt_request_model(req), &list, &count))
+	{
+		return 500;
+	}
+	rdf_writer_init(&writer, req);
+	rdf_writer_headers(&writer, turtle_type.mimetype);
+	quilt_ns_get_all(turtle_prefix_cb_, &writer);
+	prev = NULL;
+	for(c = 0; c < count && !writer.error; c++)
+	{
+		st = list[c];
+		subject = librdf_statement_get_subject(st);
+		predicate = librdf_statement_get_predicate(st);
+		if(!prev || rdf_node_cmp(librdf_statement_get_subject(prev), subject))
+		{
+			if(prev)
+			{
+				rdf_writer_put(&writer, " .\n", 3);
+			}
+			rdf_writer_putc(&writer, '\n');
+			turtle_write_node_(&writer, subject);
+			rdf_writer_put(&writer, "\n\t", 2);
+			turtle_write_predicate_(&writer, predicate);
+		}
+		else if(rdf_node_cmp(librdf_statement_get_predicate(prev), predicate))
+		{
+			rdf_writer_put(&writer, " ;\n\t", 4);
+			turtle_write_predicate_(&writer, predicate);
+		}
+		else
+		{
+			rdf_writer_putc(&writer, ',');
+		}
+		rdf_writer_putc(&writer, ' ');
+		turtle_write_node_(&writer, librdf_statement_get_object(st));
+		prev = st;
+	}
+	if(prev)
+	{
+		rdf_writer_put(&writer, " .\n", 3);
+	}
+	rdf_writer_flush(&writer);
+	if(writer.error)
+	{
+		quilt_logf(LOG_ERR, QUILT_PLUGIN_NAME ": failed to write Turtle response\n");
+	}
+	rdf_sort_free(list, count);
+	return 0;
+}
+
+static int
+turtle_prefix_cb_(const char *prefix, const char *uri, void *data)
+{
+	RDFWRITER *writer;
+
+	writer = (RDFWRITER *) data;
+	rdf_writer_put(writer, "@prefix ", 8);
+	rdf_writer_puts(writer, prefix);
+	rdf_writer_put(writer, ": ", 2);
+	rdf_writer_iri(writer, uri, strlen(uri));
+	rdf_writer_put(writer, " .\n", 3);
+	return 0;
+}
+
+/* Write a predicate, using the 'a' shorthand for rdf:type, which is only
+ * valid in the predicate position
+ */
+static int
+turtle_write_predicate_(RDFWRITER *writer, librdf_node *node)
+{
+	if(rdf_node_is_type(node))
+	{
+		return rdf_writer_putc(writer, 'a');
+	}
+	return turtle_write_node_(writer, node);
+}
+
+static int
+turtle_write_node_(RDFWRITER *writer, librdf_node *node)
+{
+	const char *str, *lang;
+	librdf_uri *uri;
+	size_t len;
+
+	if(librdf_node_is_resource(node))
+	{
+		return turtle_write_uri_(writer, librdf_node_get_uri(node));
+	}
+	if(librdf_node_is_literal(node))
+	{
+		str = (const char *) librdf_node_get_literal_value_as_counted_string(node, &len);
+		rdf_writer_putc(writer, '"');
+		rdf_writer_escape(writer, RWE_STRING, str, len);
+		rdf_writer_putc(writer, '"');
+		lang = librdf_node_get_literal_value_language(node);
+		uri = librdf_node_get_literal_value_datatype_uri(node);
+		if(lang && lang[0])
+		{
+			rdf_writer_putc(writer, '@');
+			rdf_writer_puts(writer, lang);
+		}
+		else if(uri && strcmp((const char *) librdf_uri_as_string(uri), NS_XSD "string"))
+		{
+			rdf_writer_put(writer, "^^", 2);
+			turtle_write_uri_(writer, uri);
+		}
+		return writer->error ? -1 : 0;
+	}
+	return rdf_writer_node(writer, node);
+}
+
+/* Write a URI as a prefixed name if possible, or as an IRI otherwise */
+static int
+turtle_write_uri_(RDFWRITER *writer, librdf_uri *uri)
+{
+	const char *str;
+	char contracted[RDF_CONTRACT_BUFSIZE], *local;
+	size_t len;
+
+	str = (const char *) librdf_uri_as_counted_string(uri, &len);
+	if(quilt_uri_contract_buf(str, contracted, sizeof(contracted)) == 1)
+	{
+		local = strchr(contracted, ':');
+		if(local && turtle_local_valid_(local + 1))
+		{
+			return rdf_writer_puts(writer, contracted);
+		}
+	}
+	return rdf_writer_iri(writer, str, len);
+}
+
+/* Determine whether the local part of a prefixed name can be written
+ * without escaping; this accepts a conservative subset of PN_LOCAL
+ */
+static int
+turtle_local_valid_(const char *local)
+{
+	const unsigned char *p;
+
+	for(p = (const unsigned char *) local; *p; p++)
+	{
+		if((*p >= 'a' && *p <= 'z') || (*p >= 'A' && *p <= 'Z') || (*p >= '0' && *p <= '9') || *p == '_')
+		{
+			continue;
+		}
+		if(p != (const unsigned char *) local && (*p == '-' || (*p == '.' && p[1])))
+		{
+			continue;
+		}
+		return 0;
+	}
+	return 1;
+}
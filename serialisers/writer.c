@@ -0,0 +1,247 @@
+/* Quilt: A Linked Open Data server
+ *
+ * Buffered output of RDF terms, shared by the native serializers
+ *
+ * Author: Mo McRoberts <mo.mcroberts@bbc.co.uk>
+ *
+ * Copyright (c) 2017 BBC
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include "p_rdf.h"
+
+/* For each byte, the character following the backslash when it must be
+ * escaped within a string literal, 'u' if it must be written as \uXXXX,
+ * or zero if it can be written as-is. The same rules apply to JSON strings.
+ */
+static const char string_escapes[256] = {
+	'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'b', 't', 'n', 'u', 'f', 'r', 'u', 'u',
+	'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u',
+	0, 0, '"', 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, '\\', 0, 0, 0
+};
+
+/* The characters which may not appear unescaped within an IRI reference */
+static const char iri_escapes[256] = {
+	'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u',
+	'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u',
+	'u', 0, 'u', 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 'u', 0, 'u', 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 'u', 0, 'u', 0,
+	'u', 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 'u', 'u', 'u', 0, 0
+};
+
+static const char hexdigits[] = "0123456789ABCDEF";
+
+void
+rdf_writer_init(RDFWRITER *writer, QUILTREQ *req)
+{
+	writer->req = req;
+	writer->len = 0;
+	writer->error = 0;
+}
+
+/* Emit the response headers for a serialisation of the request's model */
+int
+rdf_writer_headers(RDFWRITER *writer, const char *mimetype)
+{
+	QUILTREQ *req;
+	char *loc;
+
+	req = writer->req;
+	loc = quilt_canon_str(quilt_request_canonical(req), QCO_CONCRETE|QCO_NOABSOLUTE);
+	quilt_request_headerf(req, "Status: %d %s\n", quilt_request_status(req), quilt_request_statustitle(req));
+	if(!strncmp(mimetype, "text/", 5))
+	{
+		quilt_request_headerf(req, "Content-Type: %s; charset=utf-8\n", mimetype);
+	}
+	else
+	{
+		quilt_request_headerf(req, "Content-Type: %s\n", mimetype);
+	}
+	if(loc)
+	{
+		quilt_request_headerf(req, "Content-Location: %s\n", loc);
+	}
+	quilt_request_headers(req, "Vary: Accept\n");
+	quilt_request_headers(req, "Server: " PACKAGE_SIGNATURE "\n");
+	free(loc);
+	return 0;
+}
+
+int
+rdf_writer_put(RDFWRITER *writer, const char *bytes, size_t len)
+{
+	if(writer->len + len > RDF_WRITER_BUFSIZE)
+	{
+		rdf_writer_flush(writer);
+		if(len > RDF_WRITER_BUFSIZE)
+		{
+			/* Too large to be worth buffering */
+			if(quilt_request_put(writer->req, (const unsigned char *) bytes, len) < 0)
+			{
+				writer->error = 1;
+				return -1;
+			}
+			return 0;
+		}
+	}
+	memcpy(&(writer->buf[writer->len]), bytes, len);
+	writer->len += len;
+	return 0;
+}
+
+int
+rdf_writer_puts(RDFWRITER *writer, const char *str)
+{
+	return rdf_writer_put(writer, str, strlen(str));
+}
+
+int
+rdf_writer_putc(RDFWRITER *writer, int ch)
+{
+	if(writer->len + 1 > RDF_WRITER_BUFSIZE)
+	{
+		rdf_writer_flush(writer);
+	}
+	writer->buf[writer->len] = (unsigned char) ch;
+	writer->len++;
+	return 0;
+}
+
+/* Write str, escaping characters according to the specified rules; runs of
+ * characters which need no escaping are copied as-is
+ */
+int
+rdf_writer_escape(RDFWRITER *writer, RDFESCAPE rules, const char *str, size_t len)
+{
+	const char *table;
+	char esc[6];
+	size_t start, c;
+	unsigned char ch;
+
+	table = (rules == RWE_IRI ? iri_escapes : string_escapes);
+	start = 0;
+	for(c = 0; c < len; c++)
+	{
+		ch = (unsigned char) str[c];
+		if(!table[ch])
+		{
+			continue;
+		}
+		if(c > start)
+		{
+			rdf_writer_put(writer, &(str[start]), c - start);
+		}
+		start = c + 1;
+		esc[0] = '\\';
+		if(table[ch] == 'u')
+		{
+			esc[1] = 'u';
+			esc[2] = '0';
+			esc[3] = '0';
+			esc[4] = hexdigits[ch >> 4];
+			esc[5] = hexdigits[ch & 15];
+			rdf_writer_put(writer, esc, 6);
+		}
+		else
+		{
+			esc[1] = table[ch];
+			rdf_writer_put(writer, esc, 2);
+		}
+	}
+	if(c > start)
+	{
+		rdf_writer_put(writer, &(str[start]), c - start);
+	}
+	return writer->error ? -1 : 0;
+}
+
+/* Write an IRI in N-Triples form */
+int
+rdf_writer_iri(RDFWRITER *writer, const char *iri, size_t len)
+{
+	rdf_writer_putc(writer, '<');
+	rdf_writer_escape(writer, RWE_IRI, iri, len);
+	return rdf_writer_putc(writer, '>');
+}
+
+/* Write a node in N-Triples form */
+int
+rdf_writer_node(RDFWRITER *writer, librdf_node *node)
+{
+	const char *str, *lang;
+	librdf_uri *uri;
+	size_t len;
+
+	if(librdf_node_is_resource(node))
+	{
+		uri = librdf_node_get_uri(node);
+		str = (const char *) librdf_uri_as_counted_string(uri, &len);
+		return rdf_writer_iri(writer, str, len);
+	}
+	if(librdf_node_is_blank(node))
+	{
+		str = (const char *) librdf_node_get_counted_blank_identifier(node, &len);
+		rdf_writer_put(writer, "_:", 2);
+		return rdf_writer_put(writer, str, len);
+	}
+	if(librdf_node_is_literal(node))
+	{
+		str = (const char *) librdf_node_get_literal_value_as_counted_string(node, &len);
+		rdf_writer_putc(writer, '"');
+		rdf_writer_escape(writer, RWE_STRING, str, len);
+		rdf_writer_putc(writer, '"');
+		lang = librdf_node_get_literal_value_language(node);
+		uri = librdf_node_get_literal_value_datatype_uri(node);
+		if(lang && lang[0])
+		{
+			rdf_writer_putc(writer, '@');
+			rdf_writer_puts(writer, lang);
+		}
+		else if(uri)
+		{
+			rdf_writer_put(writer, "^^", 2);
+			str = (const char *) librdf_uri_as_counted_string(uri, &len);
+			rdf_writer_iri(writer, str, len);
+		}
+		return writer->error ? -1 : 0;
+	}
+	quilt_logf(LOG_ERR, QUILT_PLUGIN_NAME ": unable to serialise node of unknown type\n");
+	writer->error = 1;
+	return -1;
+}
+
+/* Pass any buffered output to the SAPI */
+int
+rdf_writer_flush(RDFWRITER *writer)
+{
+	if(writer->len)
+	{
+		if(quilt_request_put(writer->req, writer->buf, writer->len) < 0)
+		{
+			writer->error = 1;
+		}
+		writer->len = 0;
+	}
+	return writer->error ? -1 : 0;
+}
@@ -0,0 +1,182 @@
+#include <stdio.h>
+#include <string.h>
+#include <syslog.h>
+#include "CUnit/Basic.h"
+#include "p_libquilt.h"
+
+/* The namespaces supplied by the test configuration, in order */
+static const char *namespaces[][2] = {
+    { "rdf", "http://www.w3.org/1999/02/22-rdf-syntax-ns#" },
+    { "ex", "http://example.com/" },
+    { "exa", "http://example.com/a/" },
+    { "dup", "http://example.com/" },
+    { "foaf", "http://xmlns.com/foaf/0.1/" },
+    { NULL, NULL }
+};
+
+static void test_logger(int prio, const char *fmt, va_list ap)
+{
+    if (prio <= LOG_ERR)
+        vfprintf(stderr, fmt, ap);
+}
+
+static size_t test_config_get(const char *key, const char *defval, char *buf, size_t bufsize)
+{
+    if (!defval || !bufsize)
+        return 0;
+    strncpy(buf, defval, bufsize - 1);
+    buf[bufsize - 1] = 0;
+    return strlen(defval);
+}
+
+static char *test_config_geta(const char *key, const char *defval)
+{
+    if (!strcmp(key, "quilt:base"))
+        return strdup("http://www.example.com/");
+    return defval ? strdup(defval) : NULL;
+}
+
+static int test_config_get_int(const char *key, int defval)
+{
+    return defval;
+}
+
+static int test_config_get_bool(const char *key, int defval)
+{
+    return defval;
+}
+
+static int test_config_get_all(const char *section, const char *key, int (*fn)(const char *key, const char *value, void *data), void *data)
+{
+    char buf[64];
+    int r;
+
+    if (strcmp(section, "namespaces"))
+        return 0;
+    for (int i=0; namespaces[i][0]; i++) {
+        sprintf(buf, "namespaces:%s", namespaces[i][0]);
+        r = fn(buf, namespaces[i][1], data);
+        if (r)
+            return r;
+        }
+    return 0;
+}
+
+static struct quilt_configfn_struct configfn = {
+    test_config_get,
+    test_config_geta,
+    test_config_get_int,
+    test_config_get_bool,
+    test_config_get_all
+};
+
+int init_suite(void)
+{
+    if (quilt_log_init_(test_logger) || quilt_config_init_(&configfn) ||
+        quilt_request_init_() || quilt_librdf_init_())
+        return -1;
+    return 0;
+}
+
+int clean_suite(void)
+{
+    return 0;
+}
+
+static int count_ns(const char *prefix, const char *uri, void *data)
+{
+    int *count = (int *) data;
+
+    CU_ASSERT(strcmp(prefix, namespaces[*count][0]) == 0);
+    CU_ASSERT(strcmp(uri, namespaces[*count][1]) == 0);
+    (*count)++;
+    return 0;
+}
+
+void test_ns_get_all(void)
+{
+    printf("\nTest quilt_ns_get_all\n");
+    int count = 0;
+    CU_ASSERT(quilt_ns_get_all(count_ns, &count) == 0);
+    CU_ASSERT(count == 5);
+}
+
+void test_contract_buf(void)
+{
+    printf("\nTest quilt_uri_contract_buf\n");
+    char buf[64];
+
+    CU_ASSERT(quilt_uri_contract_buf("http://www.w3.org/1999/02/22-rdf-syntax-ns#type", buf, sizeof(buf)) == 1);
+    CU_ASSERT(strcmp(buf, "rdf:type") == 0);
+    CU_ASSERT(quilt_uri_contract_buf("http://xmlns.com/foaf/0.1/name", buf, sizeof(buf)) == 1);
+    CU_ASSERT(strcmp(buf, "foaf:name") == 0);
+    /* The longest matching namespace is used */
+    CU_ASSERT(quilt_uri_contract_buf("http://example.com/a/b", buf, sizeof(buf)) == 1);
+    CU_ASSERT(strcmp(buf, "exa:b") == 0);
+    CU_ASSERT(quilt_uri_contract_buf("http://example.com/ab", buf, sizeof(buf)) == 1);
+    CU_ASSERT(strcmp(buf, "ex:ab") == 0);
+    /* Where namespaces share a URI, the first defined is used */
+    CU_ASSERT(quilt_uri_contract_buf("http://example.com/", buf, sizeof(buf)) == 1);
+    CU_ASSERT(strcmp(buf, "ex:") == 0);
+    /* URIs which don't begin with a namespace are copied unchanged */
+    CU_ASSERT(quilt_uri_contract_buf("http://example.org/x", buf, sizeof(buf)) == 0);
+    CU_ASSERT(strcmp(buf, "http://example.org/x") == 0);
+    CU_ASSERT(quilt_uri_contract_buf("http://example.co", buf, sizeof(buf)) == 0);
+    CU_ASSERT(strcmp(buf, "http://example.co") == 0);
+    CU_ASSERT(quilt_uri_contract_buf("", buf, sizeof(buf)) == 0);
+    CU_ASSERT(strcmp(buf, "") == 0);
+}
+
+void test_contract_buf_size(void)
+{
+    printf("\nTest quilt_uri_contract_buf (buffer size)\n");
+    char buf[64];
+
+    /* "rdf:type" and its terminator need exactly 9 bytes */
+    CU_ASSERT(quilt_uri_contract_buf("http://www.w3.org/1999/02/22-rdf-syntax-ns#type", buf, 9) == 1);
+    CU_ASSERT(strcmp(buf, "rdf:type") == 0);
+    CU_ASSERT(quilt_uri_contract_buf("http://www.w3.org/1999/02/22-rdf-syntax-ns#type", buf, 8) == -1);
+    CU_ASSERT(quilt_uri_contract_buf("http://example.org/x", buf, 21) == 0);
+    CU_ASSERT(quilt_uri_contract_buf("http://example.org/x", buf, 20) == -1);
+}
+
+void test_contract(void)
+{
+    printf("\nTest quilt_uri_contract\n");
+    char *p;
+
+    p = quilt_uri_contract("http://example.com/a/b");
+    CU_ASSERT(p != NULL && strcmp(p, "exa:b") == 0);
+    free(p);
+    p = quilt_uri_contract("http://example.org/x");
+    CU_ASSERT(p != NULL && strcmp(p, "http://example.org/x") == 0);
+    free(p);
+}
+
+int main()
+{
+   CU_pSuite pSuite = NULL;
+
+   if (CUE_SUCCESS != CU_initialize_registry())
+      return CU_get_error();
+
+   pSuite = CU_add_suite("Quilt_Test", init_suite, clean_suite);
+   if (NULL == pSuite) {
+      CU_cleanup_registry();
+      return CU_get_error();
+   }
+
+   if (NULL == CU_add_test(pSuite, "test quilt_ns_get_all", test_ns_get_all) ||
+       NULL == CU_add_test(pSuite, "test quilt_uri_contract_buf", test_contract_buf) ||
+       NULL == CU_add_test(pSuite, "test quilt_uri_contract_buf (buffer size)", test_contract_buf_size) ||
+       NULL == CU_add_test(pSuite, "test quilt_uri_contract", test_contract))
+   {
+      CU_cleanup_registry();
+      return CU_get_error();
+   }
+
+   CU_basic_set_mode(CU_BRM_VERBOSE);
+   CU_basic_run_tests();
+   CU_cleanup_registry();
+   return CU_get_error();
+}